@@ -0,0 +1,1914 @@
+/*
+ * =====================================================================
+ * TETRIS STACK - NIVEL MESTRE
+ * Benchmark das Estruturas (Fila Circular e Pilha)
+ * =====================================================================
+ * Descricao: Mede o custo (ns/op e ops/s) das primitivas da fila e da
+ * pilha, das trocas e de uma carga mista realista. Cada amostra executa
+ * um lote de operacoes; o p50/p99 e calculado sobre o ns/op de cada lote.
+ * A fila com indice por mascara e comparada com a versao original por
+ * modulo (FilaModulo) nos casos ciclo_fila_*.
+ * --escala mede o Escalonador com 1..N trabalhadores sobre o mesmo
+ * roteiro e confere que o estado final das sessoes nao muda.
+ * --spsc e o teste de estresse da FilaSpsc: um Alimentador produz
+ * numa thread e o consumidor confere cada peca contra um gerador de
+ * referencia com a mesma semente (nenhuma perdida, repetida ou fora
+ * de ordem).
+ * --busca confere o modelo da busca de sequencias contra sessoes reais
+ * e contra uma forca bruta, e mede a busca com 1..N threads.
+ * --soa aplica os mesmos passos sorteados (jogar, reservar, usar) ao
+ * MotorSoA e ao Motor e confere pecas devolvidas e estado sessao a
+ * sessao, em algumas combinacoes de capacidades.
+ * --tabuleiro confere o tabuleiro de bits contra uma grade de chars
+ * (colisao, queda e limpeza de linhas) e mede pecas colocadas/s.
+ * --srs confere as tabelas de rotacao e de chutes contra a geometria
+ * e os deslocamentos de referencia do SRS e mede rotacoes/s.
+ * --perft confere o enumerador de colocacoes (contagens conhecidas no
+ * campo vazio e uma busca na grade de chars) e conta as sequencias de
+ * colocacoes com 1..N pecas da fila, com e sem a reserva.
+ * --montecarlo confere a avaliacao jogar x reservar (repetivel com a
+ * mesma semente, intervalo de 95% cobrindo a media em ~95% das vezes,
+ * sessao intacta) e mede pares de continuacoes/s com 1..N threads.
+ *
+ * Compilacao:
+ *   gcc -O2 -pthread -o benchmark benchmark.c -lm
+ *   (com -O3 -march=native os lotes do MotorSoA sao vetorizados)
+ *   (com -DVERIFICAR_HASH toda operacao confere o hash incremental)
+ *   (com -DINSTRUMENTAR os casos medem tambem o custo dos contadores)
+ *
+ * Uso:
+ *   ./benchmark [--amostras N] [--csv arquivo] [--json arquivo]
+ *   ./benchmark --escala [N]   (escalonador com 1..N threads; padrao:
+ *                               numero de nucleos)
+ *   ./benchmark --spsc [N]     (estresse da FilaSpsc com N pecas)
+ *   ./benchmark --soa [N]      (MotorSoA x Motor em N passos)
+ *   ./benchmark --busca [N]    (busca de sequencias com 1..N threads)
+ *   ./benchmark --tabuleiro [N] (N quedas conferidas contra a grade)
+ *   ./benchmark --srs          (tabelas do SRS e rotacoes/s)
+ *   ./benchmark --perft [N]    (colocacoes/s com 1..N pecas; padrao 3)
+ *   ./benchmark --montecarlo [N] (avaliacao Monte Carlo com 1..N threads)
+ *   --contadores arquivo       (qualquer modo: ao final grava os
+ *                               contadores de todas as threads em JSON)
+ * =====================================================================
+ */
+
+// Reaproveita as estruturas do sistema completo (sem o main interativo)
+#define TETRIS_SEM_MAIN
+#include "sistema_completo.c"
+#include <unistd.h>
+
+// ==================== CONSTANTES ====================
+#define AMOSTRAS_PADRAO 2000
+#define OPS_POR_AMOSTRA 256
+#define TAM_CARGA_MISTA 4096
+#define MAX_CASOS 32
+#define MOTOR_SESSOES OPS_POR_AMOSTRA
+#define SOA_SESSOES 4096
+#define ESCALA_SESSOES 16384
+#define ESCALA_PASSOS 64
+#define ESCALA_RODADAS 8
+#define SPSC_PECAS_PADRAO 2000000L
+#define SOA_CONFERIR_SESSOES 1000
+#define SOA_PASSOS_PADRAO 3000L
+#define BUSCA_ESTADOS 300
+#define BUSCA_PROF_REF 6
+#define BUSCA_MEDIDAS 50
+#define BUSCA_PROF_MEDIDA 8
+#define TABULEIRO_QUEDAS_PADRAO 1000000L
+#define SRS_ROTACOES 4000000
+#define PERFT_PROFUNDIDADE_PADRAO 3
+#define PERFT_CAMPOS 300            // Campos sorteados conferidos contra a grade
+#define PERFT_FILA 8
+#define MC_AMOSTRAS_CONFERENCIA 4000    // Pares da avaliacao conferida
+#define MC_REPETICOES 200               // Avaliacoes curtas na cobertura do intervalo
+#define MC_THREADS_CONFERENCIA 4        // Fixo: cada thread tem o seu fluxo do PCG32
+#define MC_AMOSTRAS_REPETICAO 400
+#define MC_ORCAMENTO_MEDIDA 200000      // us por avaliacao medida
+
+// Impede que o compilador elimine ou funda as operacoes medidas
+#define BARREIRA(ptr) __asm__ volatile("" : : "g"(ptr) : "memory")
+
+// ==================== ESTRUTURA DE DADOS ====================
+
+/*
+ * Struct FilaModulo:
+ * Fila circular original (indice com % TAM_FILA), mantida apenas como
+ * referencia de desempenho para a versao com mascara.
+ */
+typedef struct {
+    Peca elementos[TAM_FILA];
+    int frente;
+    int tras;
+    int tamanho;
+} FilaModulo;
+
+/*
+ * Struct Contexto:
+ * Estado compartilhado pelos casos de benchmark
+ */
+typedef struct {
+    Sessao sessao;              // Fila, pilha e gerador medidos
+    FilaCircular filaBase;      // Estado restaurado antes de cada operacao
+    FilaModulo filaModulo;
+    Pilha pilhaBase;
+    Motor motor;
+    MotorSoA motorSoA;
+    unsigned char opcoesMotor[SOA_SESSOES];
+    Peca saidas[SOA_SESSOES];
+    int passo;
+    SnapshotSessao snapshot;
+    ArmazemCheckpoints armazem;
+    int checkpoint;
+    Historico historico;
+    Tabuleiro tabuleiro;
+    Renderizador tela;          // Escreve em /dev/null
+    FILE* saidaNula;            // Idem, com buffer de linha como um terminal
+    Peca peca;
+    unsigned char carga[TAM_CARGA_MISTA + MOTOR_SESSOES]; // Opcoes da carga mista
+    int posCarga;
+    unsigned long sumidouro;
+} Contexto;
+
+typedef void (*FuncaoLote)(Contexto* ctx, int n);
+typedef void (*FuncaoPreparo)(Contexto* ctx);
+
+/*
+ * Struct CasoBench:
+ * Um caso medido. 'base' (opcional) mede so o custo de restaurar o
+ * estado e e descontado do tempo de 'lote'. 'opsPorLote' (opcional)
+ * substitui OPS_POR_AMOSTRA para casos que operam muitas sessoes de
+ * uma vez.
+ */
+typedef struct {
+    const char* nome;
+    FuncaoPreparo preparo;
+    FuncaoLote lote;
+    FuncaoLote base;
+    int opsPorLote;
+} CasoBench;
+
+typedef struct {
+    const char* nome;
+    double nsMedio;
+    double nsP50;
+    double nsP99;
+    double opsPorSegundo;
+} ResultadoBench;
+
+// ==================== VARIAVEIS GLOBAIS ====================
+ResultadoBench resultados[MAX_CASOS];
+int numResultados = 0;
+
+// ==================== UTILITARIOS ====================
+
+static double agoraNs() {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1e9 + t.tv_nsec;
+}
+
+static int compararDouble(const void* a, const void* b) {
+    double x = *(const double*)a;
+    double y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+// ==================== FILA DE REFERENCIA (MODULO) ====================
+
+static void enqueueModulo(FilaModulo* fila, Peca peca) {
+    if (fila->tamanho == TAM_FILA) return;
+    fila->tras = (fila->tras + 1) % TAM_FILA;
+    fila->elementos[fila->tras] = peca;
+    fila->tamanho++;
+}
+
+static Peca dequeueModulo(FilaModulo* fila) {
+    Peca p = fila->elementos[fila->frente];
+    fila->frente = (fila->frente + 1) % TAM_FILA;
+    fila->tamanho--;
+    return p;
+}
+
+// ==================== TELA DE REFERENCIA (PRINTF) ====================
+
+// exibirEstado/exibirMenu originais, um printf por peca e por linha.
+// Com buffer de linha (terminal) cada quadro custa 24 write().
+static void exibirEstadoPrintf(FILE* f, FilaCircular* fila, Pilha* pilha) {
+    fprintf(f, "\n=====================================================\n");
+    fprintf(f, "           ESTADO ATUAL DO SISTEMA\n");
+    fprintf(f, "=====================================================\n");
+    fprintf(f, "Fila de pecas: ");
+    if (filaVazia(fila)) {
+        fprintf(f, "[VAZIA]\n");
+    } else {
+        for (unsigned int i = fila->frente; i != fila->tras; i++) {
+            Peca p = fila->elementos[i & fila->mascara];
+            fprintf(f, "[%c %d] ", nomePeca(p), idPeca(p));
+        }
+        fprintf(f, "\n");
+    }
+    fprintf(f, "    (%d/%d pecas)\n", tamanhoFila(fila), fila->capacidade);
+    fprintf(f, "-----------------------------------------------------\n");
+    fprintf(f, "Pilha de reserva (Topo -> Base): ");
+    if (pilhaVazia(pilha)) {
+        fprintf(f, "[VAZIA]\n");
+    } else {
+        for (int i = pilha->topo; i >= 0; i--) {
+            fprintf(f, "[%c %d] ", nomePeca(pilha->elementos[i]), idPeca(pilha->elementos[i]));
+        }
+        fprintf(f, "\n");
+    }
+    fprintf(f, "    (%d/%d pecas)\n", pilha->topo + 1, pilha->capacidade);
+    fprintf(f, "=====================================================\n");
+}
+
+static void exibirMenuPrintf(FILE* f, FilaCircular* fila, Pilha* pilha) {
+    int n = tamanhoTrocaMultipla(fila, pilha);
+    fprintf(f, "\n=====================================================\n");
+    fprintf(f, "              MENU DE OPCOES\n");
+    fprintf(f, "=====================================================\n");
+    fprintf(f, "1 - Jogar peca da frente da fila\n");
+    fprintf(f, "2 - Enviar peca da fila para pilha de reserva\n");
+    fprintf(f, "3 - Usar peca da pilha de reserva\n");
+    fprintf(f, "4 - Trocar frente da fila com topo da pilha\n");
+    fprintf(f, "5 - Trocar %d primeiras (fila) com %d (pilha)\n", n, n);
+    fprintf(f, "6 - Desfazer ultima operacao\n");
+    fprintf(f, "7 - Refazer operacao desfeita\n");
+    fprintf(f, "8 - Buscar jogadas ate uma peca na frente\n");
+    fprintf(f, "9 - Avaliar jogar x reservar (Monte Carlo)\n");
+    fprintf(f, "0 - Sair\n");
+    fprintf(f, "=====================================================\n");
+}
+
+// ==================== PREPARO DOS ESTADOS ====================
+
+static void prepararCheio(Contexto* ctx) {
+    Configuracao cfg = {TAM_FILA, TAM_PILHA, 12345, GERADOR_SACO7};
+    if (ctx->sessao.arena != NULL) destruirSessao(&ctx->sessao);
+    criarSessao(&ctx->sessao, &cfg, cfg.semente);
+    for (int i = 0; i < TAM_PILHA; i++) {
+        push(&ctx->sessao.pilha, gerarPeca(&ctx->sessao.gerador));
+    }
+    ctx->filaModulo.frente = 0;
+    ctx->filaModulo.tras = -1;
+    ctx->filaModulo.tamanho = 0;
+    for (int i = 0; i < TAM_FILA; i++) {
+        enqueueModulo(&ctx->filaModulo, gerarPeca(&ctx->sessao.gerador));
+    }
+    ctx->peca = gerarPeca(&ctx->sessao.gerador);
+}
+
+// Fila com uma vaga e pilha com uma vaga (para enqueue/push).
+// Restaurar copia so os indices; o conteudo fica na arena.
+static void prepararComVaga(Contexto* ctx) {
+    prepararCheio(ctx);
+    dequeue(&ctx->sessao.fila);
+    pop(&ctx->sessao.pilha);
+    ctx->filaBase = ctx->sessao.fila;
+    ctx->pilhaBase = ctx->sessao.pilha;
+}
+
+// Fila e pilha cheias (para dequeue/pop)
+static void prepararBaseCheia(Contexto* ctx) {
+    prepararCheio(ctx);
+    ctx->filaBase = ctx->sessao.fila;
+    ctx->pilhaBase = ctx->sessao.pilha;
+}
+
+static void prepararMisto(Contexto* ctx) {
+    prepararCheio(ctx);
+    while (!pilhaVazia(&ctx->sessao.pilha)) {
+        pop(&ctx->sessao.pilha);
+    }
+    // Proporcao tipica: mais jogadas do que reservas e trocas
+    for (int i = 0; i < TAM_CARGA_MISTA; i++) {
+        int r = aleatorioLimitado(&ctx->sessao.gerador.aleatorio, 100);
+        ctx->carga[i] = r < 50 ? 1 : r < 65 ? 2 : r < 80 ? 3 : r < 90 ? 4 : 5;
+    }
+    // Copia do inicio no fim: o motor le MOTOR_SESSOES opcoes a partir de posCarga
+    memcpy(ctx->carga + TAM_CARGA_MISTA, ctx->carga, MOTOR_SESSOES);
+    ctx->posCarga = 0;
+}
+
+static void prepararMotor(Contexto* ctx) {
+    prepararMisto(ctx);
+    if (ctx->motor.sessoes != NULL) destruirMotor(&ctx->motor);
+    criarMotor(&ctx->motor, &(Configuracao){TAM_FILA, TAM_PILHA, 0, GERADOR_SACO7}, MOTOR_SESSOES);
+    for (int i = 0; i < MOTOR_SESSOES; i++) {
+        motorCriarSessao(&ctx->motor, 1000 + i);
+    }
+}
+
+// ==================== CASOS - FILA ====================
+
+static void loteEnqueue(Contexto* ctx, int n) {
+    for (int i = 0; i < n; i++) {
+        ctx->sessao.fila = ctx->filaBase;
+        enqueue(&ctx->sessao.fila, ctx->peca);
+        BARREIRA(&ctx->sessao.fila);
+    }
+}
+
+static void loteRestaurarFila(Contexto* ctx, int n) {
+    for (int i = 0; i < n; i++) {
+        ctx->sessao.fila = ctx->filaBase;
+        BARREIRA(&ctx->sessao.fila);
+    }
+}
+
+static void loteDequeue(Contexto* ctx, int n) {
+    for (int i = 0; i < n; i++) {
+        ctx->sessao.fila = ctx->filaBase;
+        ctx->sumidouro += idPeca(dequeue(&ctx->sessao.fila));
+        BARREIRA(&ctx->sessao.fila);
+    }
+}
+
+static void loteFrente(Contexto* ctx, int n) {
+    for (int i = 0; i < n; i++) {
+        ctx->sumidouro += idPeca(frente(&ctx->sessao.fila));
+        BARREIRA(&ctx->sessao.fila);
+    }
+}
+
+// Ciclo continuo dequeue + enqueue: o indice percorre todo o anel
+static void loteCicloMascara(Contexto* ctx, int n) {
+    for (int i = 0; i < n; i++) {
+        enqueue(&ctx->sessao.fila, dequeue(&ctx->sessao.fila));
+        BARREIRA(&ctx->sessao.fila);
+    }
+}
+
+static void loteCicloModulo(Contexto* ctx, int n) {
+    for (int i = 0; i < n; i++) {
+        enqueueModulo(&ctx->filaModulo, dequeueModulo(&ctx->filaModulo));
+        BARREIRA(&ctx->filaModulo);
+    }
+}
+
+// ==================== CASOS - PILHA ====================
+
+static void lotePush(Contexto* ctx, int n) {
+    for (int i = 0; i < n; i++) {
+        ctx->sessao.pilha = ctx->pilhaBase;
+        push(&ctx->sessao.pilha, ctx->peca);
+        BARREIRA(&ctx->sessao.pilha);
+    }
+}
+
+static void loteRestaurarPilha(Contexto* ctx, int n) {
+    for (int i = 0; i < n; i++) {
+        ctx->sessao.pilha = ctx->pilhaBase;
+        BARREIRA(&ctx->sessao.pilha);
+    }
+}
+
+static void lotePop(Contexto* ctx, int n) {
+    for (int i = 0; i < n; i++) {
+        ctx->sessao.pilha = ctx->pilhaBase;
+        ctx->sumidouro += idPeca(pop(&ctx->sessao.pilha));
+        BARREIRA(&ctx->sessao.pilha);
+    }
+}
+
+static void loteTopo(Contexto* ctx, int n) {
+    for (int i = 0; i < n; i++) {
+        ctx->sumidouro += idPeca(topo(&ctx->sessao.pilha));
+        BARREIRA(&ctx->sessao.pilha);
+    }
+}
+
+// ==================== CASOS - TROCAS E CARGA MISTA ====================
+
+// As trocas mantem os tamanhos, entao podem ser repetidas sem restaurar
+static void loteTrocaSimples(Contexto* ctx, int n) {
+    for (int i = 0; i < n; i++) {
+        aplicarTrocaSimples(&ctx->sessao.fila, &ctx->sessao.pilha);
+        BARREIRA(&ctx->sessao.fila);
+    }
+}
+
+static void loteTrocaMultipla(Contexto* ctx, int n) {
+    for (int i = 0; i < n; i++) {
+        aplicarTrocaMultipla(&ctx->sessao.fila, &ctx->sessao.pilha);
+        BARREIRA(&ctx->sessao.fila);
+    }
+}
+
+static void loteMisto(Contexto* ctx, int n) {
+    Peca p;
+    for (int i = 0; i < n; i++) {
+        int opcao = ctx->carga[ctx->posCarga];
+        ctx->posCarga = (ctx->posCarga + 1) % TAM_CARGA_MISTA;
+        ctx->sumidouro += executarOperacao(&ctx->sessao, opcao, &p);
+        BARREIRA(&ctx->sessao.fila);
+    }
+}
+
+// ==================== CASOS - HASH DO ESTADO ====================
+
+// Hash mantido pelas operacoes: so combina os dois campos
+static void loteHashIncremental(Contexto* ctx, int n) {
+    for (int i = 0; i < n; i++) {
+        ctx->sumidouro += hashFilaPilha(&ctx->sessao.fila, &ctx->sessao.pilha);
+        BARREIRA(&ctx->sessao.fila);
+    }
+}
+
+// O que o hash incremental evita: percorrer fila e pilha a cada consulta
+static void loteHashRecalcular(Contexto* ctx, int n) {
+    for (int i = 0; i < n; i++) {
+        ctx->sumidouro += calcularHashFila(&ctx->sessao.fila) ^ calcularHashPilha(&ctx->sessao.pilha);
+        BARREIRA(&ctx->sessao.fila);
+    }
+}
+
+// Fila e pilha cheias; as duas saidas apontam para /dev/null
+static void prepararTela(Contexto* ctx) {
+    prepararBaseCheia(ctx);
+    if (ctx->saidaNula == NULL) {
+        ctx->saidaNula = fopen("/dev/null", "w");
+        setvbuf(ctx->saidaNula, NULL, _IOLBF, BUFSIZ);
+    }
+    iniciarRenderizador(&ctx->tela, fileno(ctx->saidaNula));
+}
+
+// ==================== CASOS - TELA ====================
+
+// Um quadro por op; a troca simples muda fila e pilha a cada quadro
+static void loteTelaPrintf(Contexto* ctx, int n) {
+    for (int i = 0; i < n; i++) {
+        aplicarTrocaSimples(&ctx->sessao.fila, &ctx->sessao.pilha);
+        exibirEstadoPrintf(ctx->saidaNula, &ctx->sessao.fila, &ctx->sessao.pilha);
+        exibirMenuPrintf(ctx->saidaNula, &ctx->sessao.fila, &ctx->sessao.pilha);
+        fprintf(ctx->saidaNula, "Escolha uma opcao: ");
+        fflush(ctx->saidaNula);
+    }
+}
+
+static void loteTelaQuadro(Contexto* ctx, int n) {
+    for (int i = 0; i < n; i++) {
+        aplicarTrocaSimples(&ctx->sessao.fila, &ctx->sessao.pilha);
+        renderizarEstado(&ctx->tela, &ctx->sessao.fila, &ctx->sessao.pilha);
+        renderizarMenu(&ctx->tela, &ctx->sessao.fila, &ctx->sessao.pilha);
+        renderizarTexto(&ctx->tela, "Escolha uma opcao: ");
+        enviarQuadro(&ctx->tela);
+    }
+}
+
+// Estado igual ao do quadro anterior: nenhuma secao e formatada
+static void loteTelaRepetida(Contexto* ctx, int n) {
+    for (int i = 0; i < n; i++) {
+        renderizarEstado(&ctx->tela, &ctx->sessao.fila, &ctx->sessao.pilha);
+        renderizarMenu(&ctx->tela, &ctx->sessao.fila, &ctx->sessao.pilha);
+        renderizarTexto(&ctx->tela, "Escolha uma opcao: ");
+        enviarQuadro(&ctx->tela);
+    }
+}
+
+static void prepararHistorico(Contexto* ctx) {
+    prepararMisto(ctx);
+    iniciarHistorico(&ctx->historico);
+}
+
+// Carga mista com registro do delta de cada operacao
+static void loteMistoHistorico(Contexto* ctx, int n) {
+    Peca p;
+    for (int i = 0; i < n; i++) {
+        int opcao = ctx->carga[ctx->posCarga];
+        ctx->posCarga = (ctx->posCarga + 1) % TAM_CARGA_MISTA;
+        ctx->sumidouro += executarComHistorico(&ctx->sessao, &ctx->historico, opcao, &p);
+        BARREIRA(&ctx->sessao.fila);
+    }
+}
+
+// Cada iteracao: operacao da carga, desfazer e refazer
+static void loteDesfazerRefazer(Contexto* ctx, int n) {
+    Peca p;
+    int alvo;
+    for (int i = 0; i < n; i++) {
+        int opcao = ctx->carga[ctx->posCarga];
+        ctx->posCarga = (ctx->posCarga + 1) % TAM_CARGA_MISTA;
+        executarComHistorico(&ctx->sessao, &ctx->historico, opcao, &p);
+        ctx->sumidouro += desfazer(&ctx->sessao, &ctx->historico, &alvo);
+        ctx->sumidouro += refazer(&ctx->sessao, &ctx->historico, &alvo);
+        BARREIRA(&ctx->sessao.fila);
+    }
+}
+
+// Um passo do motor opera MOTOR_SESSOES sessoes; ns/op = por sessao
+static void loteMotor(Contexto* ctx, int n) {
+    for (int i = 0; i < n; i += MOTOR_SESSOES) {
+        ctx->sumidouro += motorPasso(&ctx->motor, ctx->carga + ctx->posCarga);
+        ctx->posCarga = (ctx->posCarga + MOTOR_SESSOES) % TAM_CARGA_MISTA;
+        BARREIRA(ctx->motor.sessoes);
+    }
+}
+
+// ==================== CASOS - AoS x SoA ====================
+
+// Mesmas SOA_SESSOES sessoes (gerador uniforme) nos dois layouts
+static void prepararLayouts(Contexto* ctx) {
+    Configuracao cfg = {TAM_FILA, TAM_PILHA, 0, GERADOR_UNIFORME};
+    if (ctx->motor.sessoes != NULL) destruirMotor(&ctx->motor);
+    if (ctx->motorSoA.frente != NULL) destruirMotorSoA(&ctx->motorSoA);
+    criarMotor(&ctx->motor, &cfg, SOA_SESSOES);
+    for (int i = 0; i < SOA_SESSOES; i++) {
+        motorCriarSessao(&ctx->motor, 1000 + i);
+    }
+    criarMotorSoA(&ctx->motorSoA, &cfg, SOA_SESSOES, 1000);
+    ctx->passo = 0;
+}
+
+// Cada chamada e um passo em todas as sessoes (n = SOA_SESSOES)
+static void loteAosJogar(Contexto* ctx, int n) {
+    (void)n;
+    memset(ctx->opcoesMotor, 1, SOA_SESSOES);
+    ctx->sumidouro += motorPasso(&ctx->motor, ctx->opcoesMotor);
+    BARREIRA(ctx->motor.sessoes);
+}
+
+static void loteSoaJogar(Contexto* ctx, int n) {
+    (void)n;
+    soaJogarTodas(&ctx->motorSoA, ctx->saidas);
+    BARREIRA(ctx->saidas);
+}
+
+// Alterna reservar (2) e usar (3) para a pilha nao ficar sempre cheia
+static void loteAosReservarUsar(Contexto* ctx, int n) {
+    (void)n;
+    memset(ctx->opcoesMotor, 2 + (ctx->passo++ & 1), SOA_SESSOES);
+    ctx->sumidouro += motorPasso(&ctx->motor, ctx->opcoesMotor);
+    BARREIRA(ctx->motor.sessoes);
+}
+
+static void loteSoaReservarUsar(Contexto* ctx, int n) {
+    (void)n;
+    if (ctx->passo++ & 1) {
+        ctx->sumidouro += soaUsarTodas(&ctx->motorSoA, ctx->saidas);
+    } else {
+        ctx->sumidouro += soaReservarTodas(&ctx->motorSoA);
+    }
+    BARREIRA(ctx->saidas);
+}
+
+// ==================== CASOS - SNAPSHOT ====================
+
+static void prepararSnapshot(Contexto* ctx) {
+    prepararMisto(ctx);
+    salvarSnapshot(&ctx->sessao, &ctx->snapshot);
+    if (ctx->armazem.snapshots != NULL) destruirArmazem(&ctx->armazem);
+    criarArmazem(&ctx->armazem, 4);
+    ctx->checkpoint = checkpointSalvar(&ctx->armazem, &ctx->sessao);
+}
+
+static void loteSalvarSnapshot(Contexto* ctx, int n) {
+    for (int i = 0; i < n; i++) {
+        salvarSnapshot(&ctx->sessao, &ctx->snapshot);
+        BARREIRA(&ctx->snapshot);
+    }
+}
+
+static void loteRestaurarSnapshot(Contexto* ctx, int n) {
+    for (int i = 0; i < n; i++) {
+        ctx->sumidouro += restaurarSnapshot(&ctx->sessao, &ctx->snapshot);
+        BARREIRA(&ctx->sessao);
+    }
+}
+
+// Compartilhar e liberar um checkpoint do pool (so contagem de referencias)
+static void loteBifurcarCheckpoint(Contexto* ctx, int n) {
+    for (int i = 0; i < n; i++) {
+        int id = checkpointCompartilhar(&ctx->armazem, ctx->checkpoint);
+        BARREIRA(&ctx->armazem);
+        checkpointLiberar(&ctx->armazem, id);
+    }
+}
+
+// ==================== CASOS - POLITICAS DE GERACAO ====================
+
+static void prepararUniforme(Contexto* ctx) {
+    iniciarGeradorPecas(&ctx->sessao.gerador, GERADOR_UNIFORME, 12345);
+}
+
+static void prepararSaco7(Contexto* ctx) {
+    iniciarGeradorPecas(&ctx->sessao.gerador, GERADOR_SACO7, 12345);
+}
+
+static void prepararSaco14(Contexto* ctx) {
+    iniciarGeradorPecas(&ctx->sessao.gerador, GERADOR_SACO14, 12345);
+}
+
+static void prepararTgm(Contexto* ctx) {
+    iniciarGeradorPecas(&ctx->sessao.gerador, GERADOR_TGM, 12345);
+}
+
+// Custo por peca gerada (ops/s = pecas por segundo)
+static void loteGerarPeca(Contexto* ctx, int n) {
+    for (int i = 0; i < n; i++) {
+        ctx->sumidouro += gerarPeca(&ctx->sessao.gerador);
+        BARREIRA(&ctx->sessao.gerador);
+    }
+}
+
+// ==================== CASOS - TABULEIRO ====================
+
+static void prepararTabuleiro(Contexto* ctx) {
+    iniciarGeradorPecas(&ctx->sessao.gerador, GERADOR_SACO7, 12345);
+    iniciarTabuleiro(&ctx->tabuleiro);
+    ctx->passo = 0;
+}
+
+// Uma queda direta por op, em colunas que se repetem (ops/s = quedas/s)
+static void loteSoltarPeca(Contexto* ctx, int n) {
+    for (int i = 0; i < n; i++) {
+        uint64_t forma = FORMAS_TABULEIRO[tipoPeca(gerarPeca(&ctx->sessao.gerador))][0];
+        int x = ctx->passo++ % (TAB_LARGURA - 3);
+        int limpas = soltarPeca(&ctx->tabuleiro, forma, x);
+        if (limpas < 0) limparCampo(&ctx->tabuleiro);
+        ctx->sumidouro += (unsigned long)limpas;
+    }
+    BARREIRA(&ctx->tabuleiro);
+}
+
+// Destino das opcoes 1/3: escolhe a coluna (13 quedas testadas) e fixa
+static void loteColocarPeca(Contexto* ctx, int n) {
+    for (int i = 0; i < n; i++) {
+        ctx->sumidouro += colocarPeca(&ctx->tabuleiro, gerarPeca(&ctx->sessao.gerador));
+    }
+    BARREIRA(&ctx->tabuleiro);
+}
+
+// ==================== MEDICAO ====================
+
+/*
+ * medirCaso()
+ * Executa 'amostras' lotes de operacoes e guarda
+ * media, p50 e p99 do ns/op de cada lote.
+ */
+void medirCaso(const CasoBench* caso, int amostras) {
+    static Contexto ctx;
+    double* nsPorOp = malloc(sizeof(double) * amostras);
+    double desconto = 0;
+    double soma = 0;
+
+    caso->preparo(&ctx);
+
+    // Aquecimento
+    int ops = caso->opsPorLote > 0 ? caso->opsPorLote : OPS_POR_AMOSTRA;
+    caso->lote(&ctx, ops);
+
+    // Custo de restaurar o estado (mediana de alguns lotes)
+    if (caso->base != NULL) {
+        double base[64];
+        for (int i = 0; i < 64; i++) {
+            double t0 = agoraNs();
+            caso->base(&ctx, ops);
+            base[i] = (agoraNs() - t0) / ops;
+        }
+        qsort(base, 64, sizeof(double), compararDouble);
+        desconto = base[32];
+    }
+
+    for (int i = 0; i < amostras; i++) {
+        double t0 = agoraNs();
+        caso->lote(&ctx, ops);
+        double ns = (agoraNs() - t0) / ops - desconto;
+        nsPorOp[i] = ns > 0 ? ns : 0;
+        soma += nsPorOp[i];
+    }
+
+    qsort(nsPorOp, amostras, sizeof(double), compararDouble);
+
+    ResultadoBench* r = &resultados[numResultados++];
+    r->nome = caso->nome;
+    r->nsMedio = soma / amostras;
+    r->nsP50 = nsPorOp[amostras / 2];
+    r->nsP99 = nsPorOp[(amostras * 99) / 100];
+    r->opsPorSegundo = r->nsMedio > 0 ? 1e9 / r->nsMedio : 0;
+
+    printf("%-20s %10.2f %10.2f %10.2f %14.0f\n",
+           r->nome, r->nsMedio, r->nsP50, r->nsP99, r->opsPorSegundo);
+
+    free(nsPorOp);
+}
+
+// ==================== ESCALONADOR ====================
+
+// Combina o resumoSessao de todas as sessoes ativas
+static uint64_t resumoMotor(Motor* m) {
+    uint64_t h = FNV_BASE;
+    for (int id = 0; id < m->capacidade; id++) {
+        Sessao* s = motorSessao(m, id);
+        if (s == NULL) continue;
+        h = (h ^ resumoSessao(s)) * FNV_PRIMO;
+    }
+    return h;
+}
+
+/*
+ * montarRoteiro()
+ * ESCALA_PASSOS linhas de opcoes 1-5 sorteadas. O primeiro quarto das
+ * sessoes joga em todo passo e o resto em 1 de cada 4, para que a
+ * divisao estatica fique desbalanceada e o roubo de tarefas apareca.
+ */
+static void montarRoteiro(unsigned char* roteiro) {
+    GeradorAleatorio g;
+    semearGerador(&g, 2025, 11);
+    for (int p = 0; p < ESCALA_PASSOS; p++) {
+        for (int id = 0; id < ESCALA_SESSOES; id++) {
+            int ativa = id < ESCALA_SESSOES / 4 || (p & 3) == (id & 3);
+            roteiro[(size_t)p * ESCALA_SESSOES + id] =
+                ativa ? (unsigned char)(1 + aleatorioLimitado(&g, 5)) : 0;
+        }
+    }
+}
+
+/*
+ * medirEscala()
+ * Roda o mesmo roteiro com 1..maxTrabalhadores trabalhadores, cada vez
+ * com sessoes recem-criadas, e mostra ops/s e aceleracao sobre 1 thread.
+ * O resumo do estado final tem que ser igual em todas as execucoes.
+ */
+static int medirEscala(int maxTrabalhadores) {
+    Configuracao cfg = {TAM_FILA, TAM_PILHA, 0, GERADOR_SACO7};
+    unsigned char* roteiro = malloc((size_t)ESCALA_PASSOS * ESCALA_SESSOES);
+    if (roteiro == NULL) return 1;
+    montarRoteiro(roteiro);
+    
+    unsigned long opsRodada = 0;
+    for (size_t i = 0; i < (size_t)ESCALA_PASSOS * ESCALA_SESSOES; i++) {
+        opsRodada += roteiro[i] != 0;
+    }
+
+    printf("=====================================================================\n");
+    printf("   TETRIS STACK - ESCALONADOR (%d sessoes, %d passos x %d rodadas)\n",
+           ESCALA_SESSOES, ESCALA_PASSOS, ESCALA_RODADAS);
+    printf("=====================================================================\n");
+    printf("%-12s %14s %10s %10s %18s\n", "threads", "ops/s", "acel.", "roubos", "resumo");
+
+    double opsBase = 0;
+    uint64_t resumoBase = 0;
+    int divergiu = 0;
+    for (int n = 1; n <= maxTrabalhadores; n++) {
+        Motor motor;
+        Escalonador esc;
+        if (!criarMotor(&motor, &cfg, ESCALA_SESSOES)) return 1;
+        for (int i = 0; i < ESCALA_SESSOES; i++) motorCriarSessao(&motor, 5000 + i);
+        if (!criarEscalonador(&esc, &motor, n, 0)) return 1;
+
+        unsigned long roubos = 0;
+        double t0 = agoraNs();
+        for (int r = 0; r < ESCALA_RODADAS; r++) {
+            escalonadorExecutar(&esc, roteiro, ESCALA_PASSOS);
+            for (int i = 0; i < n; i++) roubos += esc.filas[i].roubos;
+            for (int i = 0; i < n; i++) esc.filas[i].roubos = 0;
+        }
+        double segundos = (agoraNs() - t0) / 1e9;
+        double ops = (double)opsRodada * ESCALA_RODADAS / segundos;
+
+        uint64_t resumo = resumoMotor(&motor);
+        if (n == 1) {
+            opsBase = ops;
+            resumoBase = resumo;
+        }
+        if (resumo != resumoBase) divergiu = 1;
+        printf("%-12d %14.0f %9.2fx %10lu   %016llx%s\n", n, ops, ops / opsBase, roubos,
+               (unsigned long long)resumo, resumo != resumoBase ? " DIVERGIU" : "");
+
+        destruirEscalonador(&esc);
+        destruirMotor(&motor);
+    }
+    printf("=====================================================================\n");
+    free(roteiro);
+    return divergiu;
+}
+
+// ==================== FILA SPSC ====================
+
+/*
+ * estressarSpsc()
+ * Consome 'total' pecas de uma FilaSpsc alimentada por outra thread e
+ * compara cada uma com a sequencia de um gerador de referencia. Retorna
+ * o numero de divergencias.
+ */
+static long estressarSpsc(int capacidade, long total) {
+    Peca armazenamento[FILA_MAX];
+    FilaSpsc fila;
+    GeradorPecas produtor, referencia;
+    Alimentador alimentador;
+    
+    inicializarFilaSpsc(&fila, armazenamento, capacidade);
+    iniciarGeradorPecas(&produtor, GERADOR_SACO7, 777);
+    iniciarGeradorPecas(&referencia, GERADOR_SACO7, 777);
+    if (!iniciarAlimentador(&alimentador, &fila, &produtor)) return -1;
+    
+    long erros = 0;
+    unsigned long vazias = 0;
+    double t0 = agoraNs();
+    for (long i = 0; i < total; i++) {
+        Peca p;
+        while (!spscDequeue(&fila, &p)) {
+            vazias++;
+            sched_yield();
+        }
+        if (p != gerarPeca(&referencia)) erros++;
+    }
+    double ns = agoraNs() - t0;
+    pararAlimentador(&alimentador);
+    
+    printf("%-12d %12ld %14.0f %14lu %10ld\n",
+           capacidade, total, total / (ns / 1e9), vazias, erros);
+    return erros;
+}
+
+static int medirSpsc(long total) {
+    static const int capacidades[] = {1, 5, 16, 64};
+    long erros = 0;
+    
+    printf("=====================================================================\n");
+    printf("   TETRIS STACK - FILA SPSC (produtor e consumidor em threads)\n");
+    printf("=====================================================================\n");
+    printf("%-12s %12s %14s %14s %10s\n", "capacidade", "pecas", "pecas/s", "fila vazia", "erros");
+    for (int i = 0; i < 4; i++) {
+        long e = estressarSpsc(capacidades[i], total);
+        if (e < 0) return 1;
+        erros += e;
+    }
+    printf("=====================================================================\n");
+    printf("%s\n", erros == 0 ? "OK: nenhuma peca perdida, repetida ou fora de ordem"
+                               : "FALHA: sequencia divergiu da referencia");
+    return erros != 0;
+}
+
+// ==================== MOTOR SoA x Motor ====================
+
+/*
+ * sessaoIgualSoA()
+ * Confere a sessao i do MotorSoA contra a Sessao do Motor: pecas da
+ * fila (da frente para o fim), pecas da pilha e proximo id.
+ */
+static int sessaoIgualSoA(const MotorSoA* m, int i, Sessao* s) {
+    uint32_t tamFila = m->tras[i] - m->frente[i];
+    if (tamFila != (uint32_t)tamanhoFila(&s->fila) || m->topo[i] != s->pilha.topo) return 0;
+    if (m->proximoId[i] != s->gerador.proximoId) return 0;
+    
+    const Peca* fila = m->pecasFila + (size_t)i * m->fisicoFila;
+    for (uint32_t k = 0; k < tamFila; k++) {
+        Peca esperada = s->fila.elementos[(s->fila.frente + k) & s->fila.mascara];
+        if (fila[(m->frente[i] + k) & m->mascara] != esperada) return 0;
+    }
+    const Peca* pilha = m->pecasPilha + (size_t)i * (m->tamPilha + 1);
+    for (int k = 0; k <= m->topo[i]; k++) {
+        if (pilha[k] != s->pilha.elementos[k]) return 0;
+    }
+    return 1;
+}
+
+/*
+ * conferirSoA()
+ * Cria as mesmas SOA_CONFERIR_SESSOES sessoes nos dois layouts e aplica
+ * 'passos' opcoes sorteadas (1-3, a mesma em todas as sessoes, como nos
+ * lotes do MotorSoA). Depois de cada passo confere o aceite, a peca
+ * devolvida e o estado de cada sessao. Retorna quantas sessoes
+ * divergiram em algum passo, ou -1 se faltar memoria.
+ */
+static long conferirSoA(int tamFila, int tamPilha, long passos) {
+    static Peca saidas[SOA_CONFERIR_SESSOES];
+    static int ids[SOA_CONFERIR_SESSOES];
+    static unsigned char divergiu[SOA_CONFERIR_SESSOES];
+    Configuracao cfg = {tamFila, tamPilha, 0, GERADOR_UNIFORME};
+    GeradorAleatorio sorteio;
+    Motor motor;
+    MotorSoA soa;
+    
+    if (!criarMotor(&motor, &cfg, SOA_CONFERIR_SESSOES)) return -1;
+    if (!criarMotorSoA(&soa, &cfg, SOA_CONFERIR_SESSOES, 1000)) {
+        destruirMotor(&motor);
+        return -1;
+    }
+    for (int i = 0; i < SOA_CONFERIR_SESSOES; i++) {
+        ids[i] = motorCriarSessao(&motor, 1000 + i);
+        divergiu[i] = !sessaoIgualSoA(&soa, i, motorSessao(&motor, ids[i]));
+    }
+    semearGerador(&sorteio, 2025, (uint64_t)(tamFila * PILHA_MAX + tamPilha));
+    
+    for (long passo = 0; passo < passos; passo++) {
+        int opcao = 1 + (int)aleatorioLimitado(&sorteio, 3);
+        if (opcao == 1) soaJogarTodas(&soa, saidas);
+        else if (opcao == 2) soaReservarTodas(&soa);
+        else soaUsarTodas(&soa, saidas);
+        
+        for (int i = 0; i < SOA_CONFERIR_SESSOES; i++) {
+            Sessao* s = motorSessao(&motor, ids[i]);
+            Peca p = PECA_NENHUMA;
+            int aceitaAoS = executarOperacao(s, opcao, &p) == RES_OK;
+            int aceitaSoA = opcao == 1 ? 1 : opcao == 2 ? (int)soa.ok[i] : saidas[i] != PECA_NENHUMA;
+            int pecaIgual = opcao == 2 || !aceitaAoS || saidas[i] == p;
+            if (aceitaAoS != aceitaSoA || !pecaIgual || !sessaoIgualSoA(&soa, i, s)) divergiu[i] = 1;
+        }
+    }
+    long divergencias = 0;
+    for (int i = 0; i < SOA_CONFERIR_SESSOES; i++) divergencias += divergiu[i];
+    printf("%-6d %-6d %10d %10ld %12ld\n", tamFila, tamPilha, SOA_CONFERIR_SESSOES,
+           passos, divergencias);
+    destruirMotorSoA(&soa);
+    destruirMotor(&motor);
+    return divergencias;
+}
+
+static int medirSoA(long passos) {
+    static const int capacidades[][2] = {{TAM_FILA, TAM_PILHA}, {1, 1}, {7, 16}, {FILA_MAX, PILHA_MAX}};
+    long divergencias = 0;
+    
+    printf("=====================================================================\n");
+    printf("   TETRIS STACK - MotorSoA x Motor (mesmos passos, sessao a sessao)\n");
+    printf("=====================================================================\n");
+    printf("%-6s %-6s %10s %10s %12s\n", "fila", "pilha", "sessoes", "passos", "divergentes");
+    for (int i = 0; i < 4; i++) {
+        long d = conferirSoA(capacidades[i][0], capacidades[i][1], passos);
+        if (d < 0) {
+            fprintf(stderr, "ERRO: memoria insuficiente\n");
+            return 1;
+        }
+        divergencias += d;
+    }
+    printf("=====================================================================\n");
+    printf("%s\n", divergencias == 0 ? "OK: MotorSoA e Motor iguais em todas as sessoes e passos"
+                                     : "FALHA: MotorSoA divergiu do Motor");
+    return divergencias != 0;
+}
+
+// ==================== TABULEIRO ====================
+
+// Referencia ingenua: um char por celula, limites testados um a um
+typedef struct {
+    char celulas[TAB_ALTURA][TAB_LARGURA];
+} GradeReferencia;
+
+static int celulaDaForma(uint64_t forma, int r, int c) {
+    return (int)((forma >> (16 * r + c)) & 1);
+}
+
+static int colideGrade(const GradeReferencia* g, uint64_t forma, int x, int y) {
+    for (int r = 0; r < 4; r++) {
+        for (int c = 0; c < 4; c++) {
+            if (!celulaDaForma(forma, r, c)) continue;
+            int col = x + c;
+            int lin = y + r;
+            if (col < 0 || col >= TAB_LARGURA || lin < 0) return 1;
+            if (lin < TAB_ALTURA && g->celulas[lin][col]) return 1;
+        }
+    }
+    return 0;
+}
+
+// Mesma regra de soltarPeca: -1 se nao cabe na entrada, senao as limpas
+static int soltarGrade(GradeReferencia* g, uint64_t forma, int x) {
+    int baixa = 0;
+    while (((forma >> (16 * baixa)) & 0xF) == 0) baixa++;
+    int y = TAB_VISIVEL - baixa;
+    if (colideGrade(g, forma, x, y)) return -1;
+    while (!colideGrade(g, forma, x, y - 1)) y--;
+    for (int r = 0; r < 4; r++) {
+        for (int c = 0; c < 4; c++) {
+            if (celulaDaForma(forma, r, c)) g->celulas[y + r][x + c] = 1;
+        }
+    }
+    int limpas = 0;
+    for (int lin = 0; lin < TAB_ALTURA; ) {
+        int cheia = 1;
+        for (int c = 0; c < TAB_LARGURA; c++) cheia &= g->celulas[lin][c];
+        if (!cheia) {
+            lin++;
+            continue;
+        }
+        memmove(g->celulas[lin], g->celulas[lin + 1], (size_t)(TAB_ALTURA - 1 - lin) * TAB_LARGURA);
+        memset(g->celulas[TAB_ALTURA - 1], 0, TAB_LARGURA);
+        limpas++;
+    }
+    return limpas;
+}
+
+// Coluna em que a forma para mais baixo na grade (-1 se nenhuma cabe),
+// para as quedas conferidas tambem encherem linhas
+static int colunaMaisBaixaGrade(const GradeReferencia* g, uint64_t forma) {
+    int melhorX = -1;
+    int melhorY = TAB_ALTURA;
+    int baixa = 0;
+    while (((forma >> (16 * baixa)) & 0xF) == 0) baixa++;
+    for (int x = TAB_X_MIN; x <= TAB_X_MAX; x++) {
+        int y = TAB_VISIVEL - baixa;
+        if (colideGrade(g, forma, x, y)) continue;
+        while (!colideGrade(g, forma, x, y - 1)) y--;
+        if (y < melhorY) {
+            melhorY = y;
+            melhorX = x;
+        }
+    }
+    return melhorX;
+}
+
+static int gradeIgual(const GradeReferencia* g, const Tabuleiro* t) {
+    int altura = 0;
+    for (int lin = 0; lin < TAB_ALTURA; lin++) {
+        for (int c = 0; c < TAB_LARGURA; c++) {
+            int bit = (t->linhas[TAB_CHAO + lin] >> (c + TAB_PAREDE)) & 1;
+            if (bit != g->celulas[lin][c]) return 0;
+            if (bit) altura = lin + 1;
+        }
+    }
+    return altura == t->altura;
+}
+
+/*
+ * medirTabuleiro()
+ * 'total' quedas de tipos sorteados no tabuleiro de bits e na grade,
+ * conferindo o retorno e o campo inteiro depois de cada uma. Metade vai
+ * para uma coluna sorteada (inclusive onde a peca bate na parede) e
+ * metade para a coluna mais baixa, que enche e limpa linhas. Alem das
+ * 7 formas de entrada entra um I em pe, para limpar 3 e 4 linhas. Depois
+ * mede so o tabuleiro: quedas/s e colocarPeca/s.
+ */
+static int medirTabuleiro(long total) {
+    GeradorAleatorio g;
+    GradeReferencia grade;
+    Tabuleiro t;
+    long erros = 0;
+    unsigned long limpas[5] = {0};
+    semearGerador(&g, 77, 1);
+    memset(&grade, 0, sizeof(grade));
+    iniciarTabuleiro(&t);
+    
+    uint64_t formas[NUM_TIPOS + 1];
+    for (int tipo = 0; tipo < NUM_TIPOS; tipo++) formas[tipo] = FORMAS_TABULEIRO[tipo][0];
+    formas[NUM_TIPOS] = FORMAS_TABULEIRO[0][1];
+    
+    // Abertura fixa: Os nas colunas 0-7, I em pe na 8 e na 9 (4 linhas)
+    static const int abertura[][2] = {
+        {1, -1}, {1, -1}, {1, 1}, {1, 1}, {1, 3}, {1, 3}, {1, 5}, {1, 5},
+        {NUM_TIPOS, 6}, {NUM_TIPOS, 7}
+    };
+    int numAbertura = sizeof(abertura) / sizeof(abertura[0]);
+    
+    for (long i = 0; i < total; i++) {
+        uint64_t forma = formas[aleatorioLimitado(&g, NUM_TIPOS + 1)];
+        int x = TAB_X_MIN + (int)aleatorioLimitado(&g, TAB_X_MAX - TAB_X_MIN + 1);
+        if (i < numAbertura) {
+            forma = formas[abertura[i][0]];
+            x = abertura[i][1];
+        } else if (i & 1) {
+            x = colunaMaisBaixaGrade(&grade, forma);
+            if (x < 0) x = TAB_X_SURGIR;
+        }
+        int r = soltarPeca(&t, forma, x);
+        int esperado = soltarGrade(&grade, forma, x);
+        if (r != esperado || !gradeIgual(&grade, &t)) erros++;
+        if (r >= 0) {
+            limpas[r]++;
+        } else if (t.altura > TAB_VISIVEL / 2) {
+            limparCampo(&t);
+            memset(&grade, 0, sizeof(grade));
+        }
+    }
+    
+    Contexto* ctx = calloc(1, sizeof(Contexto));
+    if (ctx == NULL) return 1;
+    printf("=====================================================================\n");
+    printf("   TETRIS STACK - TABULEIRO (%ld quedas conferidas)\n", total);
+    printf("=====================================================================\n");
+    printf("limpezas: %lu de 1, %lu de 2, %lu de 3, %lu de 4 linhas\n",
+           limpas[1], limpas[2], limpas[3], limpas[4]);
+    const struct { const char* nome; FuncaoLote lote; } medidas[] = {
+        {"soltarPeca", loteSoltarPeca}, {"colocarPeca", loteColocarPeca}
+    };
+    for (int m = 0; m < 2; m++) {
+        prepararTabuleiro(ctx);
+        double t0 = agoraNs();
+        medidas[m].lote(ctx, (int)total);
+        double ns = agoraNs() - t0;
+        printf("%-20s %14.0f pecas/s %8.2f ns/peca\n", medidas[m].nome, total / (ns / 1e9), ns / total);
+    }
+    free(ctx);
+    printf("=====================================================================\n");
+    printf("%s\n", erros == 0 ? "OK: tabuleiro confere com a grade" : "FALHA: tabuleiro divergiu da grade");
+    return erros != 0;
+}
+
+// ==================== SRS ====================
+
+// Deslocamentos de referencia do SRS por rotacao (0, R, 2, L) e teste.
+// O chute de a para b e desloc[a][k] - desloc[b][k], menos o do teste 1
+// (a tabela do jogo gira a caixa, que ja absorve essa translacao).
+static const ChuteSrs DESLOCAMENTOS_JLSTZ[NUM_ROTACOES][NUM_CHUTES] = {
+    {{0, 0}, {0, 0}, {0, 0}, {0, 0}, {0, 0}},
+    {{0, 0}, {1, 0}, {1, -1}, {0, 2}, {1, 2}},
+    {{0, 0}, {0, 0}, {0, 0}, {0, 0}, {0, 0}},
+    {{0, 0}, {-1, 0}, {-1, -1}, {0, 2}, {-1, 2}},
+};
+static const ChuteSrs DESLOCAMENTOS_I[NUM_ROTACOES][NUM_CHUTES] = {
+    {{0, 0}, {-1, 0}, {2, 0}, {-1, 0}, {2, 0}},
+    {{-1, 0}, {0, 0}, {0, 0}, {0, 1}, {0, -2}},
+    {{-1, 1}, {1, 1}, {-2, 1}, {1, 0}, {-2, 0}},
+    {{0, 1}, {0, 1}, {0, 1}, {0, -1}, {0, 2}},
+};
+
+// Gira a forma 90 graus no sentido horario dentro da caixa n x n
+// (linha r de baixo para cima): (c, r) vai para (r, n - 1 - c)
+static uint64_t girarNaCaixa(uint64_t forma, int n) {
+    uint64_t girada = 0;
+    for (int r = 0; r < n; r++) {
+        for (int c = 0; c < n; c++) {
+            if ((forma >> (16 * r + c)) & 1) girada |= 1ULL << (16 * (n - 1 - c) + r);
+        }
+    }
+    return girada;
+}
+
+static int contarBlocos(uint64_t forma) {
+    int n = 0;
+    for (; forma; forma &= forma - 1) n++;
+    return n;
+}
+
+// Formas: 4 blocos, cada rotacao e a anterior girada na caixa (o O nao
+// gira) e J/L/S/T/Z nao usam a linha nem a coluna 3 da caixa
+static long conferirFormasSrs(void) {
+    long erros = 0;
+    for (int tipo = 0; tipo < NUM_TIPOS; tipo++) {
+        int n = tipo == 0 ? 4 : 3;
+        for (int rot = 0; rot < NUM_ROTACOES; rot++) {
+            uint64_t forma = FORMAS_TABULEIRO[tipo][rot];
+            uint64_t seguinte = FORMAS_TABULEIRO[tipo][(rot + 1) & 3];
+            uint64_t esperada = tipo == 1 ? forma : girarNaCaixa(forma, n);
+            if (contarBlocos(forma) != 4 || seguinte != esperada) erros++;
+            if (n == 3 && (forma & (FORMA(0x8, 0x8, 0x8, 0xF)))) erros++;
+        }
+    }
+    return erros;
+}
+
+// Chutes: cada teste da tabela contra o derivado dos deslocamentos
+static long conferirChutesSrs(void) {
+    long erros = 0;
+    for (int tabela = 0; tabela < 2; tabela++) {
+        const ChuteSrs (*desloc)[NUM_CHUTES] = tabela ? DESLOCAMENTOS_I : DESLOCAMENTOS_JLSTZ;
+        for (int de = 0; de < NUM_ROTACOES; de++) {
+            for (int anti = 0; anti < 2; anti++) {
+                int para = (de + (anti ? 3 : 1)) & 3;
+                int baseX = desloc[de][0].x - desloc[para][0].x;
+                int baseY = desloc[de][0].y - desloc[para][0].y;
+                for (int k = 0; k < NUM_CHUTES; k++) {
+                    const ChuteSrs* c = &CHUTES_SRS[tabela][de][anti][k];
+                    erros += c->x != desloc[de][k].x - desloc[para][k].x - baseX ||
+                             c->y != desloc[de][k].y - desloc[para][k].y - baseY;
+                }
+            }
+        }
+    }
+    return erros;
+}
+
+// Casos conhecidos: I em pe encostado na parede direita gira para 2 com
+// o teste 2 (um para a esquerda); T num poco fechado nao gira
+static long conferirGirosSrs(void) {
+    long erros = 0;
+    Tabuleiro t;
+    iniciarTabuleiro(&t);
+    PosicaoPeca i = {7, 0, 1};      // Coluna 2 da caixa = coluna 9
+    erros += girarPeca(&t, 0, &i, 0) != 2 || i.x != 6 || i.y != 0 || i.rotacao != 2;
+    
+    // Vao com a forma exata do T invertido (colunas 4-6 e 5 embaixo)
+    t.linhas[TAB_CHAO + 0] = TAB_LINHA_CHEIA & ~(0x1u << (5 + TAB_PAREDE));
+    t.linhas[TAB_CHAO + 1] = TAB_LINHA_CHEIA & ~(0x7u << (4 + TAB_PAREDE));
+    t.linhas[TAB_CHAO + 2] = TAB_LINHA_CHEIA;
+    t.altura = 3;
+    PosicaoPeca tp = {4, 0, 2};     // T de cabeca para baixo no poco
+    erros += colideTabuleiro(&t, FORMAS_TABULEIRO[2][2], tp.x, tp.y) ||
+             girarPeca(&t, 2, &tp, 0) != 0 || tp.rotacao != 2;
+    return erros;
+}
+
+/*
+ * medirSrs()
+ * Confere formas, chutes e dois giros conhecidos; depois mede girarPeca
+ * (rotacoes/s) sobre um campo com blocos, duas linhas abaixo do topo
+ * (onde os chutes entram em jogo), alternando os sentidos.
+ */
+static int medirSrs(void) {
+    long errosFormas = conferirFormasSrs();
+    long errosChutes = conferirChutesSrs();
+    long errosGiros = conferirGirosSrs();
+    
+    Tabuleiro t;
+    GeradorAleatorio g;
+    iniciarTabuleiro(&t);
+    semearGerador(&g, 5, 1);
+    for (int i = 0; i < 60; i++) colocarPeca(&t, criarPeca(aleatorioLimitado(&g, NUM_TIPOS), i));
+    
+    unsigned long giros = 0;
+    double t0 = agoraNs();
+    for (int i = 0; i < SRS_ROTACOES; i++) {
+        PosicaoPeca p = {TAB_X_SURGIR, t.altura - 2, i & 3};
+        giros += girarPeca(&t, (i >> 2) % NUM_TIPOS, &p, i & 4) != 0;
+    }
+    double ns = agoraNs() - t0;
+    
+    printf("=====================================================================\n");
+    printf("   TETRIS STACK - SRS (%d tipos x %d rotacoes)\n", NUM_TIPOS, NUM_ROTACOES);
+    printf("=====================================================================\n");
+    printf("formas:  %ld erros\n", errosFormas);
+    printf("chutes:  %ld erros\n", errosChutes);
+    printf("giros:   %ld erros\n", errosGiros);
+    printf("girarPeca: %.0f rotacoes/s (%.2f ns, %lu aceitas)\n",
+           SRS_ROTACOES / (ns / 1e9), ns / SRS_ROTACOES, giros);
+    printf("=====================================================================\n");
+    int falhou = errosFormas != 0 || errosChutes != 0 || errosGiros != 0;
+    printf("%s\n", falhou ? "FALHA: tabelas do SRS divergem da referencia" : "OK: tabelas do SRS conferem");
+    return falhou;
+}
+
+// ==================== COLOCACOES (PERFT) ====================
+
+// Colocacoes de cada tipo no campo vazio com SRS: horizontais + em pe
+// (I 7 + 10), O 9, J/L/T 8 + 9 + 8 + 9, S/Z 8 + 9
+static const int COLOCACOES_CAMPO_VAZIO[NUM_TIPOS] = {17, 9, 34, 34, 34, 17, 17};
+
+// Celulas da forma em (x, y) como chave unica: linha de baixo da caixa
+// e as 4 linhas de 10 bits
+static uint64_t chaveCelulas(uint64_t forma, int x, int y) {
+    uint64_t chave = (uint64_t)(y + TAB_CHAO) << 40;
+    for (int r = 0; r < 4; r++) {
+        uint64_t linha = ((forma >> (16 * r)) & 0xF) << (x + TAB_PAREDE);
+        chave |= ((linha >> TAB_PAREDE) & 0x3FF) << (10 * r);
+    }
+    return chave;
+}
+
+static int compararU64(const void* a, const void* b) {
+    uint64_t x = *(const uint64_t*)a;
+    uint64_t y = *(const uint64_t*)b;
+    return (x > y) - (x < y);
+}
+
+// Tabelas de simetria: a rotacao r em (x, y) tem as celulas da canonica
+// deslocada, para todo x e y validos das duas
+static long conferirCanonicas(void) {
+    long erros = 0;
+    for (int tipo = 0; tipo < NUM_TIPOS; tipo++) {
+        for (int rot = 0; rot < NUM_ROTACOES; rot++) {
+            int rc = ROTACAO_CANONICA[tipo][rot];
+            int dx = DESLOCAMENTO_CANONICO[tipo][rot].x;
+            int dy = DESLOCAMENTO_CANONICO[tipo][rot].y;
+            uint64_t a = FORMAS_TABULEIRO[tipo][rot];
+            uint64_t b = FORMAS_TABULEIRO[tipo][rc];
+            // Celula (c, r) de a e a celula (c - dx, r - dy) de b
+            for (int r = 0; r < 4; r++) {
+                for (int c = 0; c < 4; c++) {
+                    int rb = r - dy;
+                    int cb = c - dx;
+                    int emB = rb >= 0 && rb < 4 && cb >= 0 && cb < 4 && ((b >> (16 * rb + cb)) & 1);
+                    erros += (int)((a >> (16 * r + c)) & 1) != emB;
+                }
+            }
+        }
+    }
+    return erros;
+}
+
+/*
+ * enumerarGrade()
+ * Referencia: a mesma busca (esquerda, direita, descer, giros com os
+ * chutes da tabela) na grade de chars, sem mapas de bits nem formas
+ * canonicas; as colocacoes saem como chaves de celulas, sem repeticao.
+ */
+static int enumerarGrade(const GradeReferencia* g, int tipo, uint64_t* chaves) {
+    static char visitado[NUM_ROTACOES][16][TAB_LINHAS];
+    static PosicaoPeca fila[TAB_MAX_ESTADOS];
+    int inicio = 0, fim = 0, total = 0;
+    memset(visitado, 0, sizeof(visitado));
+    
+    PosicaoPeca p0 = {TAB_X_SURGIR, 0, 0};
+    while (((FORMAS_TABULEIRO[tipo][0] >> (16 * p0.y)) & 0xF) == 0) p0.y++;
+    p0.y = TAB_VISIVEL - p0.y;
+    if (colideGrade(g, FORMAS_TABULEIRO[tipo][0], p0.x, p0.y)) return 0;
+    visitado[0][p0.x - TAB_X_MIN][p0.y + TAB_CHAO] = 1;
+    fila[fim++] = p0;
+    
+    while (inicio < fim) {
+        PosicaoPeca p = fila[inicio++];
+        uint64_t forma = FORMAS_TABULEIRO[tipo][p.rotacao];
+        if (colideGrade(g, forma, p.x, p.y - 1)) {
+            uint64_t chave = chaveCelulas(forma, p.x, p.y);
+            // Normaliza pela linha mais baixa ocupada
+            int r = 0;
+            while (((chave >> (10 * r)) & 0x3FF) == 0) r++;
+            chave = ((chave & ((1ULL << 40) - 1)) >> (10 * r)) | ((chave >> 40) + r) << 40;
+            int repetida = 0;
+            for (int k = 0; k < total && !repetida; k++) repetida = chaves[k] == chave;
+            if (!repetida) chaves[total++] = chave;
+        }
+        for (int k = 0; k < 5; k++) {
+            PosicaoPeca v = p;
+            if (k == 0) v.x--;
+            if (k == 1) v.x++;
+            if (k == 2) v.y--;
+            if (k < 3) {
+                if (v.x < TAB_X_MIN || v.x > TAB_X_MAX || colideGrade(g, forma, v.x, v.y)) continue;
+            } else {
+                int destino = (p.rotacao + (k == 4 ? 3 : 1)) & 3;
+                const ChuteSrs* chutes = CHUTES_SRS[tipo == 0][p.rotacao][k == 4];
+                int achou = 0;
+                for (int c = 0; c < NUM_CHUTES && !achou; c++) {
+                    v.x = p.x + chutes[c].x;
+                    v.y = p.y + chutes[c].y;
+                    achou = v.x >= TAB_X_MIN && v.x <= TAB_X_MAX &&
+                            !colideGrade(g, FORMAS_TABULEIRO[tipo][destino], v.x, v.y);
+                }
+                if (!achou) continue;
+                v.rotacao = destino;
+            }
+            char* marca = &visitado[v.rotacao][v.x - TAB_X_MIN][v.y + TAB_CHAO];
+            if (*marca) continue;
+            *marca = 1;
+            fila[fim++] = v;
+        }
+    }
+    return total;
+}
+
+// Chaves normalizadas das colocacoes do enumerador, para comparar
+static int chavesColocacoes(const PosicaoPeca* c, int n, int tipo, uint64_t* chaves) {
+    for (int i = 0; i < n; i++) {
+        uint64_t chave = chaveCelulas(FORMAS_TABULEIRO[tipo][c[i].rotacao], c[i].x, c[i].y);
+        int r = 0;
+        while (((chave >> (10 * r)) & 0x3FF) == 0) r++;
+        chaves[i] = ((chave & ((1ULL << 40) - 1)) >> (10 * r)) | ((chave >> 40) + r) << 40;
+    }
+    qsort(chaves, (size_t)n, sizeof(uint64_t), compararU64);
+    int distintas = 1;
+    for (int i = 1; i < n; i++) distintas += chaves[i] != chaves[i - 1];
+    return n == 0 || distintas == n;
+}
+
+// Campo de meio de jogo com buracos: colocarPeca e depois celulas
+// abertas embaixo dos blocos (para haver encaixes por baixo e giros)
+static void sortearCampo(Tabuleiro* t, GeradorAleatorio* g) {
+    iniciarTabuleiro(t);
+    int pecas = (int)aleatorioLimitado(g, 40);
+    for (int i = 0; i < pecas; i++) colocarPeca(t, criarPeca(aleatorioLimitado(g, NUM_TIPOS), i));
+    for (int i = 0; i < 12 && t->altura > 1; i++) {
+        int y = (int)aleatorioLimitado(g, (uint32_t)t->altura - 1);
+        t->linhas[TAB_CHAO + y] &= (uint16_t)~(1u << (aleatorioLimitado(g, TAB_LARGURA) + TAB_PAREDE));
+    }
+}
+
+static void gradeDoTabuleiro(const Tabuleiro* t, GradeReferencia* g) {
+    for (int y = 0; y < TAB_ALTURA; y++) {
+        for (int c = 0; c < TAB_LARGURA; c++) {
+            g->celulas[y][c] = (char)((t->linhas[TAB_CHAO + y] >> (c + TAB_PAREDE)) & 1);
+        }
+    }
+}
+
+/*
+ * conferirColocacoes()
+ * Contagens conhecidas no campo vazio e, em campos sorteados, o mesmo
+ * conjunto de celulas finais que a busca na grade, sem repeticao, com
+ * cada colocacao sem colisao e apoiada. Retorna o numero de erros.
+ */
+static long conferirColocacoes(void) {
+    static PosicaoPeca colocacoes[TAB_MAX_ESTADOS];
+    static uint64_t chaves[TAB_MAX_ESTADOS];
+    static uint64_t chavesGrade[TAB_MAX_ESTADOS];
+    long erros = conferirCanonicas();
+    Tabuleiro t;
+    GradeReferencia grade;
+    GeradorAleatorio g;
+    semearGerador(&g, 2024, 1);
+    
+    iniciarTabuleiro(&t);
+    for (int tipo = 0; tipo < NUM_TIPOS; tipo++) {
+        erros += enumerarColocacoes(&t, tipo, colocacoes) != COLOCACOES_CAMPO_VAZIO[tipo];
+    }
+    
+    for (int i = 0; i < PERFT_CAMPOS; i++) {
+        sortearCampo(&t, &g);
+        gradeDoTabuleiro(&t, &grade);
+        for (int tipo = 0; tipo < NUM_TIPOS; tipo++) {
+            int n = enumerarColocacoes(&t, tipo, colocacoes);
+            for (int k = 0; k < n; k++) {
+                uint64_t forma = FORMAS_TABULEIRO[tipo][colocacoes[k].rotacao];
+                erros += colideTabuleiro(&t, forma, colocacoes[k].x, colocacoes[k].y) ||
+                         !colideTabuleiro(&t, forma, colocacoes[k].x, colocacoes[k].y - 1);
+            }
+            erros += !chavesColocacoes(colocacoes, n, tipo, chaves);
+            int m = enumerarGrade(&grade, tipo, chavesGrade);
+            qsort(chavesGrade, (size_t)m, sizeof(uint64_t), compararU64);
+            erros += n != m || memcmp(chaves, chavesGrade, sizeof(uint64_t) * (size_t)n) != 0;
+        }
+    }
+    return erros;
+}
+
+/*
+ * perft()
+ * Sequencias de 'profundidade' colocacoes: a cada passo a frente da
+ * fila (opcao 1) ou, com reserva, o topo da pilha (opcao 3). No ultimo
+ * passo so conta as colocacoes, sem fixar.
+ */
+static unsigned long perft(const Tabuleiro* t, const unsigned char* fila, int numFila,
+                           const unsigned char* pilha, int topo, int profundidade,
+                           unsigned long* enumeracoes) {
+    PosicaoPeca colocacoes[TAB_MAX_ESTADOS];
+    unsigned long nos = 0;
+    for (int opcao = 1; opcao <= 3; opcao += 2) {
+        if (opcao == 1 && numFila == 0) continue;
+        if (opcao == 3 && topo < 0) continue;
+        int tipo = opcao == 1 ? fila[0] : pilha[topo];
+        int n = enumerarColocacoes(t, tipo, colocacoes);
+        (*enumeracoes)++;
+        if (profundidade == 1) {
+            nos += (unsigned long)n;
+            continue;
+        }
+        for (int k = 0; k < n; k++) {
+            Tabuleiro filho = *t;
+            fixarPeca(&filho, FORMAS_TABULEIRO[tipo][colocacoes[k].rotacao],
+                      colocacoes[k].x, colocacoes[k].y);
+            nos += opcao == 1
+                 ? perft(&filho, fila + 1, numFila - 1, pilha, topo, profundidade - 1, enumeracoes)
+                 : perft(&filho, fila, numFila, pilha, topo - 1, profundidade - 1, enumeracoes);
+        }
+    }
+    return nos;
+}
+
+/*
+ * medirPerft()
+ * Confere o enumerador e mede perft 1..maxProfundidade no campo vazio e
+ * num de meio de jogo, com a fila de uma sessao saco7 e sem / com uma
+ * peca na reserva.
+ */
+static int medirPerft(int maxProfundidade) {
+    long erros = conferirColocacoes();
+    
+    Configuracao cfg = {PERFT_FILA, 1, 0, GERADOR_SACO7};
+    Sessao s;
+    if (!criarSessao(&s, &cfg, 31)) return 1;
+    unsigned char fila[PERFT_FILA];
+    for (int i = 0; i < PERFT_FILA; i++) {
+        fila[i] = (unsigned char)tipoPeca(s.fila.elementos[(s.fila.frente + i) & s.fila.mascara]);
+    }
+    unsigned char pilha[1] = {(unsigned char)tipoPeca(gerarPeca(&s.gerador))};
+    destruirSessao(&s);
+    
+    Tabuleiro campos[2];
+    GeradorAleatorio g;
+    semearGerador(&g, 8, 1);
+    iniciarTabuleiro(&campos[0]);
+    iniciarTabuleiro(&campos[1]);
+    for (int i = 0; i < 25; i++) colocarPeca(&campos[1], criarPeca(aleatorioLimitado(&g, NUM_TIPOS), i));
+    
+    printf("=====================================================================\n");
+    printf("   TETRIS STACK - PERFT DE COLOCACOES (fila");
+    for (int i = 0; i < PERFT_FILA; i++) printf(" %c", TIPOS_PECA[fila[i]]);
+    printf(", reserva %c)\n", TIPOS_PECA[pilha[0]]);
+    printf("=====================================================================\n");
+    printf("%-8s %-8s %5s %14s %14s %12s\n", "campo", "reserva", "prof", "colocacoes", "colocacoes/s", "us/enum");
+    for (int c = 0; c < 2; c++) {
+        for (int reserva = 0; reserva < 2; reserva++) {
+            for (int prof = 1; prof <= maxProfundidade; prof++) {
+                unsigned long enumeracoes = 0;
+                double t0 = agoraNs();
+                unsigned long nos = perft(&campos[c], fila, PERFT_FILA, pilha, reserva ? 0 : -1,
+                                          prof, &enumeracoes);
+                double ns = agoraNs() - t0;
+                printf("%-8s %-8s %5d %14lu %14.0f %12.2f\n", c ? "meio" : "vazio",
+                       reserva ? "sim" : "nao", prof, nos, nos / (ns / 1e9), ns / 1e3 / enumeracoes);
+            }
+        }
+    }
+    printf("=====================================================================\n");
+    printf("%s\n", erros == 0 ? "OK: colocacoes conferem com a grade e as contagens conhecidas"
+                               : "FALHA: enumerador divergiu da referencia");
+    return erros != 0;
+}
+
+// ==================== BUSCA ====================
+
+// Sessao com capacidades sorteadas, avancada por jogadas aleatorias
+static void sortearSessao(Sessao* s, GeradorAleatorio* g, int i) {
+    Configuracao cfg = {1 + (int)aleatorioLimitado(g, 8), 1 + (int)aleatorioLimitado(g, 4),
+                        0, (PoliticaGeracao)(i % 4)};
+    criarSessao(s, &cfg, 9000 + i);
+    int passos = (int)aleatorioLimitado(g, 40);
+    for (int p = 0; p < passos; p++) {
+        Peca peca;
+        executarOperacao(s, 1 + (int)aleatorioLimitado(g, 5), &peca);
+    }
+}
+
+/*
+ * conferirTransicoes()
+ * aplicarJogadaBusca tem que aceitar as mesmas jogadas que
+ * executarOperacao e produzir os mesmos tipos, exceto nas posicoes que
+ * o modelo marca como desconhecidas. Retorna o numero de divergencias.
+ */
+static long conferirTransicoes(GeradorAleatorio* g) {
+    long erros = 0;
+    for (int i = 0; i < BUSCA_ESTADOS; i++) {
+        Sessao s;
+        sortearSessao(&s, g, i);
+        for (int p = 0; p < 200; p++) {
+            EstadoBusca modelo, real;
+            Peca peca;
+            int opcao = 1 + (int)aleatorioLimitado(g, 5);
+            estadoBuscaDaSessao(&s, &modelo);
+            int aceita = aplicarJogadaBusca(&modelo, opcao);
+            int aceitaReal = executarOperacao(&s, opcao, &peca) == RES_OK;
+            estadoBuscaDaSessao(&s, &real);
+            
+            int igual = aceita == aceitaReal && modelo.tamFila == real.tamFila &&
+                        modelo.tamPilha == real.tamPilha &&
+                        memcmp(modelo.pilha, real.pilha, real.tamPilha) == 0;
+            for (int k = 0; igual && k < real.tamFila; k++) {
+                igual = modelo.fila[k] == TIPO_DESCONHECIDO || modelo.fila[k] == real.fila[k];
+            }
+            erros += !igual;
+        }
+        destruirSessao(&s);
+    }
+    return erros;
+}
+
+// Forca bruta: melhor (nota, -jogadas) com ate 'profundidade' jogadas
+static ValorBusca melhorForcaBruta(const EstadoBusca* e, FuncaoPontuacao pontuar,
+                                   const int* alvo, int profundidade) {
+    ValorBusca melhor = {pontuar(e, alvo), 0};
+    if (profundidade == 0) return melhor;
+    for (int opcao = 1; opcao <= 5; opcao++) {
+        EstadoBusca filho = *e;
+        if (!aplicarJogadaBusca(&filho, opcao)) continue;
+        ValorBusca v = melhorForcaBruta(&filho, pontuar, alvo, profundidade - 1);
+        v.jogadas++;
+        if (melhorValor(v, melhor)) melhor = v;
+    }
+    return melhor;
+}
+
+/*
+ * conferirBusca()
+ * Compara buscarSequencia (sem limite de tempo) com a forca bruta: o
+ * caminho mais curto ate cada tipo na frente e a maior nota de
+ * proximidade. A sequencia devolvida e refeita no modelo e tem que
+ * chegar a nota informada. Retorna o numero de divergencias.
+ */
+static long conferirBusca(GeradorAleatorio* g, int numThreads, TabelaTransposicao* tabela) {
+    long erros = 0;
+    for (int i = 0; i < BUSCA_ESTADOS / 3; i++) {
+        Sessao s;
+        EstadoBusca raiz;
+        sortearSessao(&s, g, i);
+        estadoBuscaDaSessao(&s, &raiz);
+        destruirSessao(&s);
+        
+        for (int alvo = 0; alvo < NUM_TIPOS; alvo++) {
+            for (int modo = 0; modo < 2; modo++) {
+                ParametrosBusca p = {modo == 0 ? pontuarPecaNaFrente : pontuarProximidade, &alvo,
+                                     modo == 0 ? 1 : INT32_MAX, BUSCA_PROF_REF, 0, numThreads};
+                ResultadoBusca r;
+                buscarSequencia(&raiz, &p, tabela, &r);
+                ValorBusca ref = melhorForcaBruta(&raiz, p.pontuar, &alvo, BUSCA_PROF_REF);
+                if (modo == 0 && ref.pontuacao == 0) ref.jogadas = 0;
+                
+                EstadoBusca e = raiz;
+                int valida = 1;
+                for (int k = 0; k < r.numJogadas; k++) valida &= aplicarJogadaBusca(&e, r.jogadas[k]);
+                int ok = valida && r.pontuacao == ref.pontuacao && r.numJogadas == ref.jogadas &&
+                         p.pontuar(&e, &alvo) == r.pontuacao;
+                erros += !ok;
+            }
+        }
+    }
+    return erros;
+}
+
+/*
+ * medirBusca()
+ * Confere o modelo e a busca e mede buscas de profundidade fixa (nota
+ * de proximidade, sem parada antecipada) com 1..maxThreads threads.
+ * Por fim mostra ate onde a busca chega com orcamento de 1 ms.
+ */
+static int medirBusca(int maxThreads) {
+    GeradorAleatorio g;
+    TabelaTransposicao tabela;
+    semearGerador(&g, 16, 16);
+    if (!criarTabelaTransposicao(&tabela, BITS_TABELA_PADRAO)) return 1;
+    if (maxThreads > MAX_THREADS_BUSCA) maxThreads = MAX_THREADS_BUSCA;
+    
+    printf("=====================================================================\n");
+    printf("   TETRIS STACK - BUSCA DE SEQUENCIAS\n");
+    printf("=====================================================================\n");
+    long errosTransicao = conferirTransicoes(&g);
+    printf("transicoes do modelo:          %ld divergencias\n", errosTransicao);
+    long errosBusca = 0;
+    for (int n = 1; n <= maxThreads; n++) errosBusca += conferirBusca(&g, n, &tabela);
+    printf("busca x forca bruta (prof %d): %ld divergencias\n", BUSCA_PROF_REF, errosBusca);
+    
+    printf("\n%-10s %12s %14s %14s\n", "threads", "us/busca", "nos/busca", "nos/s");
+    EstadoBusca estados[BUSCA_MEDIDAS];
+    for (int i = 0; i < BUSCA_MEDIDAS; i++) {
+        Sessao s;
+        Configuracao cfg = {TAM_FILA, TAM_PILHA, 0, GERADOR_SACO7};
+        criarSessao(&s, &cfg, 300 + i);
+        estadoBuscaDaSessao(&s, &estados[i]);
+        destruirSessao(&s);
+    }
+    for (int n = 1; n <= maxThreads; n++) {
+        unsigned long nos = 0;
+        double t0 = agoraNs();
+        for (int i = 0; i < BUSCA_MEDIDAS; i++) {
+            int alvo = i % NUM_TIPOS;
+            ParametrosBusca p = {pontuarProximidade, &alvo, INT32_MAX, BUSCA_PROF_MEDIDA, 0, n};
+            ResultadoBusca r;
+            buscarSequencia(&estados[i], &p, &tabela, &r);
+            nos += r.nos;
+        }
+        double segundos = (agoraNs() - t0) / 1e9;
+        printf("%-10d %12.1f %14lu %14.0f\n", n, segundos * 1e6 / BUSCA_MEDIDAS,
+               nos / BUSCA_MEDIDAS, nos / segundos);
+    }
+    
+    long tempoMax = 0, tempoTotal = 0;
+    int profundidadeMin = PROFUNDIDADE_BUSCA_MAX;
+    for (int i = 0; i < BUSCA_MEDIDAS; i++) {
+        int alvo = i % NUM_TIPOS;
+        ParametrosBusca p = {pontuarProximidade, &alvo, INT32_MAX, PROFUNDIDADE_BUSCA_MAX, 1000, maxThreads};
+        ResultadoBusca r;
+        buscarSequencia(&estados[i], &p, &tabela, &r);
+        tempoTotal += r.tempoUs;
+        if (r.tempoUs > tempoMax) tempoMax = r.tempoUs;
+        if (r.profundidade < profundidadeMin) profundidadeMin = r.profundidade;
+    }
+    printf("\norcamento de 1000 us: tempo medio %ld us, pior %ld us, profundidade minima %d\n",
+           tempoTotal / BUSCA_MEDIDAS, tempoMax, profundidadeMin);
+    printf("=====================================================================\n");
+    
+    destruirTabelaTransposicao(&tabela);
+    int falhou = errosTransicao != 0 || errosBusca != 0;
+    printf("%s\n", falhou ? "FALHA: busca divergiu da referencia" : "OK: modelo e busca conferem");
+    return falhou;
+}
+
+// ==================== MONTE CARLO ====================
+
+static int estimativasIguais(const ResultadoAvaliacao* a, const ResultadoAvaliacao* b) {
+    return a->amostras == b->amostras && a->escolha == b->escolha &&
+           a->jogar.media == b->jogar.media && a->jogar.margem == b->jogar.margem &&
+           a->reservar.media == b->reservar.media && a->reservar.margem == b->reservar.margem &&
+           a->diferenca.media == b->diferenca.media && a->diferenca.margem == b->diferenca.margem;
+}
+
+/*
+ * conferirAvaliacao()
+ * Com limite de amostras e sem relogio a avaliacao tem que se repetir
+ * igual e nao mexer na sessao; com a pilha cheia so 'jogar' conta.
+ * Depois, MC_REPETICOES avaliacoes curtas com sementes diferentes: o
+ * intervalo de 95% de cada uma deve cobrir a media de uma avaliacao
+ * longa em 90-99.5% das vezes (a propria media longa tem erro pequeno).
+ * Retorna o numero de falhas.
+ */
+static long conferirAvaliacao(const Sessao* s, Sessao* cheia, int numThreads) {
+    long erros = 0;
+    ResultadoAvaliacao a, b;
+    uint64_t antes = resumoSessao(s);
+    ParametrosAvaliacao p = {0, MC_AMOSTRAS_CONFERENCIA, MC_HORIZONTE_PADRAO, numThreads, 77};
+    avaliarReserva(s, NULL, &p, &a);
+    avaliarReserva(s, NULL, &p, &b);
+    int repete = estimativasIguais(&a, &b) && a.amostras == MC_AMOSTRAS_CONFERENCIA &&
+                 resumoSessao(s) == antes;
+    printf("mesma semente, mesmo resultado: %s\n", repete ? "sim" : "NAO");
+    erros += !repete;
+    
+    ResultadoAvaliacao c;
+    avaliarReserva(cheia, NULL, &p, &c);
+    int soJogar = !c.podeReservar && c.escolha == 1 && c.reservar.media == 0;
+    printf("pilha cheia, so jogar:          %s\n", soJogar ? "sim" : "NAO");
+    erros += !soJogar;
+    
+    ResultadoAvaliacao longa;
+    ParametrosAvaliacao pl = {0, 50 * MC_AMOSTRAS_CONFERENCIA, MC_HORIZONTE_PADRAO, numThreads, 78};
+    avaliarReserva(s, NULL, &pl, &longa);
+    int cobertas[3] = {0, 0, 0};
+    for (int i = 0; i < MC_REPETICOES; i++) {
+        ParametrosAvaliacao pc = {0, MC_AMOSTRAS_REPETICAO, MC_HORIZONTE_PADRAO, numThreads, 1000 + (uint64_t)i};
+        ResultadoAvaliacao r;
+        avaliarReserva(s, NULL, &pc, &r);
+        const Estimativa* curtas[3] = {&r.jogar, &r.reservar, &r.diferenca};
+        const Estimativa* referencias[3] = {&longa.jogar, &longa.reservar, &longa.diferenca};
+        for (int k = 0; k < 3; k++) {
+            double distancia = curtas[k]->media - referencias[k]->media;
+            if (distancia < 0) distancia = -distancia;
+            cobertas[k] += distancia <= curtas[k]->margem;
+        }
+    }
+    const char* nomes[3] = {"jogar", "reservar", "diferenca"};
+    for (int k = 0; k < 3; k++) {
+        double cobertura = 100.0 * cobertas[k] / MC_REPETICOES;
+        int ok = cobertura >= 90.0 && cobertura <= 99.5;
+        printf("cobertura do IC 95%% (%-9s): %5.1f%%%s\n", nomes[k], cobertura, ok ? "" : "  <- fora de 90-99.5%");
+        erros += !ok;
+    }
+    return erros;
+}
+
+/*
+ * medirMonteCarlo()
+ * Confere a avaliacao e mede pares de continuacoes/s com 1..maxThreads
+ * threads, cada medida com o orcamento de tempo da interface. A
+ * conferencia usa sempre MC_THREADS_CONFERENCIA threads: as amostras
+ * dependem da divisao entre os fluxos, e assim sao as mesmas em
+ * qualquer maquina.
+ */
+static int medirMonteCarlo(int maxThreads) {
+    if (maxThreads > MAX_THREADS_BUSCA) maxThreads = MAX_THREADS_BUSCA;
+    Configuracao cfg = {TAM_FILA, TAM_PILHA, 0, GERADOR_SACO7};
+    Sessao s, cheia;
+    if (!criarSessao(&s, &cfg, 41) || !criarSessao(&cheia, &cfg, 42)) return 1;
+    Peca peca;
+    for (int i = 0; i < TAM_PILHA; i++) executarOperacao(&cheia, 2, &peca);
+    
+    printf("=====================================================================\n");
+    printf("   TETRIS STACK - AVALIACAO MONTE CARLO (jogar x reservar)\n");
+    printf("=====================================================================\n");
+    long erros = conferirAvaliacao(&s, &cheia, MC_THREADS_CONFERENCIA);
+    
+    printf("\n%-10s %12s %14s %12s %12s %10s\n", "threads", "pares", "pares/s", "jogar", "reservar", "escolha");
+    for (int n = 1; n <= maxThreads; n++) {
+        ParametrosAvaliacao p = {MC_ORCAMENTO_MEDIDA, 0, MC_HORIZONTE_PADRAO, n, 5};
+        ResultadoAvaliacao r;
+        avaliarReserva(&s, NULL, &p, &r);
+        printf("%-10d %12lu %14.0f %6.3f+-%.3f %6.3f+-%.3f %10s\n", n, r.amostras,
+               r.amostras / (r.tempoUs / 1e6), r.jogar.media, r.jogar.margem,
+               r.reservar.media, r.reservar.margem,
+               r.escolha == 0 ? "empate" : NOMES_JOGADA[r.escolha]);
+    }
+    printf("=====================================================================\n");
+    destruirSessao(&s);
+    destruirSessao(&cheia);
+    printf("%s\n", erros == 0 ? "OK: avaliacao repetivel e intervalos conferem"
+                              : "FALHA: avaliacao divergiu do esperado");
+    return erros != 0;
+}
+
+// ==================== SAIDA ====================
+
+void gravarCsv(const char* caminho) {
+    FILE* f = fopen(caminho, "w");
+    if (f == NULL) {
+        fprintf(stderr, "ERRO: nao foi possivel criar '%s'\n", caminho);
+        return;
+    }
+    fprintf(f, "caso,ns_medio,ns_p50,ns_p99,ops_por_segundo\n");
+    for (int i = 0; i < numResultados; i++) {
+        ResultadoBench* r = &resultados[i];
+        fprintf(f, "%s,%.3f,%.3f,%.3f,%.0f\n",
+                r->nome, r->nsMedio, r->nsP50, r->nsP99, r->opsPorSegundo);
+    }
+    fclose(f);
+}
+
+void gravarJson(const char* caminho) {
+    FILE* f = fopen(caminho, "w");
+    if (f == NULL) {
+        fprintf(stderr, "ERRO: nao foi possivel criar '%s'\n", caminho);
+        return;
+    }
+    fprintf(f, "{\n  \"ops_por_amostra\": %d,\n  \"casos\": [\n", OPS_POR_AMOSTRA);
+    for (int i = 0; i < numResultados; i++) {
+        ResultadoBench* r = &resultados[i];
+        fprintf(f, "    {\"caso\": \"%s\", \"ns_medio\": %.3f, \"ns_p50\": %.3f, "
+                   "\"ns_p99\": %.3f, \"ops_por_segundo\": %.0f}%s\n",
+                r->nome, r->nsMedio, r->nsP50, r->nsP99, r->opsPorSegundo,
+                i + 1 < numResultados ? "," : "");
+    }
+    fprintf(f, "  ]\n}\n");
+    fclose(f);
+}
+
+// ==================== FUNCAO PRINCIPAL ====================
+int main(int argc, char* argv[]) {
+    const char* arquivoCsv = NULL;
+    const char* arquivoJson = NULL;
+    const char* arquivoContadores = NULL;
+    int amostras = AMOSTRAS_PADRAO;
+    const char* modo = NULL;        // --escala / --spsc / --busca
+    long n = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--amostras") == 0 && i + 1 < argc) {
+            amostras = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--csv") == 0 && i + 1 < argc) {
+            arquivoCsv = argv[++i];
+        } else if (strcmp(argv[i], "--json") == 0 && i + 1 < argc) {
+            arquivoJson = argv[++i];
+        } else if (strcmp(argv[i], "--contadores") == 0 && i + 1 < argc) {
+            arquivoContadores = argv[++i];
+        } else if (strcmp(argv[i], "--escala") == 0 || strcmp(argv[i], "--busca") == 0 ||
+                   strcmp(argv[i], "--perft") == 0 || strcmp(argv[i], "--montecarlo") == 0) {
+            modo = argv[i];
+            n = strcmp(modo, "--perft") == 0 ? PERFT_PROFUNDIDADE_PADRAO : sysconf(_SC_NPROCESSORS_ONLN);
+            if (i + 1 < argc && argv[i + 1][0] != '-') n = atol(argv[++i]);
+            if (n < 1) n = 1;
+        } else if (strcmp(argv[i], "--srs") == 0) {
+            modo = argv[i];
+        } else if (strcmp(argv[i], "--spsc") == 0 || strcmp(argv[i], "--tabuleiro") == 0 ||
+                   strcmp(argv[i], "--soa") == 0) {
+            modo = argv[i];
+            long padrao = strcmp(modo, "--spsc") == 0 ? SPSC_PECAS_PADRAO
+                        : strcmp(modo, "--soa") == 0  ? SOA_PASSOS_PADRAO
+                        : TABULEIRO_QUEDAS_PADRAO;
+            n = padrao;
+            if (i + 1 < argc && argv[i + 1][0] != '-') n = atol(argv[++i]);
+            if (n < 1) n = padrao;
+        } else {
+            fprintf(stderr, "Uso: %s [--amostras N] [--csv arquivo] [--json arquivo] "
+                            "[--escala [N]] [--spsc [N]] [--soa [N]] [--busca [N]] [--tabuleiro [N]] [--srs] [--perft [N]] "
+                            "[--montecarlo [N]] "
+                            "[--contadores arquivo]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (modo != NULL) {
+        int status = strcmp(modo, "--escala") == 0 ? medirEscala((int)n)
+                   : strcmp(modo, "--spsc") == 0   ? medirSpsc(n)
+                   : strcmp(modo, "--soa") == 0    ? medirSoA(n)
+                   : strcmp(modo, "--tabuleiro") == 0 ? medirTabuleiro(n)
+                   : strcmp(modo, "--srs") == 0    ? medirSrs()
+                   : strcmp(modo, "--perft") == 0  ? medirPerft((int)n)
+                   : strcmp(modo, "--montecarlo") == 0 ? medirMonteCarlo((int)n)
+                   : medirBusca((int)n);
+        if (arquivoContadores != NULL && !gravarContadores(arquivoContadores, NULL)) {
+            fprintf(stderr, "ERRO: nao foi possivel criar '%s'\n", arquivoContadores);
+            status = 1;
+        }
+        return status;
+    }
+    if (amostras < 100) amostras = 100;
+
+    const CasoBench casos[] = {
+        {"enqueue",           prepararComVaga,   loteEnqueue,       loteRestaurarFila, 0},
+        {"dequeue",           prepararBaseCheia, loteDequeue,       loteRestaurarFila, 0},
+        {"frente",            prepararBaseCheia, loteFrente,        NULL, 0},
+        {"ciclo_fila_mascara", prepararBaseCheia, loteCicloMascara, NULL, 0},
+        {"ciclo_fila_modulo",  prepararBaseCheia, loteCicloModulo,  NULL, 0},
+        {"push",              prepararComVaga,   lotePush,          loteRestaurarPilha, 0},
+        {"pop",               prepararBaseCheia, lotePop,           loteRestaurarPilha, 0},
+        {"topo",              prepararBaseCheia, loteTopo,          NULL, 0},
+        {"trocarPecaSimples", prepararBaseCheia, loteTrocaSimples,  NULL, 0},
+        {"trocarMultipla",    prepararBaseCheia, loteTrocaMultipla, NULL, 0},
+        {"misto",             prepararMisto,     loteMisto,         NULL, 0},
+        {"hash_incremental",  prepararBaseCheia, loteHashIncremental, NULL, 0},
+        {"hash_recalcular",   prepararBaseCheia, loteHashRecalcular, NULL, 0},
+        {"tela_printf",       prepararTela,      loteTelaPrintf,    NULL, 0},
+        {"tela_quadro",       prepararTela,      loteTelaQuadro,    NULL, 0},
+        {"tela_repetida",     prepararTela,      loteTelaRepetida,  NULL, 0},
+        {"misto_historico",   prepararHistorico, loteMistoHistorico, NULL, 0},
+        {"desfazer_refazer",  prepararHistorico, loteDesfazerRefazer, NULL, 0},
+        {"motor_passo",       prepararMotor,     loteMotor,         NULL, 0},
+        {"aos_jogar",         prepararLayouts,   loteAosJogar,        NULL, SOA_SESSOES},
+        {"soa_jogar",         prepararLayouts,   loteSoaJogar,        NULL, SOA_SESSOES},
+        {"aos_reservar_usar", prepararLayouts,   loteAosReservarUsar, NULL, SOA_SESSOES},
+        {"soa_reservar_usar", prepararLayouts,   loteSoaReservarUsar, NULL, SOA_SESSOES},
+        {"snapshot_salvar",   prepararSnapshot,  loteSalvarSnapshot, NULL, 0},
+        {"snapshot_restaurar", prepararSnapshot, loteRestaurarSnapshot, NULL, 0},
+        {"checkpoint_bifurcar", prepararSnapshot, loteBifurcarCheckpoint, NULL, 0},
+        {"gerar_uniforme",    prepararUniforme,  loteGerarPeca,     NULL, 0},
+        {"gerar_saco7",       prepararSaco7,     loteGerarPeca,     NULL, 0},
+        {"gerar_saco14",      prepararSaco14,    loteGerarPeca,     NULL, 0},
+        {"gerar_tgm",         prepararTgm,       loteGerarPeca,     NULL, 0},
+        {"tabuleiro_soltar",  prepararTabuleiro, loteSoltarPeca,    NULL, 0},
+        {"tabuleiro_colocar", prepararTabuleiro, loteColocarPeca,   NULL, 0},
+    };
+    int numCasos = sizeof(casos) / sizeof(casos[0]);
+
+    printf("=====================================================================\n");
+    printf("   TETRIS STACK - BENCHMARK (%d amostras x %d ops)\n", amostras, OPS_POR_AMOSTRA);
+    printf("=====================================================================\n");
+    printf("%-20s %10s %10s %10s %14s\n", "caso", "ns/op", "p50", "p99", "ops/s");
+
+    for (int i = 0; i < numCasos; i++) {
+        medirCaso(&casos[i], amostras);
+    }
+
+    printf("=====================================================================\n");
+
+    if (arquivoCsv != NULL) gravarCsv(arquivoCsv);
+    if (arquivoJson != NULL) gravarJson(arquivoJson);
+    if (arquivoContadores != NULL && !gravarContadores(arquivoContadores, NULL)) {
+        fprintf(stderr, "ERRO: nao foi possivel criar '%s'\n", arquivoContadores);
+    }
+
+    return 0;
+}
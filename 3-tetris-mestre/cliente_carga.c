@@ -0,0 +1,424 @@
+/*
+ * =====================================================================
+ * TETRIS STACK - NIVEL MESTRE
+ * Gerador de Carga do Servidor
+ * =====================================================================
+ * Descricao: Abre muitas conexoes com o servidor (servidor.c) e mantem
+ * em cada uma ate --janela pedidos em voo (pipeline), repartidas entre
+ * algumas threads com um epoll cada. Cada conexao comeca com "s N" e
+ * guarda uma copia local da sessao com a mesma semente, entao toda
+ * resposta e conferida contra o estado esperado. Mede pedidos/s e a
+ * latencia de cada pedido (envio -> resposta): media, p50, p99, maximo.
+ *
+ * Compilacao:
+ *   gcc -O2 -pthread -o cliente_carga cliente_carga.c -lm
+ *
+ * Uso:
+ *   ./cliente_carga [--socket caminho] [--clientes N] [--pedidos N]
+ *                   [--janela N] [--threads N] [--semente S]
+ *                   [--fila N] [--pilha M] [--gerador nome]
+ *   (--fila / --pilha / --gerador tem que ser os mesmos do servidor)
+ *
+ * Teste local:
+ *   ./servidor --threads 4 &
+ *   ./cliente_carga --clientes 2000 --pedidos 500 --janela 32
+ *   kill %1
+ * =====================================================================
+ */
+
+// Reaproveita as estruturas do sistema completo (sem o main interativo)
+#define TETRIS_SEM_MAIN
+#include "sistema_completo.c"
+
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+// ==================== CONSTANTES ====================
+#define SOCKET_PADRAO "tetris.sock"
+#define CLIENTES_PADRAO 1000
+#define PEDIDOS_PADRAO 1000         // Por conexao, contando o "s N" inicial
+#define JANELA_PADRAO 16
+#define JANELA_MAX 256              // Pedidos em voo por conexao
+#define MAX_THREADS_CARGA 64
+#define MAX_EVENTOS 256
+#define TAM_ENTRADA_CARGA 32768     // Respostas recebidas e ainda nao conferidas
+#define TAM_PEDIDO_MAX 24           // "s " + 20 digitos + '\n'
+#define TAM_RESPOSTA_MAX (32 + 11 * (FILA_MAX + PILHA_MAX))
+#define AMOSTRAS_MAX (1L << 22)     // Latencias guardadas por thread
+#define OPCAO_SEMENTE 0             // Codigos dos pedidos em voo (1-5: menu)
+#define OPCAO_ESTADO 6
+
+// ==================== ESTRUTURAS ====================
+
+/*
+ * Struct ConexaoCarga:
+ * Uma conexao: a sessao que o servidor deve ter, os pedidos em voo
+ * (codigo e instante do envio, num anel de JANELA_MAX) e os buffers.
+ */
+typedef struct {
+    int descritor;
+    int indice;
+    Sessao sessao;
+    uint64_t semente;
+    GeradorAleatorio aleatorio;     // Sorteio dos pedidos
+    unsigned char emVoo[JANELA_MAX];
+    long enviadoNs[JANELA_MAX];
+    long enviados;
+    long respondidos;
+    char entrada[TAM_ENTRADA_CARGA];
+    int tamEntrada;
+    char saida[JANELA_MAX * TAM_PEDIDO_MAX];
+    int tamSaida;
+    int escritos;
+    int esperaEscrita;
+} ConexaoCarga;
+
+typedef struct {
+    const char* caminho;
+    const Configuracao* cfg;
+    int primeira;               // Indices das conexoes desta thread
+    int numConexoes;
+    long pedidos;
+    int janela;
+    uint64_t semente;
+    long* latencias;            // ns, ate AMOSTRAS_MAX
+    long numLatencias;
+    long respostas;
+    long divergencias;
+    int falhou;                 // Conexao recusada ou fechada antes do fim
+    pthread_t thread;
+} ThreadCarga;
+
+// ==================== CONFERENCIA ====================
+
+static long relogioNs(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1000000000L + t.tv_nsec;
+}
+
+static int formatarPeca(char* b, Peca peca) {
+    if (peca == PECA_NENHUMA) return sprintf(b, "-");
+    return sprintf(b, "%c%d", nomePeca(peca), idPeca(peca));
+}
+
+/*
+ * respostaEsperada()
+ * Aplica o pedido na copia local e escreve a linha que o servidor tem
+ * que devolver (sem o '\n'). Formatacao independente da do servidor.
+ */
+static void respostaEsperada(ConexaoCarga* c, const Configuracao* cfg, int opcao, char* b) {
+    Peca peca = PECA_NENHUMA;
+    Resultado r = RES_OK;
+    if (opcao == OPCAO_SEMENTE) {
+        iniciarSessao(&c->sessao, cfg, c->sessao.arena, c->semente);
+    } else if (opcao != OPCAO_ESTADO) {
+        r = executarOperacao(&c->sessao, opcao, &peca);
+        if (r != RES_OK || opcao > 3) peca = PECA_NENHUMA;
+    }
+
+    b += sprintf(b, "%s ", NOMES_RESULTADO[r]);
+    b += formatarPeca(b, peca);
+    b += sprintf(b, " F:");
+    FilaCircular* f = &c->sessao.fila;
+    for (int i = 0; i < tamanhoFila(f); i++) {
+        if (i > 0) *b++ = ',';
+        b += formatarPeca(b, f->elementos[(f->frente + (unsigned int)i) & f->mascara]);
+    }
+    b += sprintf(b, " P:");
+    for (int i = 0; i <= c->sessao.pilha.topo; i++) {
+        if (i > 0) *b++ = ',';
+        b += formatarPeca(b, c->sessao.pilha.elementos[i]);
+    }
+}
+
+// Confere as respostas completas da entrada, na ordem dos pedidos
+static void conferirRespostas(ThreadCarga* t, ConexaoCarga* c) {
+    char esperada[TAM_RESPOSTA_MAX];
+    int inicio = 0;
+    for (int i = 0; i < c->tamEntrada; i++) {
+        if (c->entrada[i] != '\n') continue;
+        int k = (int)(c->respondidos % JANELA_MAX);
+        c->entrada[i] = '\0';
+        respostaEsperada(c, t->cfg, c->emVoo[k], esperada);
+        if (strcmp(esperada, c->entrada + inicio) != 0) {
+            if (t->divergencias == 0) {
+                fprintf(stderr, "DIVERGENCIA na conexao %d, pedido %ld:\n  esperado: %s\n  recebido: %s\n",
+                        c->indice, c->respondidos, esperada, c->entrada + inicio);
+            }
+            t->divergencias++;
+        }
+        if (t->numLatencias < AMOSTRAS_MAX) {
+            t->latencias[t->numLatencias++] = relogioNs() - c->enviadoNs[k];
+        }
+        c->respondidos++;
+        t->respostas++;
+        inicio = i + 1;
+    }
+    c->tamEntrada -= inicio;
+    memmove(c->entrada, c->entrada + inicio, (size_t)c->tamEntrada);
+}
+
+// ==================== CONEXOES ====================
+
+static int conectar(const char* caminho) {
+    struct sockaddr_un endereco;
+    memset(&endereco, 0, sizeof(endereco));
+    endereco.sun_family = AF_UNIX;
+    strncpy(endereco.sun_path, caminho, sizeof(endereco.sun_path) - 1);
+
+    int d = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (d < 0) return -1;
+    int flags;
+    if (connect(d, (struct sockaddr*)&endereco, sizeof(endereco)) != 0 ||
+        (flags = fcntl(d, F_GETFL, 0)) < 0 || fcntl(d, F_SETFL, flags | O_NONBLOCK) != 0) {
+        close(d);
+        return -1;
+    }
+    return d;
+}
+
+// Completa a janela com pedidos sorteados (o primeiro e "s N")
+static void encherJanela(ThreadCarga* t, ConexaoCarga* c) {
+    long agora = relogioNs();
+    while (c->enviados < t->pedidos && c->enviados - c->respondidos < t->janela) {
+        int k = (int)(c->enviados % JANELA_MAX);
+        char* p = c->saida + c->tamSaida;
+        if (c->enviados == 0) {
+            c->emVoo[k] = OPCAO_SEMENTE;
+            p += sprintf(p, "s %llu\n", (unsigned long long)c->semente);
+        } else {
+            c->emVoo[k] = (unsigned char)(1 + aleatorioLimitado(&c->aleatorio, OPCAO_ESTADO));
+            *p++ = c->emVoo[k] == OPCAO_ESTADO ? 'e' : (char)('0' + c->emVoo[k]);
+            *p++ = '\n';
+        }
+        c->tamSaida = (int)(p - c->saida);
+        c->enviadoNs[k] = agora;
+        c->enviados++;
+    }
+}
+
+/*
+ * atenderCarga()
+ * Le e confere o que chegou, completa a janela e envia. Retorna -1 em
+ * erro, 0 quando todas as respostas chegaram e 1 para continuar.
+ */
+static int atenderCarga(ThreadCarga* t, int epoll, ConexaoCarga* c) {
+    for (;;) {
+        ssize_t n = read(c->descritor, c->entrada + c->tamEntrada,
+                         (size_t)(TAM_ENTRADA_CARGA - c->tamEntrada));
+        if (n == 0) return -1;
+        if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK) return -1;
+        if (n > 0) {
+            c->tamEntrada += (int)n;
+            conferirRespostas(t, c);
+            if (c->tamEntrada == TAM_ENTRADA_CARGA) return -1;     // Linha longa demais
+        }
+        if (n < 0) break;
+    }
+    if (c->respondidos == t->pedidos) return 0;
+
+    if (c->tamSaida == c->escritos) {
+        c->tamSaida = c->escritos = 0;
+        encherJanela(t, c);
+    }
+    while (c->escritos < c->tamSaida) {
+        ssize_t n = write(c->descritor, c->saida + c->escritos, (size_t)(c->tamSaida - c->escritos));
+        if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK) return -1;
+        if (n < 0) break;
+        c->escritos += (int)n;
+    }
+    int espera = c->escritos < c->tamSaida;
+    if (espera != c->esperaEscrita) {
+        struct epoll_event ev = {.events = EPOLLIN | (espera ? EPOLLOUT : 0), .data.ptr = c};
+        epoll_ctl(epoll, EPOLL_CTL_MOD, c->descritor, &ev);
+        c->esperaEscrita = espera;
+    }
+    return 1;
+}
+
+static void* lacoCarga(void* arg) {
+    ThreadCarga* t = (ThreadCarga*)arg;
+    ConexaoCarga* conexoes = calloc((size_t)t->numConexoes, sizeof(ConexaoCarga));
+    struct epoll_event eventos[MAX_EVENTOS];
+    int epoll = epoll_create1(0);
+    int ativas = 0;
+    if (conexoes == NULL || epoll < 0) {
+        t->falhou = 1;
+        free(conexoes);
+        return NULL;
+    }
+
+    for (int i = 0; i < t->numConexoes; i++) {
+        ConexaoCarga* c = &conexoes[i];
+        c->indice = t->primeira + i;
+        c->semente = t->semente + (uint64_t)c->indice;
+        semearGerador(&c->aleatorio, t->semente, (uint64_t)c->indice + 1);
+        c->descritor = conectar(t->caminho);
+        struct epoll_event ev = {.events = EPOLLIN, .data.ptr = c};
+        if (c->descritor < 0 || !criarSessao(&c->sessao, t->cfg, c->semente) ||
+            epoll_ctl(epoll, EPOLL_CTL_ADD, c->descritor, &ev) != 0) {
+            t->falhou = 1;
+            if (c->descritor >= 0) close(c->descritor);
+            c->descritor = -1;
+            continue;
+        }
+        if (atenderCarga(t, epoll, c) < 0) {
+            t->falhou = 1;
+            close(c->descritor);
+            c->descritor = -1;
+            continue;
+        }
+        ativas++;
+    }
+
+    while (ativas > 0) {
+        int n = epoll_wait(epoll, eventos, MAX_EVENTOS, -1);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) break;
+        for (int i = 0; i < n; i++) {
+            ConexaoCarga* c = (ConexaoCarga*)eventos[i].data.ptr;
+            int estado = atenderCarga(t, epoll, c);
+            if (estado <= 0) {
+                t->falhou |= estado < 0;
+                epoll_ctl(epoll, EPOLL_CTL_DEL, c->descritor, NULL);
+                close(c->descritor);
+                c->descritor = -1;
+                ativas--;
+            }
+        }
+    }
+
+    for (int i = 0; i < t->numConexoes; i++) destruirSessao(&conexoes[i].sessao);
+    free(conexoes);
+    close(epoll);
+    return NULL;
+}
+
+static int compararLatencias(const void* a, const void* b) {
+    long x = *(const long*)a;
+    long y = *(const long*)b;
+    return (x > y) - (x < y);
+}
+
+// ==================== FUNCAO PRINCIPAL ====================
+int main(int argc, char* argv[]) {
+    Configuracao cfg = {TAM_FILA, TAM_PILHA, 0, GERADOR_SACO7};
+    const char* caminho = SOCKET_PADRAO;
+    int clientes = CLIENTES_PADRAO;
+    long pedidos = PEDIDOS_PADRAO;
+    int janela = JANELA_PADRAO;
+    uint64_t semente = 1;
+    long nucleos = sysconf(_SC_NPROCESSORS_ONLN);
+    int numThreads = nucleos < 1 ? 1 : (int)nucleos;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--socket") == 0 && i + 1 < argc) {
+            caminho = argv[++i];
+        } else if (strcmp(argv[i], "--clientes") == 0 && i + 1 < argc) {
+            clientes = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--pedidos") == 0 && i + 1 < argc) {
+            pedidos = atol(argv[++i]);
+        } else if (strcmp(argv[i], "--janela") == 0 && i + 1 < argc) {
+            janela = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            numThreads = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--semente") == 0 && i + 1 < argc) {
+            semente = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--fila") == 0 && i + 1 < argc) {
+            cfg.tamFila = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--pilha") == 0 && i + 1 < argc) {
+            cfg.tamPilha = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--gerador") == 0 && i + 1 < argc) {
+            int politica = politicaPorNome(argv[++i]);
+            if (politica < 0) {
+                fprintf(stderr, "ERRO: gerador desconhecido '%s'\n", argv[i]);
+                return 1;
+            }
+            cfg.politica = (PoliticaGeracao)politica;
+        } else {
+            fprintf(stderr, "Uso: %s [--socket caminho] [--clientes N] [--pedidos N] [--janela N] "
+                            "[--threads N] [--semente S] [--fila N] [--pilha M] [--gerador nome]\n",
+                    argv[0]);
+            return 1;
+        }
+    }
+    if (cfg.tamFila < 1 || cfg.tamFila > FILA_MAX || cfg.tamPilha < 1 || cfg.tamPilha > PILHA_MAX ||
+        clientes < 1 || pedidos < 1 || janela < 1 || janela > JANELA_MAX) {
+        fprintf(stderr, "ERRO: parametros fora dos limites (janela: 1 a %d)\n", JANELA_MAX);
+        return 1;
+    }
+    if (numThreads > clientes) numThreads = clientes;
+    if (numThreads > MAX_THREADS_CARGA) numThreads = MAX_THREADS_CARGA;
+    if (numThreads < 1) numThreads = 1;
+    signal(SIGPIPE, SIG_IGN);
+
+    static ThreadCarga threads[MAX_THREADS_CARGA];
+    long amostrasPorThread = (long)(clientes / numThreads + 1) * pedidos;
+    if (amostrasPorThread > AMOSTRAS_MAX) amostrasPorThread = AMOSTRAS_MAX;
+    long t0 = relogioNs();
+    int criadas = 0;
+    for (int i = 0; i < numThreads; i++) {
+        ThreadCarga* t = &threads[i];
+        memset(t, 0, sizeof(*t));
+        t->caminho = caminho;
+        t->cfg = &cfg;
+        t->primeira = (int)((long)clientes * i / numThreads);
+        t->numConexoes = (int)((long)clientes * (i + 1) / numThreads) - t->primeira;
+        t->pedidos = pedidos;
+        t->janela = janela;
+        t->semente = semente;
+        t->latencias = malloc(sizeof(long) * (size_t)amostrasPorThread);
+        if (t->latencias == NULL || pthread_create(&t->thread, NULL, lacoCarga, t) != 0) {
+            free(t->latencias);
+            break;
+        }
+        criadas++;
+    }
+
+    long respostas = 0, divergencias = 0, numLatencias = 0;
+    int falhou = criadas < numThreads;
+    for (int i = 0; i < criadas; i++) {
+        pthread_join(threads[i].thread, NULL);
+        respostas += threads[i].respostas;
+        divergencias += threads[i].divergencias;
+        numLatencias += threads[i].numLatencias;
+        falhou |= threads[i].falhou;
+    }
+    double segundos = (relogioNs() - t0) / 1e9;
+
+    // Junta as latencias de todas as threads para os percentis
+    long* todas = malloc(sizeof(long) * (size_t)(numLatencias > 0 ? numLatencias : 1));
+    long n = 0;
+    double soma = 0;
+    for (int i = 0; i < criadas; i++) {
+        for (long k = 0; todas != NULL && k < threads[i].numLatencias; k++) {
+            todas[n++] = threads[i].latencias[k];
+            soma += threads[i].latencias[k];
+        }
+        free(threads[i].latencias);
+    }
+    qsort(todas, (size_t)n, sizeof(long), compararLatencias);
+
+    printf("=====================================================================\n");
+    printf("   TETRIS STACK - CARGA NO SERVIDOR ('%s')\n", caminho);
+    printf("=====================================================================\n");
+    printf("conexoes: %d  threads: %d  janela: %d  pedidos por conexao: %ld\n",
+           clientes, criadas, janela, pedidos);
+    printf("respostas: %ld de %ld em %.3f s (%.0f pedidos/s)\n",
+           respostas, (long)clientes * pedidos, segundos, respostas / segundos);
+    if (n > 0) {
+        printf("latencia (us): media %.1f  p50 %.1f  p99 %.1f  max %.1f\n",
+               soma / n / 1e3, todas[n / 2] / 1e3, todas[n * 99 / 100] / 1e3, todas[n - 1] / 1e3);
+    }
+    printf("divergencias: %ld\n", divergencias);
+    printf("=====================================================================\n");
+    free(todas);
+
+    int ok = !falhou && divergencias == 0 && respostas == (long)clientes * pedidos;
+    printf("%s\n", ok ? "OK: todas as respostas conferem com a sessao local"
+                      : "FALHA: conexoes recusadas, respostas faltando ou divergentes");
+    return !ok;
+}
@@ -0,0 +1,334 @@
+/*
+ * =====================================================================
+ * TETRIS STACK - NIVEL MESTRE
+ * Reproducao de Logs de Replay
+ * =====================================================================
+ * Descricao: Re-executa um log binario gravado com --gravar (ou
+ * gerado aqui com --gerar). O arquivo e mapeado com mmap e lido em
+ * sequencia, entao logs de varios GB nao precisam caber na RAM. Cada
+ * checkpoint do log e conferido contra o estado reproduzido; a
+ * primeira divergencia e apontada com o numero da operacao e o offset.
+ *
+ * Compilacao:
+ *   gcc -O2 -pthread -o reproducao reproducao.c -lm
+ *
+ * Uso:
+ *   ./reproducao arquivo [--ate N] [--sem-verificar] [--estado]
+ *                [--verificar-desfazer]
+ *                (desfaz e refaz cada operacao conferindo o estado, e a
+ *                 cada 4096 desfaz o historico inteiro e refaz)
+ *   ./reproducao --gerar arquivo N [--semente S] [--gerador nome]
+ *                [--fila N] [--pilha M]
+ *                (log sintetico com N operacoes sorteadas)
+ * =====================================================================
+ */
+
+// Reaproveita as estruturas do sistema completo (sem o main interativo)
+#define TETRIS_SEM_MAIN
+#include "sistema_completo.c"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define INTERVALO_DESFAZER_TUDO 4096
+
+// ==================== REPRODUCAO ====================
+
+/*
+ * Struct ConferenciaDesfazer:
+ * Resumos do estado antes de cada operacao ainda desfazivel, no mesmo
+ * anel (mesmos indices) do Historico.
+ */
+typedef struct {
+    uint64_t antes[TAM_HISTORICO];
+    unsigned long operacoes;
+    unsigned long falhas;
+} ConferenciaDesfazer;
+
+/*
+ * conferirDesfazer()
+ * Executa 'opcao' como a reproducao normal, mas confere que desfazer
+ * volta ao resumo de antes e refazer ao de depois. A cada
+ * INTERVALO_DESFAZER_TUDO operacoes desfaz o historico inteiro,
+ * conferindo cada passo, e refaz tudo.
+ */
+static Resultado conferirDesfazer(Sessao* s, Historico* h, ConferenciaDesfazer* c,
+                                  int opcao, Peca* p) {
+    if (opcao > 5) return executarComHistorico(s, h, opcao, p);
+    
+    uint64_t antes = resumoSessao(s);
+    Resultado r = executarComHistorico(s, h, opcao, p);
+    if (r != RES_OK) return r;
+    c->antes[(h->atual - 1) % TAM_HISTORICO] = antes;
+    
+    int alvo;
+    uint64_t depois = resumoSessao(s);
+    desfazer(s, h, &alvo);
+    if (resumoSessao(s) != antes) c->falhas++;
+    refazer(s, h, &alvo);
+    if (resumoSessao(s) != depois) c->falhas++;
+    
+    if (++c->operacoes % INTERVALO_DESFAZER_TUDO == 0) {
+        while (h->atual != h->inicio) {
+            desfazer(s, h, &alvo);
+            if (resumoSessao(s) != c->antes[h->atual % TAM_HISTORICO]) c->falhas++;
+        }
+        while (h->atual != h->fim) refazer(s, h, &alvo);
+        if (resumoSessao(s) != depois) c->falhas++;
+    }
+    return r;
+}
+
+/*
+ * reproduzir()
+ * Executa as operacoes do log mapeado em 'dados' a partir de uma
+ * sessao nova com a semente do cabecalho. Para em 'limite' operacoes
+ * (0 = todas). Retorna 0 se tudo conferiu, 2 se algum checkpoint
+ * divergiu e 1 se o arquivo estiver corrompido. O gravador sempre fecha
+ * o log com um checkpoint; um arquivo lido ate o fim que nao termina
+ * num checkpoint foi truncado, e as operacoes depois do ultimo nao
+ * teriam sido conferidas.
+ */
+static int reproduzir(const unsigned char* dados, size_t tamanho, uint64_t limite,
+                      int verificar, int verificarDesfazer, int mostrarEstado) {
+    Configuracao cfg;
+    uint32_t intervalo;
+    if (!lerCabecalhoReplay(dados, tamanho, &cfg, &intervalo)) {
+        if (tamanho >= REPLAY_TAM_CABECALHO && memcmp(dados, REPLAY_MAGICO, 4) == 0 &&
+            (dados[4] | (dados[5] << 8)) > REPLAY_VERSAO) {
+            fprintf(stderr, "ERRO: log da versao %d, esta reproducao le ate a %d\n",
+                    dados[4] | (dados[5] << 8), REPLAY_VERSAO);
+        } else {
+            fprintf(stderr, "ERRO: cabecalho de replay invalido\n");
+        }
+        return 1;
+    }
+
+    Sessao sessao;
+    if (!criarSessao(&sessao, &cfg, cfg.semente)) {
+        fprintf(stderr, "ERRO: memoria insuficiente\n");
+        return 1;
+    }
+
+    unsigned long contagem[NUM_OPCOES + 1][NUM_RESULTADOS] = {{0}};
+    Historico historico;
+    ConferenciaDesfazer conferencia = {{0}, 0, 0};
+    uint64_t numOps = 0;
+    uint64_t resumoOps = FNV_BASE;
+    unsigned long checkpoints = 0;
+    int emCheckpoint = 0;
+    int status = 0;
+    size_t pos = REPLAY_TAM_CABECALHO;
+    Peca p;
+
+    iniciarHistorico(&historico);
+    clock_t inicio = clock();
+
+    while (pos < tamanho && (limite == 0 || numOps < limite)) {
+        unsigned char c = dados[pos];
+        if (c >= 1 && c <= NUM_OPCOES) {
+            Resultado r = verificarDesfazer
+                ? conferirDesfazer(&sessao, &historico, &conferencia, c, &p)
+                : executarComHistorico(&sessao, &historico, c, &p);
+            contagem[c][r]++;
+            resumoOps = (resumoOps ^ c) * FNV_PRIMO;
+            numOps++;
+            pos++;
+            emCheckpoint = 0;
+            continue;
+        }
+
+        if (c == REPLAY_CHECKPOINT && tamanho - pos < REPLAY_TAM_CHECKPOINT) {
+            emCheckpoint = 0;  // checkpoint cortado no meio
+            break;
+        }
+        if (c != REPLAY_CHECKPOINT) {
+            fprintf(stderr, "ERRO: byte invalido 0x%02x no offset %zu\n", c, pos);
+            status = 1;
+            break;
+        }
+        if (verificar) {
+            uint64_t opsGravadas = lerU64(dados + pos + 1);
+            uint64_t resumoGravado = lerU64(dados + pos + 9);
+            uint64_t opsResumoGravado = lerU64(dados + pos + 17);
+            if (opsGravadas != numOps || resumoGravado != resumoSessao(&sessao) ||
+                opsResumoGravado != resumoOps) {
+                fprintf(stderr, "DIVERGENCIA: checkpoint no offset %zu (operacao %llu) "
+                                "nao confere com o estado reproduzido\n",
+                        pos, (unsigned long long)numOps);
+                status = 2;
+                break;
+            }
+        }
+        checkpoints++;
+        pos += REPLAY_TAM_CHECKPOINT;
+        emCheckpoint = 1;
+    }
+
+    if (status == 0 && (limite == 0 || numOps < limite) && !emCheckpoint) {
+        fprintf(stderr, "ERRO: log truncado apos operacao %llu\n", (unsigned long long)numOps);
+        status = 1;
+    }
+
+    double segundos = (double)(clock() - inicio) / CLOCKS_PER_SEC;
+
+    printf("=====================================================\n");
+    printf("   TETRIS STACK - REPRODUCAO\n");
+    printf("=====================================================\n");
+    printf("Semente: %llu (gerador %s, fila %d, pilha %d)\n",
+           (unsigned long long)cfg.semente, nomePolitica(cfg.politica), cfg.tamFila, cfg.tamPilha);
+    printf("Operacoes reproduzidas: %llu\n", (unsigned long long)numOps);
+    for (int op = 1; op <= NUM_OPCOES; op++) {
+        unsigned long ok = contagem[op][RES_OK];
+        unsigned long soma = 0;
+        for (int r = 0; r < NUM_RESULTADOS; r++) soma += contagem[op][r];
+        printf("  Opcao %d: %lu (ok: %lu, erros: %lu)\n", op, soma, ok, soma - ok);
+    }
+    printf("Checkpoints %s: %lu (a cada %u operacoes)\n",
+           verificar ? "conferidos" : "ignorados", checkpoints, intervalo);
+    if (verificarDesfazer) {
+        printf("Desfazer/refazer conferidos: %lu operacoes, %lu falhas\n",
+               conferencia.operacoes, conferencia.falhas);
+        if (conferencia.falhas > 0 && status == 0) status = 2;
+    }
+    printf("Total de pecas geradas: %u\n", sessao.gerador.proximoId);
+    if (segundos > 0) {
+        printf("Tempo: %.3f s (%.0f ops/s, %.1f MB/s)\n", segundos, numOps / segundos,
+               pos / segundos / 1e6);
+    }
+    printf("=====================================================\n");
+
+    if (mostrarEstado) exibirEstado(&sessao.fila, &sessao.pilha);
+
+    destruirSessao(&sessao);
+    return status;
+}
+
+/*
+ * gerarLog()
+ * Grava um log com 'total' operacoes sorteadas (1-5), executando cada
+ * uma para que os checkpoints tenham o resumo correto.
+ */
+static int gerarLog(const char* caminho, uint64_t total, const Configuracao* cfg) {
+    GravadorReplay gravador;
+    GeradorAleatorio sorteio;
+    Sessao sessao;
+    Peca p;
+
+    if (!criarSessao(&sessao, cfg, cfg->semente)) {
+        fprintf(stderr, "ERRO: memoria insuficiente\n");
+        return 1;
+    }
+    if (!abrirGravador(&gravador, caminho, cfg, REPLAY_INTERVALO_PADRAO)) {
+        fprintf(stderr, "ERRO: nao foi possivel criar '%s'\n", caminho);
+        destruirSessao(&sessao);
+        return 1;
+    }
+
+    semearGerador(&sorteio, cfg->semente, 13);
+    for (uint64_t i = 0; i < total; i++) {
+        int opcao = 1 + (int)aleatorioLimitado(&sorteio, 5);
+        executarOperacao(&sessao, opcao, &p);
+        gravarOperacao(&gravador, &sessao, opcao);
+    }
+
+    int ok = fecharGravador(&gravador, &sessao);
+    destruirSessao(&sessao);
+    if (!ok) {
+        fprintf(stderr, "ERRO: falha ao gravar '%s'\n", caminho);
+        return 1;
+    }
+    printf("Log gerado: %s (%llu operacoes)\n", caminho, (unsigned long long)total);
+    return 0;
+}
+
+// ==================== FUNCAO PRINCIPAL ====================
+int main(int argc, char* argv[]) {
+    Configuracao cfg = {TAM_FILA, TAM_PILHA, 12345, GERADOR_SACO7};
+    const char* caminho = NULL;
+    const char* destino = NULL;
+    uint64_t limite = 0;
+    uint64_t totalGerar = 0;
+    int verificar = 1;
+    int verificarDesfazer = 0;
+    int mostrarEstado = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--gerar") == 0 && i + 2 < argc) {
+            destino = argv[++i];
+            totalGerar = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--semente") == 0 && i + 1 < argc) {
+            cfg.semente = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--gerador") == 0 && i + 1 < argc) {
+            int politica = politicaPorNome(argv[++i]);
+            if (politica < 0) {
+                fprintf(stderr, "ERRO: gerador desconhecido '%s'\n", argv[i]);
+                return 1;
+            }
+            cfg.politica = (PoliticaGeracao)politica;
+        } else if (strcmp(argv[i], "--fila") == 0 && i + 1 < argc) {
+            cfg.tamFila = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--pilha") == 0 && i + 1 < argc) {
+            cfg.tamPilha = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--ate") == 0 && i + 1 < argc) {
+            limite = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--sem-verificar") == 0) {
+            verificar = 0;
+        } else if (strcmp(argv[i], "--verificar-desfazer") == 0) {
+            verificarDesfazer = 1;
+        } else if (strcmp(argv[i], "--estado") == 0) {
+            mostrarEstado = 1;
+        } else if (caminho == NULL && argv[i][0] != '-') {
+            caminho = argv[i];
+        } else {
+            fprintf(stderr, "Uso: %s arquivo [--ate N] [--sem-verificar] [--estado] "
+                            "[--verificar-desfazer]\n"
+                            "     %s --gerar arquivo N [--semente S] [--gerador nome] "
+                            "[--fila N] [--pilha M]\n",
+                    argv[0], argv[0]);
+            return 1;
+        }
+    }
+
+    if (destino != NULL) {
+        if (cfg.tamFila < 1 || cfg.tamFila > FILA_MAX || cfg.tamPilha < 1 || cfg.tamPilha > PILHA_MAX) {
+            fprintf(stderr, "ERRO: --fila deve estar entre 1 e %d e --pilha entre 1 e %d\n",
+                    FILA_MAX, PILHA_MAX);
+            return 1;
+        }
+        return gerarLog(destino, totalGerar, &cfg);
+    }
+    if (caminho == NULL) {
+        fprintf(stderr, "ERRO: informe o arquivo de replay\n");
+        return 1;
+    }
+
+    int fd = open(caminho, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "ERRO: nao foi possivel abrir '%s'\n", caminho);
+        return 1;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size < REPLAY_TAM_CABECALHO) {
+        fprintf(stderr, "ERRO: '%s' nao e um log de replay\n", caminho);
+        close(fd);
+        return 1;
+    }
+
+    size_t tamanho = (size_t)info.st_size;
+    const unsigned char* dados = mmap(NULL, tamanho, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (dados == MAP_FAILED) {
+        fprintf(stderr, "ERRO: mmap falhou para '%s'\n", caminho);
+        return 1;
+    }
+
+    // Leitura estritamente sequencial: o kernel le adiante e descarta
+    madvise((void*)dados, tamanho, MADV_SEQUENTIAL);
+
+    int status = reproduzir(dados, tamanho, limite, verificar, verificarDesfazer, mostrarEstado);
+    munmap((void*)dados, tamanho);
+    return status;
+}
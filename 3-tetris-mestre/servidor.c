@@ -0,0 +1,421 @@
+/*
+ * =====================================================================
+ * TETRIS STACK - NIVEL MESTRE
+ * Servidor de Sessoes (socket Unix)
+ * =====================================================================
+ * Descricao: Expoe as operacoes do menu num socket Unix, com um
+ * protocolo de texto de uma linha por pedido. Cada conexao e uma Sessao
+ * independente. Poucas threads, cada uma com o seu epoll, atendem
+ * milhares de conexoes: a conexao fica na thread que a aceitou, entao
+ * nada e compartilhado nem travado. O cliente pode mandar varios
+ * pedidos sem esperar as respostas (pipeline); tudo o que chegou numa
+ * leitura e respondido, em ordem, com um unico write.
+ *
+ * Protocolo (cada pedido gera uma linha de resposta):
+ *   1 jogar   2 reservar   3 usar reserva   4 troca simples
+ *   5 troca multipla   e estado   s N recomeca a sessao com a semente N
+ *   Resposta: RESULTADO PECA F:fila P:pilha
+ *     ex.: "OK I12 F:J3,O4,S5,I6,L7 P:Z0,L1,T2"
+ *     RESULTADO e um de NOMES_RESULTADO; PECA e a peca jogada, reservada
+ *     ou usada ('-' se nenhuma); fila da frente para tras, pilha da
+ *     base ao topo. Pedido desconhecido: OPCAO_INVALIDA.
+ *   Uma conexao nova comeca com a semente --semente + numero da conexao.
+ *
+ * Compilacao:
+ *   gcc -O2 -pthread -o servidor servidor.c -lm
+ *   (com -DINSTRUMENTAR, --contadores grava as operacoes de todas as
+ *    threads ao encerrar)
+ *
+ * Uso:
+ *   ./servidor [--socket caminho] [--threads N] [--fila N] [--pilha M]
+ *              [--semente S] [--gerador nome] [--contadores arquivo]
+ *   SIGINT/SIGTERM encerram. Teste de carga: ver cliente_carga.c.
+ * =====================================================================
+ */
+
+// Reaproveita as estruturas do sistema completo (sem o main interativo)
+#define TETRIS_SEM_MAIN
+#include "sistema_completo.c"
+
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+// ==================== CONSTANTES ====================
+#define SOCKET_PADRAO "tetris.sock"
+#define MAX_THREADS_SERVIDOR 64
+#define MAX_EVENTOS 256             // Eventos por epoll_wait
+#define TAM_ENTRADA 4096            // Pedidos ainda nao respondidos
+#define TAM_SAIDA 16384             // Respostas ainda nao enviadas
+#define TAM_RESPOSTA_MAX (32 + 11 * (FILA_MAX + PILHA_MAX))   // Peca: tipo + 9 digitos + ','
+
+// ==================== ESTRUTURAS ====================
+
+/*
+ * Struct Conexao:
+ * Um cliente: a sua sessao e os buffers de entrada (linhas ainda nao
+ * completas ou nao atendidas) e de saida (respostas ainda nao aceitas
+ * pelo socket). Enquanto ha saida pendente a conexao nao le mais nada.
+ */
+typedef struct {
+    int descritor;
+    Sessao sessao;
+    char entrada[TAM_ENTRADA];
+    int tamEntrada;
+    char saida[TAM_SAIDA];
+    int tamSaida;
+    int enviados;               // Bytes de 'saida' ja escritos
+    int esperaEscrita;          // EPOLLOUT ligado
+} Conexao;
+
+/*
+ * Struct ThreadServidor:
+ * Uma thread com o seu epoll. O socket de escuta esta em todos (com
+ * EPOLLEXCLUSIVE so uma acorda por conexao nova) e o eventfd avisa o
+ * encerramento.
+ */
+typedef struct {
+    int epoll;
+    int escuta;
+    int despertar;
+    const Configuracao* cfg;
+    unsigned long conexoes;
+    unsigned long pedidos;
+    unsigned long escritas;     // Chamadas a write()
+    pthread_t thread;
+} ThreadServidor;
+
+// Marcas no epoll_event dos descritores que nao sao conexoes
+static char MARCA_ESCUTA;
+static char MARCA_DESPERTAR;
+static _Atomic unsigned long proximaConexao;
+
+// ==================== PROTOCOLO ====================
+
+// "T123" ou "-"
+static char* escreverPecaCompacta(char* p, Peca peca) {
+    if (peca == PECA_NENHUMA) {
+        *p++ = '-';
+        return p;
+    }
+    *p++ = nomePeca(peca);
+    return escreverInteiro(p, (unsigned int)idPeca(peca));
+}
+
+/*
+ * escreverResposta()
+ * "RESULTADO PECA F:fila P:pilha\n" em 'p' (cabe em TAM_RESPOSTA_MAX).
+ * Devolve o fim.
+ */
+static char* escreverResposta(char* p, const Sessao* s, Resultado r, Peca peca) {
+    const FilaCircular* f = &s->fila;
+    p = escreverTexto(p, NOMES_RESULTADO[r]);
+    *p++ = ' ';
+    p = escreverPecaCompacta(p, peca);
+    p = escreverTexto(p, " F:");
+    for (unsigned int i = f->frente; i != f->tras; i++) {
+        if (i != f->frente) *p++ = ',';
+        p = escreverPecaCompacta(p, f->elementos[i & f->mascara]);
+    }
+    p = escreverTexto(p, " P:");
+    for (int i = 0; i <= s->pilha.topo; i++) {
+        if (i > 0) *p++ = ',';
+        p = escreverPecaCompacta(p, s->pilha.elementos[i]);
+    }
+    *p++ = '\n';
+    return p;
+}
+
+// "s N": semente decimal. Retorna 0 se a linha nao for nesse formato.
+static int lerSemente(const char* linha, int tam, uint64_t* semente) {
+    if (tam < 3 || linha[0] != 's' || linha[1] != ' ') return 0;
+    uint64_t v = 0;
+    for (int i = 2; i < tam; i++) {
+        if (linha[i] < '0' || linha[i] > '9') return 0;
+        v = v * 10 + (uint64_t)(linha[i] - '0');
+    }
+    *semente = v;
+    return 1;
+}
+
+/*
+ * atenderPedido()
+ * Executa uma linha (sem o '\n') na sessao da conexao e acrescenta a
+ * resposta na saida
+ */
+static void atenderPedido(Conexao* c, const Configuracao* cfg, const char* linha, int tam) {
+    Peca peca = PECA_NENHUMA;
+    Resultado r = RES_OK;
+    uint64_t semente;
+    if (tam > 0 && linha[tam - 1] == '\r') tam--;
+
+    if (tam == 1 && linha[0] >= '1' && linha[0] <= '5') {
+        r = executarOperacao(&c->sessao, linha[0] - '0', &peca);
+        if (r != RES_OK || linha[0] > '3') peca = PECA_NENHUMA;
+    } else if (tam == 1 && linha[0] == 'e') {
+        r = RES_OK;
+    } else if (lerSemente(linha, tam, &semente)) {
+        iniciarSessao(&c->sessao, cfg, c->sessao.arena, semente);
+    } else {
+        r = RES_OPCAO_INVALIDA;
+    }
+    char* fim = escreverResposta(c->saida + c->tamSaida, &c->sessao, r, peca);
+    c->tamSaida = (int)(fim - c->saida);
+}
+
+// ==================== CONEXOES ====================
+
+static void fecharConexao(ThreadServidor* t, Conexao* c) {
+    epoll_ctl(t->epoll, EPOLL_CTL_DEL, c->descritor, NULL);
+    close(c->descritor);
+    destruirSessao(&c->sessao);
+    free(c);
+}
+
+static int semBloqueio(int descritor) {
+    int flags = fcntl(descritor, F_GETFL, 0);
+    return flags >= 0 && fcntl(descritor, F_SETFL, flags | O_NONBLOCK) == 0;
+}
+
+// Aceita todas as conexoes pendentes; cada uma fica nesta thread
+static void aceitarConexoes(ThreadServidor* t) {
+    for (;;) {
+        int d = accept(t->escuta, NULL, NULL);
+        if (d < 0) return;      // EAGAIN: outra thread levou ou acabou
+
+        Conexao* c = malloc(sizeof(Conexao));
+        uint64_t semente = t->cfg->semente + atomic_fetch_add(&proximaConexao, 1);
+        if (c == NULL || !semBloqueio(d) || !criarSessao(&c->sessao, t->cfg, semente)) {
+            free(c);
+            close(d);
+            continue;
+        }
+        c->descritor = d;
+        c->tamEntrada = 0;
+        c->tamSaida = 0;
+        c->enviados = 0;
+        c->esperaEscrita = 0;
+
+        struct epoll_event ev = {.events = EPOLLIN, .data.ptr = c};
+        if (epoll_ctl(t->epoll, EPOLL_CTL_ADD, d, &ev) != 0) {
+            close(d);
+            destruirSessao(&c->sessao);
+            free(c);
+            continue;
+        }
+        t->conexoes++;
+    }
+}
+
+// Escreve o que puder da saida. Retorna -1 em erro, 1 se sobrou algo.
+static int enviarSaida(ThreadServidor* t, Conexao* c) {
+    while (c->enviados < c->tamSaida) {
+        ssize_t n = write(c->descritor, c->saida + c->enviados, (size_t)(c->tamSaida - c->enviados));
+        if (n < 0) return errno == EAGAIN || errno == EWOULDBLOCK ? 1 : -1;
+        c->enviados += (int)n;
+        t->escritas++;
+    }
+    c->tamSaida = 0;
+    c->enviados = 0;
+    return 0;
+}
+
+// Responde as linhas completas da entrada enquanto couber na saida
+static void atenderLinhas(ThreadServidor* t, Conexao* c) {
+    int inicio = 0;
+    for (int i = 0; i < c->tamEntrada && c->tamSaida + TAM_RESPOSTA_MAX <= TAM_SAIDA; i++) {
+        if (c->entrada[i] != '\n') continue;
+        atenderPedido(c, t->cfg, c->entrada + inicio, i - inicio);
+        t->pedidos++;
+        inicio = i + 1;
+    }
+    c->tamEntrada -= inicio;
+    memmove(c->entrada, c->entrada + inicio, (size_t)c->tamEntrada);
+}
+
+/*
+ * atenderConexao()
+ * Le, responde e envia ate o socket nao ter mais nada para ler ou nao
+ * aceitar mais escrita. No segundo caso liga EPOLLOUT e para de ler
+ * (o cliente que nao le as respostas nao enche a memoria do servidor).
+ * Retorna 0 quando a conexao deve ser fechada.
+ */
+static int atenderConexao(ThreadServidor* t, Conexao* c) {
+    for (;;) {
+        atenderLinhas(t, c);
+        int pendente = enviarSaida(t, c);
+        if (pendente < 0) return 0;
+        if (!pendente && memchr(c->entrada, '\n', (size_t)c->tamEntrada) != NULL) continue;  // A saida tinha enchido
+        if (!pendente && c->tamEntrada == TAM_ENTRADA) return 0;    // Linha longa demais
+
+        if (pendente != c->esperaEscrita) {
+            struct epoll_event ev = {.events = pendente ? EPOLLOUT : EPOLLIN, .data.ptr = c};
+            epoll_ctl(t->epoll, EPOLL_CTL_MOD, c->descritor, &ev);
+            c->esperaEscrita = pendente;
+        }
+        if (pendente) return 1;
+
+        ssize_t n = read(c->descritor, c->entrada + c->tamEntrada, (size_t)(TAM_ENTRADA - c->tamEntrada));
+        if (n == 0) return 0;
+        if (n < 0) return errno == EAGAIN || errno == EWOULDBLOCK;
+        c->tamEntrada += (int)n;
+    }
+}
+
+// ==================== LACO DE EVENTOS ====================
+
+static void* lacoServidor(void* arg) {
+    ThreadServidor* t = (ThreadServidor*)arg;
+    struct epoll_event eventos[MAX_EVENTOS];
+    for (;;) {
+        int n = epoll_wait(t->epoll, eventos, MAX_EVENTOS, -1);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) break;
+        for (int i = 0; i < n; i++) {
+            void* alvo = eventos[i].data.ptr;
+            if (alvo == &MARCA_DESPERTAR) return NULL;
+            if (alvo == &MARCA_ESCUTA) {
+                aceitarConexoes(t);
+            } else if (!atenderConexao(t, (Conexao*)alvo)) {
+                fecharConexao(t, (Conexao*)alvo);
+            }
+        }
+    }
+    return NULL;
+}
+
+/*
+ * abrirEscuta()
+ * Socket Unix de escuta, sem bloqueio, no caminho dado (um arquivo
+ * antigo no caminho e removido). Retorna -1 em erro.
+ */
+static int abrirEscuta(const char* caminho) {
+    struct sockaddr_un endereco;
+    if (strlen(caminho) >= sizeof(endereco.sun_path)) return -1;
+    memset(&endereco, 0, sizeof(endereco));
+    endereco.sun_family = AF_UNIX;
+    strcpy(endereco.sun_path, caminho);
+
+    int d = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (d < 0) return -1;
+    unlink(caminho);
+    if (bind(d, (struct sockaddr*)&endereco, sizeof(endereco)) != 0 ||
+        listen(d, SOMAXCONN) != 0 || !semBloqueio(d)) {
+        close(d);
+        return -1;
+    }
+    return d;
+}
+
+// ==================== FUNCAO PRINCIPAL ====================
+int main(int argc, char* argv[]) {
+    Configuracao cfg = {TAM_FILA, TAM_PILHA, 1, GERADOR_SACO7};
+    const char* caminho = SOCKET_PADRAO;
+    const char* caminhoContadores = NULL;
+    long nucleos = sysconf(_SC_NPROCESSORS_ONLN);
+    int numThreads = nucleos < 1 ? 1 : (int)nucleos;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--socket") == 0 && i + 1 < argc) {
+            caminho = argv[++i];
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            numThreads = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--fila") == 0 && i + 1 < argc) {
+            cfg.tamFila = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--pilha") == 0 && i + 1 < argc) {
+            cfg.tamPilha = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--semente") == 0 && i + 1 < argc) {
+            cfg.semente = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--gerador") == 0 && i + 1 < argc) {
+            int politica = politicaPorNome(argv[++i]);
+            if (politica < 0) {
+                fprintf(stderr, "ERRO: gerador desconhecido '%s'\n", argv[i]);
+                return 1;
+            }
+            cfg.politica = (PoliticaGeracao)politica;
+        } else if (strcmp(argv[i], "--contadores") == 0 && i + 1 < argc) {
+            caminhoContadores = argv[++i];
+        } else {
+            fprintf(stderr, "Uso: %s [--socket caminho] [--threads N] [--fila N] [--pilha M] "
+                            "[--semente S] [--gerador nome] [--contadores arquivo]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (cfg.tamFila < 1 || cfg.tamFila > FILA_MAX || cfg.tamPilha < 1 || cfg.tamPilha > PILHA_MAX) {
+        fprintf(stderr, "ERRO: --fila deve estar entre 1 e %d e --pilha entre 1 e %d\n",
+                FILA_MAX, PILHA_MAX);
+        return 1;
+    }
+    if (numThreads < 1) numThreads = 1;
+    if (numThreads > MAX_THREADS_SERVIDOR) numThreads = MAX_THREADS_SERVIDOR;
+
+    int escuta = abrirEscuta(caminho);
+    int despertar = eventfd(0, 0);
+    if (escuta < 0 || despertar < 0) {
+        fprintf(stderr, "ERRO: nao foi possivel escutar em '%s'\n", caminho);
+        return 1;
+    }
+
+    // Os sinais de encerramento ficam so com o main (sigwait)
+    sigset_t sinais;
+    sigemptyset(&sinais);
+    sigaddset(&sinais, SIGINT);
+    sigaddset(&sinais, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &sinais, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    static ThreadServidor threads[MAX_THREADS_SERVIDOR];
+    int criadas = 0;
+    for (int i = 0; i < numThreads; i++) {
+        ThreadServidor* t = &threads[i];
+        memset(t, 0, sizeof(*t));
+        t->escuta = escuta;
+        t->despertar = despertar;
+        t->cfg = &cfg;
+        t->epoll = epoll_create1(0);
+        struct epoll_event evEscuta = {.events = EPOLLIN | EPOLLEXCLUSIVE, .data.ptr = &MARCA_ESCUTA};
+        struct epoll_event evDespertar = {.events = EPOLLIN, .data.ptr = &MARCA_DESPERTAR};
+        if (t->epoll < 0 || epoll_ctl(t->epoll, EPOLL_CTL_ADD, escuta, &evEscuta) != 0 ||
+            epoll_ctl(t->epoll, EPOLL_CTL_ADD, despertar, &evDespertar) != 0 ||
+            pthread_create(&t->thread, NULL, lacoServidor, t) != 0) {
+            if (t->epoll >= 0) close(t->epoll);
+            break;
+        }
+        criadas++;
+    }
+    if (criadas == 0) {
+        fprintf(stderr, "ERRO: nao foi possivel criar as threads\n");
+        return 1;
+    }
+    fprintf(stderr, ">>> Servidor em '%s' com %d threads (fila %d, pilha %d, gerador %s)\n",
+            caminho, criadas, cfg.tamFila, cfg.tamPilha, nomePolitica(cfg.politica));
+
+    int sinal;
+    sigwait(&sinais, &sinal);
+
+    // O eventfd fica legivel para sempre: acorda todas as threads
+    uint64_t um = 1;
+    if (write(despertar, &um, sizeof(um)) != sizeof(um)) perror("eventfd");
+    unsigned long conexoes = 0, pedidos = 0, escritas = 0;
+    for (int i = 0; i < criadas; i++) {
+        pthread_join(threads[i].thread, NULL);
+        close(threads[i].epoll);
+        conexoes += threads[i].conexoes;
+        pedidos += threads[i].pedidos;
+        escritas += threads[i].escritas;
+    }
+    close(escuta);
+    close(despertar);
+    unlink(caminho);
+
+    fprintf(stderr, ">>> Encerrado: %lu conexoes, %lu pedidos, %lu writes (%.1f pedidos/write)\n",
+            conexoes, pedidos, escritas, escritas ? (double)pedidos / escritas : 0.0);
+    int status = 0;
+    if (caminhoContadores != NULL && !gravarContadores(caminhoContadores, NULL)) {
+        fprintf(stderr, "ERRO: nao foi possivel gravar '%s'\n", caminhoContadores);
+        status = 1;
+    }
+    return status;
+}
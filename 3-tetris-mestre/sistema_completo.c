@@ -7,6 +7,26 @@
  * com operacoes de troca individual e multipla entre as estruturas.
  * Permite estrategias complexas de reorganizacao de pecas.
  * 
+ * Uso:
+ *   ./sistema_completo                    (menu interativo)
+ *   ./sistema_completo --lote [arquivo]   (modo lote, sem menu/pausas)
+ *   ./sistema_completo --lote arq --rastro (modo lote com rastro por op)
+ *   ./sistema_completo --lote arq --tabuleiro (pecas jogadas/usadas caem
+ *                  num tabuleiro 10x40; o resumo mostra o campo)
+ *   Opcoes comuns: --fila N (1-64 pecas)  --pilha M (1-16 pecas)
+ *                  --semente S (mesma semente = mesma sequencia de pecas)
+ *                  --gerador uniforme|saco7|saco14|tgm (padrao: saco7)
+ *                  --gravar arq (log binario de replay; ver reproducao.c)
+ *                  --carregar arq / --salvar arq (snapshot do estado
+ *                  completo no inicio / ao sair)
+ *   ./sistema_completo --tui [--medir]    (tela em tempo real, uma tecla
+ *                  por operacao; --medir mostra o tempo tecla->quadro)
+ *   --contadores arq (qualquer modo): ao sair grava os contadores de
+ *                  instrumentacao em JSON ('-' = stderr); so contam se
+ *                  compilado com -DINSTRUMENTAR
+ *   Servidor (socket Unix, varios clientes): ver servidor.c e
+ *                  cliente_carga.c
+ * 
  * Autora: Daniela Chiavenato Marzagao
  * Data: Novembro/2025
  * Disciplina: Analise e Desenvolvimento de Sistemas
@@ -14,47 +34,1015 @@
  */
 
 // ==================== BIBLIOTECAS ====================
+#include <errno.h>
+#include <math.h>
 #include <stdio.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
 #include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <termios.h>
 #include <time.h>
+#include <unistd.h>
 
 // ==================== CONSTANTES ====================
-#define TAM_FILA 5
-#define TAM_PILHA 3
+#define TAM_FILA 5          // Capacidade padrao da fila
+#define TAM_PILHA 3         // Capacidade padrao da pilha
+#define FILA_MAX 64         // Limites aceitos em --fila / --pilha
+#define PILHA_MAX 16
+#define TAM_BUFFER_LOTE 65536
+#define NUM_OPCOES 7            // 1-5 jogo, 6 desfazer, 7 refazer
+#define TAM_HISTORICO 64        // Operacoes que podem ser desfeitas
+#define NUM_TIPOS 7
+#define BITS_ID 29
+#define MASCARA_ID ((1u << BITS_ID) - 1)
+#define PECA_NENHUMA 0xFFFFFFFFu    // Tipo 7: nenhuma peca
+#define TAM_SACO_MAX (2 * NUM_TIPOS)
+#define TENTATIVAS_TGM 6
+#define TAM_LINHA_CACHE 64
+#define TAM_BLOCO_PADRAO 64     // Sessoes por tarefa do escalonador
+#define PROFUNDIDADE_BUSCA_MAX 32
+#define TIPO_DESCONHECIDO NUM_TIPOS     // Peca ainda nao gerada ('-')
+#define BITS_TABELA_PADRAO 16           // Tabela de transposicao: 2^16 entradas
+#define NOS_ENTRE_RELOGIO 256           // Nos visitados entre consultas ao relogio
+#define MAX_THREADS_BUSCA 64
+#define MC_HORIZONTE_PADRAO 20          // Pecas colocadas por continuacao
+#define MC_ENTRE_RELOGIO 16             // Pares de continuacoes entre consultas ao relogio
+#define MC_ORCAMENTO_INTERFACE 200000   // us gastos pela opcao 9
+#define MC_Z_95 1.959964                // Quantil da normal: intervalo de 95%
+#define TAM_SECAO_TELA 1024     // Fila de 64 pecas com ids de 9 digitos cabe
+#define TAM_QUADRO 4096         // Estado + menu + prompt
+
+// Tabuleiro: uma palavra de 16 bits por linha, coluna c no bit c + 3
+#define TAB_LARGURA 10
+#define TAB_ALTURA 40               // 20 visiveis + 20 de folga acima
+#define TAB_VISIVEL 20
+#define TAB_PAREDE 3                // Bits de parede a esquerda (e 3 a direita)
+#define TAB_CHAO 4                  // Linhas cheias abaixo da linha 0
+#define TAB_LINHAS (TAB_CHAO + TAB_ALTURA + 4)  // Chao + campo + folga acima
+#define TAB_X_MIN (-TAB_PAREDE)     // Caixa 4x4 da peca: x da coluna 0
+#define TAB_X_MAX (TAB_LARGURA - 1)
+#define TAB_X_SURGIR 3
+#define TAB_LINHA_VAZIA 0xE007u     // So as paredes
+#define TAB_LINHA_CHEIA 0xFFFFu
+#define NUM_ROTACOES 4               // SRS: 0 (entrada), R, 2, L
+#define NUM_CHUTES 5                // Testes de chute por rotacao
+#define TAB_MAX_ESTADOS (NUM_ROTACOES * 16 * TAB_LINHAS)   // (rotacao, x, y) distintos
+#define TAB_PISTAS_7FFF 0x7FFF7FFF7FFF7FFFULL   // Quatro linhas de 16 bits num uint64_t
+
+// Modo --tui: tela fixa de TUI_LINHAS x TUI_COLUNAS, uma celula por peca
+#define TUI_LINHAS 13
+#define TUI_COLUNAS 80
+#define TUI_LARGURA 64              // Largura das linhas separadoras
+#define TUI_INICIO_CELULAS 15
+#define TUI_CELULA 2
+#define TUI_POR_LINHA 32            // Fila de 64 pecas ocupa duas linhas
+#define TUI_FOLGA 4                 // Colunas iguais toleradas dentro de um trecho
+#define TUI_AMOSTRAS 4096           // Latencias guardadas para os percentis
+
+// Log de replay: cabecalho fixo + 1 byte por operacao (1-7)
+#define REPLAY_MAGICO "TTRP"
+#define REPLAY_VERSAO 2                 // 1: so opcoes 1-5; 2: + desfazer/refazer
+#define REPLAY_TAM_CABECALHO 32
+#define REPLAY_CHECKPOINT 0xFF          // Seguido de ops, estado e historico (u64)
+#define REPLAY_TAM_CHECKPOINT 25
+#define REPLAY_INTERVALO_PADRAO 4096    // Operacoes entre checkpoints
+#define SNAPSHOT_MAGICO 0x53535454u    // "TTSS"
+#define SNAPSHOT_VERSAO 1
+#define FNV_BASE 1469598103934665603ULL
+#define FNV_PRIMO 1099511628211ULL
+
+// Hash incremental da fila (polinomial) e da pilha (Zobrist)
+#define HASH_BASE 0x9E3779B97F4A7C15ULL         // Impar: tem inverso modulo 2^64
+#define HASH_BASE_INVERSA 0xF1DE83E19937733DULL // HASH_BASE * inversa = 1
+#define HASH_SAL_PILHA 0xD6E8FEB86659FD93ULL
+
+// Resultado de uma operacao do menu (usado pelo modo lote)
+typedef enum {
+    RES_OK = 0,
+    RES_FILA_VAZIA,
+    RES_PILHA_CHEIA,
+    RES_PILHA_VAZIA,
+    RES_TROCA_INSUFICIENTE,
+    RES_OPCAO_INVALIDA,
+    RES_NADA_A_DESFAZER,
+    RES_NADA_A_REFAZER,
+    NUM_RESULTADOS
+} Resultado;
+
+// Eventos contados nas primitivas com -DINSTRUMENTAR
+typedef enum {
+    EV_ENQUEUE = 0,
+    EV_ENQUEUE_FILA_CHEIA,      // enqueue ignorado (retorno antecipado)
+    EV_DEQUEUE,
+    EV_PUSH,
+    EV_PUSH_PILHA_CHEIA,
+    EV_POP,
+    EV_TROCA_SIMPLES,
+    EV_TROCA_K,
+    EV_TROCA_K_INSUFICIENTE,    // trocarK / trocarMultipla recusada
+    EV_PECA_GERADA,
+    NUM_EVENTOS
+} Evento;
 
 // ==================== ESTRUTURA DE DADOS ====================
 
-typedef struct {
-    char nome;
-    int id;
-} Peca;
+/*
+ * Peca:
+ * Compactada em 32 bits: tipo (indice em TIPOS_PECA) nos 3 bits de
+ * cima e id nos 29 de baixo. Ocupa 4 bytes em vez dos 8 de
+ * {char nome; int id;} com padding, e e copiada como um inteiro.
+ */
+typedef uint32_t Peca;
 
+/*
+ * Struct FilaCircular:
+ * 'frente' e 'tras' sao contadores que so crescem; a posicao no array
+ * e (contador & mascara) e o tamanho e (tras - frente). O array tem a
+ * capacidade arredondada para potencia de 2 (indice sem divisao), mas a
+ * fila nunca passa de 'capacidade' pecas visiveis.
+ * 'hash' e a soma de chave(peca_i) * HASH_BASE^i, i contado a partir
+ * da frente: entrar no fim soma um termo e sair da frente subtrai o
+ * primeiro e divide tudo por HASH_BASE (multiplica pela inversa), O(1).
+ */
 typedef struct {
-    Peca elementos[TAM_FILA];
-    int frente;
-    int tras;
-    int tamanho;
+    Peca* elementos;        // Aponta para a arena da sessao
+    unsigned int mascara;   // Tamanho fisico do array - 1
+    unsigned int frente;    // Contador da proxima peca a sair
+    unsigned int tras;      // Contador da proxima posicao livre
+    int capacidade;         // Limite logico de pecas
+    uint64_t hash;
+    uint64_t potencia;      // HASH_BASE^tamanho
 } FilaCircular;
 
+/*
+ * Struct FilaSpsc:
+ * Variante da FilaCircular para um produtor e um consumidor em threads
+ * diferentes, sem travas. So o produtor escreve 'tras' e so o
+ * consumidor escreve 'frente' (store release / load acquire). Cada
+ * lado fica na sua linha de cache junto com a copia que guarda do
+ * contador do outro, entao so le a linha alheia quando a copia indica
+ * fila cheia (produtor) ou vazia (consumidor).
+ */
+typedef struct {
+    // Somente leitura depois de inicializada
+    _Alignas(TAM_LINHA_CACHE) Peca* elementos;
+    unsigned int mascara;
+    unsigned int capacidade;
+    
+    // Lado do consumidor
+    _Alignas(TAM_LINHA_CACHE) _Atomic unsigned int frente;
+    unsigned int trasVisto;
+    
+    // Lado do produtor
+    _Alignas(TAM_LINHA_CACHE) _Atomic unsigned int tras;
+    unsigned int frenteVista;
+} FilaSpsc;
+
+/*
+ * Struct Pilha:
+ * 'hash' e o XOR de uma chave por (posicao, peca), no estilo Zobrist:
+ * push e pop aplicam o mesmo XOR e sobrescrever uma posicao troca a
+ * chave antiga pela nova.
+ */
 typedef struct {
-    Peca elementos[TAM_PILHA];
+    Peca* elementos;        // Aponta para a arena da sessao
     int topo;
+    int capacidade;
+    uint64_t hash;
 } Pilha;
 
-// ==================== VARIAVEIS GLOBAIS ====================
-int proximoId = 0;
+/*
+ * Struct GeradorAleatorio:
+ * PCG32 (O'Neill): 16 bytes de estado, aritmetica so em uint64_t, entao
+ * a mesma semente gera a mesma sequencia em qualquer plataforma.
+ */
+typedef struct {
+    uint64_t estado;
+    uint64_t incremento;    // Sempre impar; escolhe o fluxo
+} GeradorAleatorio;
+
+// Politicas de geracao de pecas (--gerador)
+typedef enum {
+    GERADOR_UNIFORME = 0,   // Cada peca sorteada de forma independente
+    GERADOR_SACO7,          // Permutacao embaralhada das 7 pecas
+    GERADOR_SACO14,         // Duas copias das 7 pecas, embaralhadas juntas
+    GERADOR_TGM,            // Historico de 4 com ate 6 novos sorteios
+    NUM_POLITICAS
+} PoliticaGeracao;
+
+/*
+ * Struct GeradorPecas:
+ * Gera as pecas de uma sessao. Cada politica produz um saco inteiro
+ * de uma vez; as pecas saem do saco na ordem ate ele esvaziar.
+ */
+typedef struct {
+    PoliticaGeracao politica;
+    GeradorAleatorio aleatorio;
+    unsigned char saco[TAM_SACO_MAX];   // Indices em TIPOS_PECA
+    int posSaco;
+    int tamSaco;
+    uint32_t historico;                 // TGM: 4 ultimos tipos, 1 byte cada
+    int primeira;                       // TGM: primeira peca do jogo
+    unsigned int proximoId;             // Id da proxima peca gerada
+} GeradorPecas;
+
+/*
+ * Struct Configuracao:
+ * Parametros escolhidos na inicializacao (--fila / --pilha / --semente
+ * / --gerador)
+ */
+typedef struct {
+    int tamFila;
+    int tamPilha;
+    uint64_t semente;
+    PoliticaGeracao politica;
+} Configuracao;
+
+/*
+ * Struct ContadoresSessao:
+ * Operacoes por codigo (0 = invalida) e resultado, e o tempo gasto em
+ * cada codigo. Fica dentro da Sessao, escrita so por quem a executa.
+ */
+typedef struct {
+    uint64_t operacoes[NUM_OPCOES + 1][NUM_RESULTADOS];
+    uint64_t nsOperacoes[NUM_OPCOES + 1];
+} ContadoresSessao;
+
+/*
+ * Struct Contadores:
+ * Total (de uma thread ou somado de todas): eventos das primitivas e
+ * as operacoes de todas as sessoes.
+ */
+typedef struct {
+    uint64_t eventos[NUM_EVENTOS];
+    ContadoresSessao operacoes;
+} Contadores;
+
+/*
+ * Struct BlocoContadores:
+ * Contadores de uma thread. So a dona escreve; quem soma le com loads
+ * relaxados, por isso os campos sao atomicos (sem trava nem lock no
+ * caminho quente). Os blocos vivos ficam numa lista global.
+ */
+typedef struct BlocoContadores {
+    _Atomic uint64_t eventos[NUM_EVENTOS];
+    _Atomic uint64_t operacoes[NUM_OPCOES + 1][NUM_RESULTADOS];
+    _Atomic uint64_t nsOperacoes[NUM_OPCOES + 1];
+    struct BlocoContadores* proximo;
+} BlocoContadores;
+
+/*
+ * Struct Sessao:
+ * Um jogo completo e independente: fila, pilha de reserva e gerador
+ * (com o contador de ids). Nao depende de nenhum estado global.
+ * Com -DINSTRUMENTAR leva tambem os contadores das suas operacoes.
+ */
+typedef struct {
+    FilaCircular fila;
+    Pilha pilha;
+    GeradorPecas gerador;
+    Peca* arena;            // Armazenamento da fila + pilha
+#ifdef INSTRUMENTAR
+    ContadoresSessao contadores;
+#endif
+} Sessao;
+
+/*
+ * Struct SnapshotSessao:
+ * Estado completo de uma sessao num bloco de tamanho fixo: contadores
+ * da fila, topo da pilha, gerador (RNG, saco, historico, proximoId) e
+ * as pecas da arena no mesmo layout da sessao (fila circular e depois
+ * pilha), entao restaurar e copiar os campos e um unico memcpy das
+ * pecas, sem reordenar nada. Gravado em arquivo como esta (layout e
+ * endianness da maquina); 'versao' muda se o layout mudar.
+ */
+typedef struct {
+    uint32_t magico;
+    uint16_t versao;
+    uint8_t tamFila;
+    uint8_t tamPilha;
+    uint32_t frente;
+    uint32_t tras;
+    int32_t topo;
+    GeradorPecas gerador;
+    Peca pecas[FILA_MAX + PILHA_MAX];   // So tamanhoArena() sao usadas
+} SnapshotSessao;
+
+/*
+ * Struct ArmazemCheckpoints:
+ * Pool de snapshots imutaveis com contagem de referencias. Compartilhar
+ * um checkpoint so incrementa a contagem: varios donos usam o mesmo
+ * bloco e a copia so acontece quando um deles e restaurado numa Sessao.
+ * Slots livres ficam numa pilha de indices, como no Motor, entao nada e
+ * alocado por checkpoint. O jogo nao usa o pool (desfazer guarda deltas
+ * no Historico e a busca copia EstadoBusca); hoje so o benchmark o mede.
+ */
+typedef struct {
+    SnapshotSessao* snapshots;
+    uint32_t* referencias;
+    int* livres;
+    int numLivres;
+    int capacidade;
+} ArmazemCheckpoints;
+
+/*
+ * Struct GravadorReplay:
+ * Log binario so de acrescimo de uma sessao. Cabecalho de
+ * REPLAY_TAM_CABECALHO bytes (little-endian):
+ *   0  "TTRP"        4  versao (u16)   6  tamFila (u8)   7  tamPilha (u8)
+ *   8  politica (u8) 12 intervalo (u32) 16 semente (u64)  24 reservado
+ * Depois, um byte por operacao (1-7) e, a cada 'intervalo' operacoes,
+ * um checkpoint: REPLAY_CHECKPOINT, total de operacoes (u64),
+ * resumoSessao (u64) do estado e o resumo de todos os codigos gravados
+ * ate ali (u64), que acusa operacoes trocadas mesmo quando o estado
+ * final coincide.
+ */
+typedef struct {
+    FILE* arquivo;
+    uint32_t intervalo;
+    uint32_t desdeCheckpoint;
+    uint64_t numOps;
+    uint64_t resumoOps;     // FNV-1a dos codigos ja gravados
+} GravadorReplay;
+
+/*
+ * Struct DeltaOperacao:
+ * O minimo para desfazer uma operacao aceita. As trocas sao desfeitas
+ * com os proprios dados da fila/pilha; jogar/usar guardam a peca que
+ * saiu do jogo; jogar/reservar geram uma peca, e se essa geracao abriu
+ * um saco novo guardam o estado do gerador de antes do saco.
+ */
+typedef struct {
+    uint8_t opcao;
+    uint8_t novoSaco;               // A peca gerada abriu um saco novo
+    uint8_t tamSacoAnterior;
+    uint8_t primeiraAnterior;
+    Peca descartada;                // Opcoes 1 e 3
+    uint32_t historicoAnterior;     // Historico TGM antes do saco novo
+    uint64_t aleatorioAnterior;     // Estado do PCG antes do saco novo
+} DeltaOperacao;
+
+/*
+ * Struct Historico:
+ * Anel de TAM_HISTORICO deltas com contadores que so crescem, como a
+ * fila: [inicio, atual) pode ser desfeito e [atual, fim) refeito.
+ * Quando o anel enche, a operacao mais antiga deixa de ser desfazivel.
+ * Memoria fixa por sessao (TAM_HISTORICO * 24 bytes).
+ */
+typedef struct {
+    DeltaOperacao entradas[TAM_HISTORICO];
+    unsigned int inicio;
+    unsigned int atual;
+    unsigned int fim;
+} Historico;
+
+/*
+ * Struct Tabuleiro:
+ * Campo de 10 x 40 com uma palavra de 16 bits por linha (linha 0 no
+ * fundo): coluna c no bit c + TAB_PAREDE e os 6 bits que sobram sempre
+ * ligados, como paredes. Abaixo da linha 0 ficam TAB_CHAO linhas cheias
+ * (o chao) e acima do campo 4 linhas so com paredes, entao uma peca na
+ * caixa 4x4 le as suas 4 linhas num uint64_t e colidir, fixar e achar
+ * linhas cheias sao operacoes de bits, sem testar limites.
+ * 'altura' e o numero de linhas a partir do fundo com algum bloco.
+ */
+typedef struct {
+    uint16_t linhas[TAB_LINHAS];
+    int altura;
+    unsigned long pecas;
+    unsigned long linhasLimpas;
+    unsigned long derrotas;     // Campo zerado por falta de espaco
+} Tabuleiro;
+
+/*
+ * Struct PosicaoPeca:
+ * Peca solta no tabuleiro: canto inferior esquerdo da caixa 4x4 e a
+ * rotacao (indice em FORMAS_TABULEIRO)
+ */
+typedef struct {
+    int x;
+    int y;
+    int rotacao;
+} PosicaoPeca;
+
+// Deslocamento de um teste de chute do SRS (x para a direita, y para cima)
+typedef struct {
+    int8_t x;
+    int8_t y;
+} ChuteSrs;
+
+/*
+ * Struct HistoricoTabuleiro:
+ * Para desfazer/refazer com tabuleiro: uma copia do campo por posicao
+ * do Historico ('atual' & mascara). O anel tem o dobro de posicoes do
+ * Historico, entao as TAM_HISTORICO + 1 posicoes que ele alcanca nunca
+ * se sobrepoem. Desfazer uma limpeza de linhas e so copiar de volta.
+ */
+typedef struct {
+    Tabuleiro estados[2 * TAM_HISTORICO];
+} HistoricoTabuleiro;
+
+/*
+ * Struct Alimentador:
+ * Thread produtora que mantem uma FilaSpsc cheia com as pecas do
+ * gerador, enquanto o consumidor retira em outra thread.
+ */
+typedef struct {
+    FilaSpsc* fila;
+    GeradorPecas* gerador;
+    pthread_t thread;
+    atomic_int parar;
+} Alimentador;
+
+/*
+ * Struct Motor:
+ * Pool de sessoes alocado de uma vez (slab). Sessoes livres ficam numa
+ * pilha de indices e as ativas num array denso, entao criar, destruir
+ * e percorrer as ativas nao alocam memoria e criar/destruir sao O(1).
+ */
+typedef struct {
+    Configuracao cfg;
+    int capacidade;         // Maximo de sessoes simultaneas
+    size_t pecasPorSessao;  // Tamanho da arena de cada sessao
+    Sessao* sessoes;        // Slab de sessoes (indice = identificador)
+    Peca* armazenamento;    // Slab das arenas de todas as sessoes
+    int* livres;            // Pilha de indices livres
+    int numLivres;
+    int* ativas;            // Indices ativos, contiguos
+    int* posicaoAtiva;      // Indice -> posicao em 'ativas' (-1 = livre)
+    int numAtivas;
+} Motor;
+
+/*
+ * Struct MotorSoA:
+ * As mesmas sessoes em layout "struct of arrays": cada campo de todas
+ * as sessoes fica num array proprio (frentes, tras, topos, geradores) e
+ * as pecas de todas as filas/pilhas ficam em dois buffers contiguos.
+ * As operacoes em lote percorrem esses arrays em sequencia, o que
+ * permite ao compilador vetorizar. Usa sempre o sorteio uniforme.
+ */
+typedef struct {
+    int numSessoes;
+    int tamFila;
+    int tamPilha;
+    unsigned int fisicoFila;    // Posicoes por fila (potencia de 2)
+    unsigned int mascara;
+    uint32_t* frente;
+    uint32_t* tras;
+    int32_t* topo;              // -1 = pilha vazia
+    uint64_t* estadoAleatorio;  // PCG32 de cada sessao
+    uint64_t* incremento;
+    uint32_t* proximoId;
+    Peca* pecasFila;            // numSessoes * fisicoFila
+    Peca* pecasPilha;           // numSessoes * (tamPilha + 1); a ultima e descarte
+    Peca* novas;                // Pecas geradas no lote atual (uma por sessao)
+    uint32_t* ok;               // 1 onde a operacao do lote foi aceita
+} MotorSoA;
+
+/*
+ * Struct FilaTrabalho:
+ * Deque de tarefas de um trabalhador do escalonador. As tarefas de uma
+ * rodada sao os numeros 0..numTarefas-1, entao a deque e so o intervalo
+ * [inicio, fim): o dono consome pelo inicio e quem rouba tira do fim.
+ * Alinhada a uma linha de cache para que a trava e os contadores de um
+ * trabalhador nao disputem a linha com os do vizinho.
+ */
+struct Escalonador;
+typedef struct {
+    _Alignas(TAM_LINHA_CACHE) pthread_mutex_t trava;
+    int inicio;
+    int fim;
+    unsigned long ok;           // Operacoes RES_OK na rodada
+    unsigned long roubos;       // Tarefas roubadas de outros
+    uint32_t sorteio;           // Estado xorshift para escolher vitimas
+    struct Escalonador* dono;
+} FilaTrabalho;
+
+/*
+ * Struct Escalonador:
+ * Divide as sessoes ativas de um Motor em tarefas (blocos contiguos de
+ * tamBloco sessoes) e executa um roteiro de operacoes com um
+ * trabalhador por nucleo. Cada sessao pertence a uma unica tarefa por
+ * rodada e a tarefa aplica os passos do roteiro em ordem, entao as
+ * operacoes de uma sessao nunca se reordenam nem correm em paralelo.
+ * O trabalhador 0 e a propria thread que chama escalonadorExecutar.
+ */
+typedef struct Escalonador {
+    Motor* motor;
+    int numTrabalhadores;
+    int tamBloco;
+    FilaTrabalho* filas;        // Uma por trabalhador
+    pthread_t* threads;         // numTrabalhadores - 1
+    int numThreads;             // Threads efetivamente criadas
+    
+    // Rodada atual (escritos antes de acordar os trabalhadores)
+    const unsigned char* roteiro;
+    int numPassos;
+    int numTarefas;
+    
+    pthread_mutex_t trava;
+    pthread_cond_t inicioRodada;
+    pthread_cond_t fimRodada;
+    unsigned int geracao;       // Incrementada a cada rodada
+    int restantes;              // Trabalhadores ainda na rodada
+    int encerrar;
+} Escalonador;
+
+/*
+ * Struct EstadoBusca:
+ * So o que o jogador enxerga: os tipos da fila (da frente para tras) e
+ * da pilha (da base ao topo). Pecas que ainda vao ser geradas entram
+ * como TIPO_DESCONHECIDO, entao a busca nao usa o futuro do gerador.
+ */
+typedef struct {
+    uint8_t fila[FILA_MAX];
+    uint8_t pilha[PILHA_MAX];
+    uint8_t tamFila;
+    uint8_t capFila;
+    uint8_t tamPilha;
+    uint8_t capPilha;
+} EstadoBusca;
+
+// Nota de um estado (maior = melhor); 'contexto' e repassado sem uso
+typedef int32_t (*FuncaoPontuacao)(const EstadoBusca* estado, const void* contexto);
+
+/*
+ * Struct ParametrosBusca:
+ * A busca para ao achar um estado com nota >= 'suficiente' (a sequencia
+ * mais curta que chega la), ao completar 'profundidadeMax' ou quando o
+ * orcamento de tempo acaba. Com suficiente = INT32_MAX procura a maior
+ * nota alcancavel, desempatando pela sequencia mais curta.
+ */
+typedef struct {
+    FuncaoPontuacao pontuar;
+    const void* contexto;
+    int32_t suficiente;
+    int profundidadeMax;        // 1 a PROFUNDIDADE_BUSCA_MAX
+    long orcamentoUs;           // Microssegundos (<= 0 = sem limite)
+    int numThreads;             // 1 a MAX_THREADS_BUSCA
+} ParametrosBusca;
+
+typedef struct {
+    uint8_t jogadas[PROFUNDIDADE_BUSCA_MAX];   // Opcoes 1-5 em ordem
+    int numJogadas;
+    int32_t pontuacao;          // Nota do estado ao fim da sequencia
+    int profundidade;           // Ultima iteracao completa
+    int atingiu;                // pontuacao >= suficiente
+    unsigned long nos;
+    long tempoUs;
+} ResultadoBusca;
+
+/*
+ * Struct TabelaTransposicao:
+ * 2^bits entradas de dois u64 (chave ^ dados, dados) gravadas sem trava:
+ * uma entrada rasgada por duas threads nao confere com a chave e e
+ * ignorada. Cada busca mistura um sal novo na chave, entao a tabela
+ * pode ser reaproveitada sem limpar.
+ */
+typedef struct {
+    _Atomic uint64_t verificacao;
+    _Atomic uint64_t dados;
+} EntradaTransposicao;
+
+typedef struct {
+    EntradaTransposicao* entradas;
+    uint64_t mascara;
+    uint64_t buscas;            // Contador que gera o sal de cada busca
+} TabelaTransposicao;
+
+// Nota alcancada e jogadas gastas; mais nota e melhor, depois menos jogadas
+typedef struct {
+    int32_t pontuacao;
+    int jogadas;
+} ValorBusca;
+
+/*
+ * Struct BuscaCompartilhada:
+ * Estado de uma chamada de buscarSequencia visto por todas as threads.
+ * Cada iteracao divide a raiz em 25 tarefas, os pares (1a jogada,
+ * 2a jogada), retiradas de um contador atomico; a thread que chamou
+ * junta os valores entre duas barreiras e decide se aprofunda.
+ */
+typedef struct {
+    const ParametrosBusca* parametros;
+    EntradaTransposicao* tabela;
+    uint64_t mascara;
+    uint64_t sal;
+    long limiteUs;              // 0 = sem limite
+    atomic_int esgotado;        // Tempo acabou: valores deixam de valer
+    
+    pthread_mutex_t largada;    // Segura as threads ate a barreira existir
+    pthread_barrier_t barreira;
+    
+    // Iteracao atual (escritos pela thread 0 entre as barreiras)
+    int profundidade;
+    int parar;
+    atomic_int proximaTarefa;
+    EstadoBusca filhos[5];
+    int filhoValido[5];
+    ValorBusca valorNeto[25];
+    int netoValido[25];
+} BuscaCompartilhada;
+
+typedef struct {
+    BuscaCompartilhada* busca;
+    int comRelogio;             // 0 ao reconstruir a sequencia
+    unsigned long nos;
+    pthread_t thread;
+} TrabalhadorBusca;
+
+/*
+ * Struct ParametrosAvaliacao:
+ * A avaliacao para quando o orcamento de tempo acaba ou quando cada
+ * thread completa a sua parte de 'maxAmostras' (o que vier antes; um
+ * dos dois precisa estar ligado). Com maxAmostras e sem tempo, a mesma
+ * semente e o mesmo numThreads dao sempre o mesmo resultado.
+ */
+typedef struct {
+    long orcamentoUs;           // Microssegundos (<= 0 = sem limite)
+    unsigned long maxAmostras;  // Pares de continuacoes (0 = sem limite)
+    int horizonte;              // Pecas colocadas por continuacao
+    int numThreads;             // 1 a MAX_THREADS_BUSCA
+    uint64_t semente;
+} ParametrosAvaliacao;
+
+// Media de uma nota e a meia largura do intervalo de confianca de 95%
+typedef struct {
+    double media;
+    double margem;
+} Estimativa;
+
+typedef struct {
+    Estimativa jogar;
+    Estimativa reservar;
+    Estimativa diferenca;       // reservar - jogar, nas mesmas pecas futuras
+    unsigned long amostras;     // Pares de continuacoes
+    int podeReservar;           // 0 com a pilha cheia: so 'jogar' e avaliado
+    int escolha;                // 1, 2, ou 0 se o intervalo da diferenca tem o 0
+    long tempoUs;
+} ResultadoAvaliacao;
+
+/*
+ * Struct TrabalhadorAvaliacao:
+ * Uma thread da avaliacao: o que ela le (compartilhado, so leitura) e
+ * as somas que ela acumula sozinha, juntadas depois do join. Cada uma
+ * sorteia do seu proprio fluxo do PCG32.
+ */
+typedef struct {
+    const EstadoBusca* raiz;
+    const Tabuleiro* tabuleiro;
+    const GeradorPecas* gerador;
+    const ParametrosAvaliacao* parametros;
+    int podeReservar;
+    long limiteUs;              // 0 = sem limite
+    unsigned long cota;         // Pares desta thread (0 = sem limite)
+    GeradorAleatorio aleatorio; // Sementes dos pares
+    uint64_t fluxo;             // Fluxo do PCG32 desta thread
+    unsigned long amostras;
+    double soma[3];             // jogar, reservar, diferenca
+    double somaQuadrados[3];
+    pthread_t thread;
+} TrabalhadorAvaliacao;
+
+/*
+ * Struct SecaoTela:
+ * Texto ja formatado de uma parte da tela e o que ele mostra. Se a
+ * fila/pilha nao mudou (mesmo hash, tamanho e capacidade) o texto e
+ * reusado sem formatar de novo.
+ */
+typedef struct {
+    char texto[TAM_SECAO_TELA];
+    int bytes;
+    uint64_t hash;
+    int tamanho;
+    int capacidade;
+    int valida;
+} SecaoTela;
+
+/*
+ * Struct Renderizador:
+ * Monta o quadro inteiro (estado, menu e prompt) num buffer fixo e o
+ * envia com um unico write(), em vez de uma chamada ao stdio por peca
+ * e por linha. Nenhuma alocacao por quadro.
+ */
+typedef struct {
+    SecaoTela fila;
+    SecaoTela pilha;
+    SecaoTela menu;
+    char quadro[TAM_QUADRO];
+    int tamanho;                // Bytes pendentes em 'quadro'
+    int descritor;
+    unsigned long quadros;
+    unsigned long envios;       // Chamadas a write()
+    unsigned long bytes;
+    unsigned long secoesRefeitas;
+} Renderizador;
+
+/*
+ * Struct TelaTui:
+ * Modelo da tela do modo --tui. 'atual' e montado a cada tecla e
+ * comparado com 'anterior' (o que o terminal mostra); so as celulas
+ * diferentes sao enviadas, com o cursor posicionado.
+ */
+typedef struct {
+    char atual[TUI_LINHAS][TUI_COLUNAS];
+    char anterior[TUI_LINHAS][TUI_COLUNAS];
+    int redesenhar;             // Limpa o terminal e envia tudo
+    char mensagem[TUI_COLUNAS + 1];
+    char busca[TUI_COLUNAS + 1];
+    Renderizador saida;
+    int medir;
+    unsigned long quadros;
+    long ultimoNs;              // Tecla -> quadro enviado
+    long maximoNs;
+    unsigned long ultimosBytes;
+} TelaTui;
+
+// ==================== CONSTANTES GLOBAIS ====================
+static const char TIPOS_PECA[NUM_TIPOS + 1] = {'I', 'O', 'T', 'L', 'J', 'S', 'Z', '-'};
+static const char* NOMES_RESULTADO[NUM_RESULTADOS] = {
+    "OK", "FILA_VAZIA", "PILHA_CHEIA", "PILHA_VAZIA",
+    "TROCA_INSUFICIENTE", "OPCAO_INVALIDA", "NADA_A_DESFAZER", "NADA_A_REFAZER"
+};
+static const char* NOMES_JOGADA[6] = {"", "jogar", "reservar", "usar reserva",
+                                      "troca simples", "troca multipla"};
+
+// Forma de cada tipo nas 4 rotacoes do SRS (0 = entrada, R, 2, L), na
+// caixa 4x4: a linha r da caixa (0 = de baixo) nos 4 bits de 16r, coluna
+// c da caixa no bit c. J/L/S/T/Z giram numa caixa 3x3 (linhas 0-2,
+// colunas 0-2), o I na 4x4 e o O nao muda. Girar e so trocar o indice.
+#define FORMA(l0, l1, l2, l3) \
+    ((uint64_t)(l0) | (uint64_t)(l1) << 16 | (uint64_t)(l2) << 32 | (uint64_t)(l3) << 48)
+static const uint64_t FORMAS_TABULEIRO[NUM_TIPOS][NUM_ROTACOES] = {
+    {FORMA(0x0, 0x0, 0xF, 0x0), FORMA(0x4, 0x4, 0x4, 0x4),      // I
+     FORMA(0x0, 0xF, 0x0, 0x0), FORMA(0x2, 0x2, 0x2, 0x2)},
+    {FORMA(0x0, 0x6, 0x6, 0x0), FORMA(0x0, 0x6, 0x6, 0x0),      // O
+     FORMA(0x0, 0x6, 0x6, 0x0), FORMA(0x0, 0x6, 0x6, 0x0)},
+    {FORMA(0x0, 0x7, 0x2, 0x0), FORMA(0x2, 0x6, 0x2, 0x0),      // T
+     FORMA(0x2, 0x7, 0x0, 0x0), FORMA(0x2, 0x3, 0x2, 0x0)},
+    {FORMA(0x0, 0x7, 0x4, 0x0), FORMA(0x6, 0x2, 0x2, 0x0),      // L
+     FORMA(0x1, 0x7, 0x0, 0x0), FORMA(0x2, 0x2, 0x3, 0x0)},
+    {FORMA(0x0, 0x7, 0x1, 0x0), FORMA(0x2, 0x2, 0x6, 0x0),      // J
+     FORMA(0x4, 0x7, 0x0, 0x0), FORMA(0x3, 0x2, 0x2, 0x0)},
+    {FORMA(0x0, 0x3, 0x6, 0x0), FORMA(0x4, 0x6, 0x2, 0x0),      // S
+     FORMA(0x3, 0x6, 0x0, 0x0), FORMA(0x2, 0x3, 0x1, 0x0)},
+    {FORMA(0x0, 0x6, 0x3, 0x0), FORMA(0x2, 0x6, 0x4, 0x0),      // Z
+     FORMA(0x6, 0x3, 0x0, 0x0), FORMA(0x1, 0x3, 0x2, 0x0)},
+};
+
+// Chutes do SRS, tentados em ordem:
+// [0 = J/L/S/T/Z, 1 = I][rotacao de origem][0 = horario, 1 = anti][teste].
+// O O usa a primeira tabela: como a forma nao muda, o teste (0, 0) ja cabe.
+// Rotacoes com as mesmas celulas: a rotacao 'r' em (x, y) ocupa o mesmo
+// que ROTACAO_CANONICA[r] em (x + dx, y + dy). O: tudo e a 0; I, S e Z:
+// 2 e a 0 uma linha acima, L e a R uma coluna a direita.
+static const int8_t ROTACAO_CANONICA[NUM_TIPOS][NUM_ROTACOES] = {
+    {0, 1, 0, 1}, {0, 0, 0, 0}, {0, 1, 2, 3}, {0, 1, 2, 3},
+    {0, 1, 2, 3}, {0, 1, 0, 1}, {0, 1, 0, 1},
+};
+static const ChuteSrs DESLOCAMENTO_CANONICO[NUM_TIPOS][NUM_ROTACOES] = {
+    {{0, 0}, {0, 0}, {0, -1}, {-1, 0}},     // I
+    {{0, 0}, {0, 0}, {0, 0}, {0, 0}},       // O
+    {{0, 0}, {0, 0}, {0, 0}, {0, 0}},       // T
+    {{0, 0}, {0, 0}, {0, 0}, {0, 0}},       // L
+    {{0, 0}, {0, 0}, {0, 0}, {0, 0}},       // J
+    {{0, 0}, {0, 0}, {0, -1}, {-1, 0}},     // S
+    {{0, 0}, {0, 0}, {0, -1}, {-1, 0}},     // Z
+};
+
+static const ChuteSrs CHUTES_SRS[2][NUM_ROTACOES][2][NUM_CHUTES] = {
+    {   // J, L, S, T, Z
+        {{{0, 0}, {-1, 0}, {-1, 1}, {0, -2}, {-1, -2}},     // 0 -> R
+         {{0, 0}, {1, 0}, {1, 1}, {0, -2}, {1, -2}}},       // 0 -> L
+        {{{0, 0}, {1, 0}, {1, -1}, {0, 2}, {1, 2}},         // R -> 2
+         {{0, 0}, {1, 0}, {1, -1}, {0, 2}, {1, 2}}},        // R -> 0
+        {{{0, 0}, {1, 0}, {1, 1}, {0, -2}, {1, -2}},        // 2 -> L
+         {{0, 0}, {-1, 0}, {-1, 1}, {0, -2}, {-1, -2}}},    // 2 -> R
+        {{{0, 0}, {-1, 0}, {-1, -1}, {0, 2}, {-1, 2}},      // L -> 0
+         {{0, 0}, {-1, 0}, {-1, -1}, {0, 2}, {-1, 2}}},     // L -> 2
+    },
+    {   // I
+        {{{0, 0}, {-2, 0}, {1, 0}, {-2, -1}, {1, 2}},       // 0 -> R
+         {{0, 0}, {-1, 0}, {2, 0}, {-1, 2}, {2, -1}}},      // 0 -> L
+        {{{0, 0}, {-1, 0}, {2, 0}, {-1, 2}, {2, -1}},       // R -> 2
+         {{0, 0}, {2, 0}, {-1, 0}, {2, 1}, {-1, -2}}},      // R -> 0
+        {{{0, 0}, {2, 0}, {-1, 0}, {2, 1}, {-1, -2}},       // 2 -> L
+         {{0, 0}, {1, 0}, {-2, 0}, {1, -2}, {-2, 1}}},      // 2 -> R
+        {{{0, 0}, {1, 0}, {-2, 0}, {1, -2}, {-2, 1}},       // L -> 0
+         {{0, 0}, {-2, 0}, {1, 0}, {-2, -1}, {1, 2}}},      // L -> 2
+    },
+};
+
+// ==================== PECA COMPACTADA ====================
+
+static inline Peca criarPeca(unsigned int tipo, unsigned int id) {
+    return ((Peca)tipo << BITS_ID) | (id & MASCARA_ID);
+}
+
+static inline unsigned int tipoPeca(Peca p) {
+    return p >> BITS_ID;
+}
+
+static inline char nomePeca(Peca p) {
+    return TIPOS_PECA[p >> BITS_ID];
+}
+
+static inline int idPeca(Peca p) {
+    return (int)(p & MASCARA_ID);
+}
+
+// ==================== CHAVES DE HASH ====================
+
+// Finalizador do splitmix64: espalha cada bit da entrada pelos 64
+static inline uint64_t misturar64(uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xBF58476D1CE4E5B9ULL;
+    x ^= x >> 27;
+    x *= 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+}
+
+// Chave de uma peca na fila (a posicao entra pela potencia de HASH_BASE)
+static inline uint64_t chaveFila(Peca p) {
+    return misturar64(p);
+}
+
+// Chave Zobrist de (posicao, peca) na pilha. Com ids de 29 bits uma
+// tabela por peca nao cabe, entao a chave e calculada em vez de lida.
+static inline uint64_t chavePilha(Peca p, int posicao) {
+    return misturar64(((uint64_t)(uint32_t)posicao << 32 | p) ^ HASH_SAL_PILHA);
+}
+
+// Com -DVERIFICAR_HASH toda operacao recalcula o hash do zero e aborta
+// se o incremental divergir
+#ifdef VERIFICAR_HASH
+#define CONFERIR_HASH_FILA(fila) conferirHashFila((fila), __func__)
+#define CONFERIR_HASH_PILHA(pilha) conferirHashPilha((pilha), __func__)
+#else
+#define CONFERIR_HASH_FILA(fila) ((void)0)
+#define CONFERIR_HASH_PILHA(pilha) ((void)0)
+#endif
+
+// ==================== INSTRUMENTACAO ====================
+// Com -DINSTRUMENTAR cada thread conta no seu proprio BlocoContadores
+// (criado no primeiro evento) e os blocos so sao somados quando alguem
+// pede o total. Sem a flag as macros viram ((void)0): custo zero.
+#ifdef INSTRUMENTAR
+BlocoContadores* registrarBlocoContadores(void);
+void registrarOperacao(Sessao* s, int opcao, Resultado r, uint64_t ns);
+
+static _Thread_local BlocoContadores* blocoLocal;
+
+// So a dona escreve: load + store relaxados (um add comum no x86)
+static inline void somarRelaxado(_Atomic uint64_t* c, uint64_t n) {
+    atomic_store_explicit(c, atomic_load_explicit(c, memory_order_relaxed) + n,
+                          memory_order_relaxed);
+}
+
+static inline BlocoContadores* blocoContadores(void) {
+    BlocoContadores* b = blocoLocal;
+    return b != NULL ? b : registrarBlocoContadores();
+}
+
+static inline uint64_t agoraNanossegundos(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (uint64_t)t.tv_sec * 1000000000ULL + (uint64_t)t.tv_nsec;
+}
+
+#define CONTAR(evento) somarRelaxado(&blocoContadores()->eventos[(evento)], 1)
+#define INICIAR_MEDICAO(t) uint64_t t = agoraNanossegundos()
+#define REGISTRAR_OPERACAO(s, opcao, r, t) \
+    registrarOperacao((s), (opcao), (r), agoraNanossegundos() - (t))
+#else
+#define CONTAR(evento) ((void)0)
+#define INICIAR_MEDICAO(t) ((void)0)
+#define REGISTRAR_OPERACAO(s, opcao, r, t) ((void)0)
+#endif
 
 // ==================== PROTOTIPOS ====================
+// Gerador aleatorio
+void semearGerador(GeradorAleatorio* g, uint64_t semente, uint64_t fluxo);
+uint32_t proximoAleatorio(GeradorAleatorio* g);
+uint32_t aleatorioLimitado(GeradorAleatorio* g, uint32_t limite);
+
+// Politicas de geracao
+void iniciarGeradorPecas(GeradorPecas* g, PoliticaGeracao politica, uint64_t semente);
+int encherSacoUniforme(GeradorPecas* g);
+int encherSaco7(GeradorPecas* g);
+int encherSaco14(GeradorPecas* g);
+int encherSacoTgm(GeradorPecas* g);
+int politicaPorNome(const char* nome);
+const char* nomePolitica(PoliticaGeracao politica);
+
+// Arena (memoria unica da fila + pilha)
+unsigned int potenciaDe2(unsigned int n);
+size_t tamanhoArena(const Configuracao* cfg);
+void ligarArena(FilaCircular* fila, Pilha* pilha, const Configuracao* cfg, Peca* arena);
+
+// Sessao
+void iniciarSessao(Sessao* s, const Configuracao* cfg, Peca* arena, uint64_t semente);
+int criarSessao(Sessao* s, const Configuracao* cfg, uint64_t semente);
+void destruirSessao(Sessao* s);
+uint64_t resumoSessao(const Sessao* s);
+
+// Snapshot e checkpoints
+void salvarSnapshot(const Sessao* s, SnapshotSessao* snap);
+int restaurarSnapshot(Sessao* s, const SnapshotSessao* snap);
+int gravarSnapshot(const SnapshotSessao* snap, const char* caminho);
+int lerSnapshot(SnapshotSessao* snap, const char* caminho);
+int criarArmazem(ArmazemCheckpoints* a, int capacidade);
+void destruirArmazem(ArmazemCheckpoints* a);
+int checkpointSalvar(ArmazemCheckpoints* a, const Sessao* s);
+int checkpointCompartilhar(ArmazemCheckpoints* a, int id);
+void checkpointLiberar(ArmazemCheckpoints* a, int id);
+int checkpointRestaurar(const ArmazemCheckpoints* a, int id, Sessao* s);
+
+// Motor (varias sessoes)
+int criarMotor(Motor* m, const Configuracao* cfg, int capacidade);
+void destruirMotor(Motor* m);
+int motorCriarSessao(Motor* m, uint64_t semente);
+void motorDestruirSessao(Motor* m, int id);
+Sessao* motorSessao(Motor* m, int id);
+unsigned long motorPasso(Motor* m, const unsigned char* opcoes);
+
+// Motor SoA (lotes de sessoes)
+int criarMotorSoA(MotorSoA* m, const Configuracao* cfg, int numSessoes, uint64_t sementeBase);
+void destruirMotorSoA(MotorSoA* m);
+void soaJogarTodas(MotorSoA* m, Peca* jogadas);
+unsigned long soaReservarTodas(MotorSoA* m);
+unsigned long soaUsarTodas(MotorSoA* m, Peca* usadas);
+
+// Escalonador (varias threads)
+int criarEscalonador(Escalonador* e, Motor* motor, int numTrabalhadores, int tamBloco);
+void destruirEscalonador(Escalonador* e);
+unsigned long escalonadorExecutar(Escalonador* e, const unsigned char* roteiro, int numPassos);
+
+// Tabuleiro
+void iniciarTabuleiro(Tabuleiro* t);
+void limparCampo(Tabuleiro* t);
+int colideTabuleiro(const Tabuleiro* t, uint64_t forma, int x, int y);
+int fixarPeca(Tabuleiro* t, uint64_t forma, int x, int y);
+int soltarPeca(Tabuleiro* t, uint64_t forma, int x);
+int colocarPeca(Tabuleiro* t, Peca p);
+int girarPeca(const Tabuleiro* t, int tipo, PosicaoPeca* pos, int antiHorario);
+int enumerarColocacoes(const Tabuleiro* t, int tipo, PosicaoPeca* saida);
+int enumerarJogadas(const Sessao* s, const Tabuleiro* t, int comReserva,
+                    PosicaoPeca* saida, int* numFrente);
+void iniciarHistoricoTabuleiro(HistoricoTabuleiro* ht, const Historico* h, const Tabuleiro* t);
+Resultado executarComTabuleiro(Sessao* s, Historico* h, Tabuleiro* t, HistoricoTabuleiro* ht,
+                               int opcao, Peca* peca);
+void exibirTabuleiro(const Tabuleiro* t);
+
+// Busca de sequencias (aprofundamento iterativo)
+void estadoBuscaDaSessao(const Sessao* s, EstadoBusca* e);
+int aplicarJogadaBusca(EstadoBusca* e, int opcao);
+uint64_t hashEstadoBusca(const EstadoBusca* e);
+int32_t pontuarPecaNaFrente(const EstadoBusca* e, const void* tipoAlvo);
+int32_t pontuarProximidade(const EstadoBusca* e, const void* tipoAlvo);
+int criarTabelaTransposicao(TabelaTransposicao* t, int bits);
+void destruirTabelaTransposicao(TabelaTransposicao* t);
+int buscarSequencia(const EstadoBusca* raiz, const ParametrosBusca* p, TabelaTransposicao* tabela, ResultadoBusca* r);
+long agoraMicrossegundos(void);
+int buscarAtePecaNaFrente(const Sessao* s, int alvo, ResultadoBusca* r);
+
+// Avaliacao Monte Carlo (jogar x reservar)
+int avaliarReserva(const Sessao* s, const Tabuleiro* t, const ParametrosAvaliacao* p,
+                   ResultadoAvaliacao* r);
+int avaliarReservaPadrao(const Sessao* s, ResultadoAvaliacao* r);
+
 // Fila
-void inicializarFila(FilaCircular* fila);
+void inicializarFila(FilaCircular* fila, Peca* armazenamento, int capacidade);
 int filaVazia(FilaCircular* fila);
 int filaCheia(FilaCircular* fila);
+int tamanhoFila(FilaCircular* fila);
 void enqueue(FilaCircular* fila, Peca peca);
 Peca dequeue(FilaCircular* fila);
 Peca frente(FilaCircular* fila);
 
+// Fila SPSC (produtor e consumidor em threads diferentes)
+void inicializarFilaSpsc(FilaSpsc* fila, Peca* armazenamento, int capacidade);
+int spscEnqueue(FilaSpsc* fila, Peca peca);
+int spscDequeue(FilaSpsc* fila, Peca* peca);
+int spscFrente(FilaSpsc* fila, Peca* peca);
+int reporFilaSpsc(FilaSpsc* fila, GeradorPecas* gerador);
+int iniciarAlimentador(Alimentador* a, FilaSpsc* fila, GeradorPecas* gerador);
+void pararAlimentador(Alimentador* a);
+
+// Hash incremental
+uint64_t calcularHashFila(const FilaCircular* fila);
+uint64_t calcularHashPilha(const Pilha* pilha);
+void recalcularHashes(FilaCircular* fila, Pilha* pilha);
+uint64_t hashFilaPilha(const FilaCircular* fila, const Pilha* pilha);
+void conferirHashFila(const FilaCircular* fila, const char* onde);
+void conferirHashPilha(const Pilha* pilha, const char* onde);
+
 // Pilha
-void inicializarPilha(Pilha* pilha);
+void inicializarPilha(Pilha* pilha, Peca* armazenamento, int capacidade);
 int pilhaVazia(Pilha* pilha);
 int pilhaCheia(Pilha* pilha);
 void push(Pilha* pilha, Peca peca);
@@ -62,57 +1050,239 @@ Peca pop(Pilha* pilha);
 Peca topo(Pilha* pilha);
 
 // Operacoes avancadas
-void trocarPecaSimples(FilaCircular* fila, Pilha* pilha);
-void trocarMultipla(FilaCircular* fila, Pilha* pilha);
+Resultado aplicarTrocaSimples(FilaCircular* fila, Pilha* pilha);
+Resultado trocarK(FilaCircular* fila, Pilha* pilha, int k);
+int tamanhoTrocaMultipla(const FilaCircular* fila, const Pilha* pilha);
+Resultado aplicarTrocaMultipla(FilaCircular* fila, Pilha* pilha);
+Resultado trocarPecaSimples(FilaCircular* fila, Pilha* pilha);
+Resultado trocarMultipla(FilaCircular* fila, Pilha* pilha);
+Resultado executarOperacao(Sessao* s, int opcao, Peca* peca);
+
+// Desfazer / refazer
+void iniciarHistorico(Historico* h);
+Resultado executarComHistorico(Sessao* s, Historico* h, int opcao, Peca* peca);
+void registrarTroca(Historico* h, int opcao);
+Resultado desfazer(Sessao* s, Historico* h, int* opcao);
+Resultado refazer(Sessao* s, Historico* h, int* opcao);
+
+// Instrumentacao (contadores)
+void somarContadores(Contadores* total);
+void despejarContadores(FILE* saida, const Sessao* s);
+int gravarContadores(const char* caminho, const Sessao* s);
+
+// Modo lote
+int executarLote(FILE* entrada, int rastro, Configuracao* cfg, Sessao* sessao,
+                 GravadorReplay* gravador, Tabuleiro* tabuleiro);
+
+// Log de replay
+int abrirGravador(GravadorReplay* g, const char* caminho, const Configuracao* cfg, uint32_t intervalo);
+void gravarOperacao(GravadorReplay* g, const Sessao* s, int opcao);
+int fecharGravador(GravadorReplay* g, const Sessao* s);
+int lerCabecalhoReplay(const unsigned char* dados, size_t tamanho, Configuracao* cfg, uint32_t* intervalo);
+
+// Renderizacao (quadro inteiro num write)
+void iniciarRenderizador(Renderizador* r, int descritor);
+void renderizarEstado(Renderizador* r, const FilaCircular* fila, const Pilha* pilha);
+void renderizarMenu(Renderizador* r, const FilaCircular* fila, const Pilha* pilha);
+void renderizarTexto(Renderizador* r, const char* texto);
+int enviarQuadro(Renderizador* r);
+
+// Interface de terminal (--tui)
+int executarTui(Sessao* s, GravadorReplay* gravador, int medir);
 
 // Gerais
-Peca gerarPeca();
+Peca gerarPeca(GeradorPecas* gerador);
+void reporFila(FilaCircular* fila, GeradorPecas* gerador);
 void exibirEstado(FilaCircular* fila, Pilha* pilha);
-void exibirMenu();
+void exibirMenu(FilaCircular* fila, Pilha* pilha);
+void sugerirSequencia(const Sessao* s);
+void sugerirReserva(const Sessao* s);
 void pausar();
 
 // ==================== FUNCAO PRINCIPAL ====================
-int main() {
-    FilaCircular fila;
-    Pilha pilha;
+#ifndef TETRIS_SEM_MAIN
+int main(int argc, char* argv[]) {
+    Sessao sessao;
+    Configuracao cfg = {TAM_FILA, TAM_PILHA, (uint64_t)time(NULL), GERADOR_SACO7};
+    const char* caminho = NULL;
+    const char* caminhoGravacao = NULL;
+    const char* caminhoCarregar = NULL;
+    const char* caminhoSalvar = NULL;
+    const char* caminhoContadores = NULL;
+    GravadorReplay gravador;
+    SnapshotSessao snapshot;
+    Historico historico;
+    Renderizador tela;
+    Tabuleiro tabuleiro;
+    int comTabuleiro = 0;
+    int lote = 0;
+    int rastro = 0;
+    int tui = 0;
+    int medir = 0;
     int opcao;
     
-    srand(time(NULL));
+    // Argumentos: [--lote [arquivo] [--rastro]] [--fila N] [--pilha M]
+    //             [--semente S] [--gerador nome] [--gravar arquivo]
+    //             [--carregar arquivo] [--salvar arquivo] [--tui [--medir]]
+    //             [--contadores arquivo] [--tabuleiro]
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--lote") == 0) {
+            lote = 1;
+        } else if (strcmp(argv[i], "--tui") == 0) {
+            tui = 1;
+        } else if (strcmp(argv[i], "--medir") == 0) {
+            medir = 1;
+        } else if (strcmp(argv[i], "--rastro") == 0) {
+            rastro = 1;
+        } else if (strcmp(argv[i], "--tabuleiro") == 0) {
+            comTabuleiro = 1;
+        } else if (strcmp(argv[i], "--fila") == 0 && i + 1 < argc) {
+            cfg.tamFila = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--pilha") == 0 && i + 1 < argc) {
+            cfg.tamPilha = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--semente") == 0 && i + 1 < argc) {
+            cfg.semente = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--gerador") == 0 && i + 1 < argc) {
+            int politica = politicaPorNome(argv[++i]);
+            if (politica < 0) {
+                fprintf(stderr, "ERRO: gerador desconhecido '%s'\n", argv[i]);
+                return 1;
+            }
+            cfg.politica = (PoliticaGeracao)politica;
+        } else if (strcmp(argv[i], "--gravar") == 0 && i + 1 < argc) {
+            caminhoGravacao = argv[++i];
+        } else if (strcmp(argv[i], "--carregar") == 0 && i + 1 < argc) {
+            caminhoCarregar = argv[++i];
+        } else if (strcmp(argv[i], "--salvar") == 0 && i + 1 < argc) {
+            caminhoSalvar = argv[++i];
+        } else if (strcmp(argv[i], "--contadores") == 0 && i + 1 < argc) {
+            caminhoContadores = argv[++i];
+        } else if (lote && caminho == NULL) {
+            caminho = argv[i];
+        } else {
+            fprintf(stderr, "ERRO: argumento invalido '%s'\n", argv[i]);
+            return 1;
+        }
+    }
+    
+    // O snapshot traz as capacidades e o gerador da sessao salva
+    if (caminhoCarregar != NULL) {
+        if (!lerSnapshot(&snapshot, caminhoCarregar)) {
+            fprintf(stderr, "ERRO: snapshot invalido ou ilegivel '%s'\n", caminhoCarregar);
+            return 1;
+        }
+        if (caminhoGravacao != NULL) {
+            fprintf(stderr, "ERRO: --gravar parte da semente; nao combina com --carregar\n");
+            return 1;
+        }
+        cfg.tamFila = snapshot.tamFila;
+        cfg.tamPilha = snapshot.tamPilha;
+        cfg.politica = snapshot.gerador.politica;
+    }
+    
+    if (cfg.tamFila < 1 || cfg.tamFila > FILA_MAX) {
+        fprintf(stderr, "ERRO: --fila deve estar entre 1 e %d\n", FILA_MAX);
+        return 1;
+    }
+    if (cfg.tamPilha < 1 || cfg.tamPilha > PILHA_MAX) {
+        fprintf(stderr, "ERRO: --pilha deve estar entre 1 e %d\n", PILHA_MAX);
+        return 1;
+    }
+    if (caminhoGravacao != NULL &&
+        !abrirGravador(&gravador, caminhoGravacao, &cfg, REPLAY_INTERVALO_PADRAO)) {
+        fprintf(stderr, "ERRO: nao foi possivel criar '%s'\n", caminhoGravacao);
+        return 1;
+    }
+    GravadorReplay* log = caminhoGravacao != NULL ? &gravador : NULL;
+    
+    // Cria a sessao e preenche a fila inicial (ou restaura a salva)
+    if (!criarSessao(&sessao, &cfg, cfg.semente)) {
+        fprintf(stderr, "ERRO: memoria insuficiente\n");
+        return 1;
+    }
+    if (caminhoCarregar != NULL && !restaurarSnapshot(&sessao, &snapshot)) {
+        fprintf(stderr, "ERRO: snapshot '%s' nao confere com a sessao criada\n", caminhoCarregar);
+        destruirSessao(&sessao);
+        return 1;
+    }
     
-    inicializarFila(&fila);
-    inicializarPilha(&pilha);
+    // Modo lote (sem menu nem pausas) e modo tui (tecla a tecla)
+    if (lote || tui) {
+        int status;
+        if (lote) {
+            FILE* entrada = stdin;
+            if (caminho != NULL && strcmp(caminho, "-") != 0) {
+                entrada = fopen(caminho, "rb");
+                if (entrada == NULL) {
+                    fprintf(stderr, "ERRO: nao foi possivel abrir '%s'\n", caminho);
+                    return 1;
+                }
+            }
+            
+            if (comTabuleiro) iniciarTabuleiro(&tabuleiro);
+            status = executarLote(entrada, rastro, &cfg, &sessao, log,
+                                  comTabuleiro ? &tabuleiro : NULL);
+            if (entrada != stdin) {
+                fclose(entrada);
+            }
+        } else {
+            status = executarTui(&sessao, log, medir);
+        }
+        if (caminhoSalvar != NULL) {
+            salvarSnapshot(&sessao, &snapshot);
+            if (!gravarSnapshot(&snapshot, caminhoSalvar)) {
+                fprintf(stderr, "ERRO: nao foi possivel salvar '%s'\n", caminhoSalvar);
+                status = 1;
+            }
+        }
+        if (caminhoContadores != NULL && !gravarContadores(caminhoContadores, &sessao)) {
+            fprintf(stderr, "ERRO: nao foi possivel gravar '%s'\n", caminhoContadores);
+            status = 1;
+        }
+        destruirSessao(&sessao);
+        return status;
+    }
     
     printf("=====================================================\n");
     printf("   TETRIS STACK - SISTEMA COMPLETO (MESTRE)\n");
     printf("=====================================================\n");
     printf(">>> Inicializando sistema avancado...\n\n");
     
-    // Preenche fila inicial
-    for (int i = 0; i < TAM_FILA; i++) {
-        enqueue(&fila, gerarPeca());
-    }
+    FilaCircular* fila = &sessao.fila;
+    Pilha* pilha = &sessao.pilha;
+    iniciarHistorico(&historico);
+    iniciarRenderizador(&tela, STDOUT_FILENO);
     
-    printf(">>> Fila inicializada!\n");
+    if (caminhoCarregar != NULL) {
+        printf(">>> Estado restaurado de '%s'!\n", caminhoCarregar);
+    } else {
+        printf(">>> Fila inicializada! (semente %llu)\n", (unsigned long long)cfg.semente);
+    }
     printf(">>> Pilha pronta!\n");
     printf(">>> Trocas estrategicas disponiveis!\n");
     pausar();
     
-    // Loop principal
+    // Loop principal: estado, menu e prompt saem num unico write()
     do {
-        exibirEstado(&fila, &pilha);
-        exibirMenu();
+        renderizarEstado(&tela, fila, pilha);
+        renderizarMenu(&tela, fila, pilha);
+        renderizarTexto(&tela, "Escolha uma opcao: ");
+        enviarQuadro(&tela);
         
-        printf("Escolha uma opcao: ");
         scanf("%d", &opcao);
         printf("\n");
         
+        Peca p;
+        Resultado r;
+        int alvo;
+        INICIAR_MEDICAO(inicio);    // 4 e 5 nao passam por executarOperacao
+        
         switch (opcao) {
             case 1:
                 // Jogar peca
-                if (!filaVazia(&fila)) {
-                    Peca p = dequeue(&fila);
-                    printf(">>> PECA JOGADA: [%c %d]\n", p.nome, p.id);
-                    enqueue(&fila, gerarPeca());
+                r = executarComHistorico(&sessao, &historico, opcao, &p);
+                if (r == RES_OK) {
+                    printf(">>> PECA JOGADA: [%c %d]\n", nomePeca(p), idPeca(p));
                 } else {
                     printf(">>> ERRO: Fila vazia!\n");
                 }
@@ -120,36 +1290,66 @@ int main() {
                 
             case 2:
                 // Reservar peca
-                if (pilhaCheia(&pilha)) {
+                r = executarComHistorico(&sessao, &historico, opcao, &p);
+                if (r == RES_PILHA_CHEIA) {
                     printf(">>> ERRO: Pilha cheia!\n");
-                } else if (filaVazia(&fila)) {
+                } else if (r == RES_FILA_VAZIA) {
                     printf(">>> ERRO: Fila vazia!\n");
                 } else {
-                    Peca p = dequeue(&fila);
-                    push(&pilha, p);
-                    printf(">>> PECA RESERVADA: [%c %d]\n", p.nome, p.id);
-                    enqueue(&fila, gerarPeca());
+                    printf(">>> PECA RESERVADA: [%c %d]\n", nomePeca(p), idPeca(p));
                 }
                 break;
                 
             case 3:
                 // Usar peca reservada
-                if (pilhaVazia(&pilha)) {
+                r = executarComHistorico(&sessao, &historico, opcao, &p);
+                if (r == RES_PILHA_VAZIA) {
                     printf(">>> ERRO: Pilha vazia!\n");
                 } else {
-                    Peca p = pop(&pilha);
-                    printf(">>> PECA USADA: [%c %d]\n", p.nome, p.id);
+                    printf(">>> PECA USADA: [%c %d]\n", nomePeca(p), idPeca(p));
                 }
                 break;
                 
             case 4:
                 // Trocar peca simples (frente fila <-> topo pilha)
-                trocarPecaSimples(&fila, &pilha);
+                r = trocarPecaSimples(fila, pilha);
+                REGISTRAR_OPERACAO(&sessao, opcao, r, inicio);
+                if (r == RES_OK) registrarTroca(&historico, opcao);
                 break;
                 
             case 5:
-                // Trocar 3 primeiras da fila com 3 da pilha
-                trocarMultipla(&fila, &pilha);
+                // Trocar N primeiras da fila com as N da pilha
+                r = trocarMultipla(fila, pilha);
+                REGISTRAR_OPERACAO(&sessao, opcao, r, inicio);
+                if (r == RES_OK) registrarTroca(&historico, opcao);
+                break;
+                
+            case 6:
+                // Desfazer a ultima operacao
+                if (desfazer(&sessao, &historico, &alvo) == RES_OK) {
+                    printf(">>> OPERACAO %d DESFEITA\n", alvo);
+                } else {
+                    printf(">>> ERRO: Nada para desfazer!\n");
+                }
+                break;
+                
+            case 7:
+                // Refazer a ultima operacao desfeita
+                if (refazer(&sessao, &historico, &alvo) == RES_OK) {
+                    printf(">>> OPERACAO %d REFEITA\n", alvo);
+                } else {
+                    printf(">>> ERRO: Nada para refazer!\n");
+                }
+                break;
+                
+            case 8:
+                // Sugerir a sequencia mais curta ate um tipo na frente
+                sugerirSequencia(&sessao);
+                break;
+                
+            case 9:
+                // Estimar se vale mais jogar ou reservar a frente
+                sugerirReserva(&sessao);
                 break;
                 
             case 0:
@@ -160,6 +1360,10 @@ int main() {
                 printf(">>> ERRO: Opcao invalida!\n");
         }
         
+        if (log != NULL && opcao >= 1 && opcao <= NUM_OPCOES) {
+            gravarOperacao(log, &sessao, opcao);
+        }
+        
         if (opcao != 0) {
             pausar();
         }
@@ -168,227 +1372,3589 @@ int main() {
     
     printf("\n=====================================================\n");
     printf("Sistema finalizado!\n");
-    printf("Total de pecas geradas: %d\n", proximoId);
+    printf("Total de pecas geradas: %u\n", sessao.gerador.proximoId);
     printf("=====================================================\n\n");
     
+    if (log != NULL && !fecharGravador(log, &sessao)) {
+        fprintf(stderr, "ERRO: falha ao gravar '%s'\n", caminhoGravacao);
+    }
+    if (caminhoSalvar != NULL) {
+        salvarSnapshot(&sessao, &snapshot);
+        if (!gravarSnapshot(&snapshot, caminhoSalvar)) {
+            fprintf(stderr, "ERRO: nao foi possivel salvar '%s'\n", caminhoSalvar);
+        }
+    }
+    if (caminhoContadores != NULL && !gravarContadores(caminhoContadores, &sessao)) {
+        fprintf(stderr, "ERRO: nao foi possivel gravar '%s'\n", caminhoContadores);
+    }
+    destruirSessao(&sessao);
     return 0;
 }
+#endif
 
-// ==================== IMPLEMENTACAO - FILA ====================
+// ==================== IMPLEMENTACAO - ARENA ====================
 
-void inicializarFila(FilaCircular* fila) {
-    fila->frente = 0;
-    fila->tras = -1;
-    fila->tamanho = 0;
+/*
+ * potenciaDe2()
+ * Menor potencia de 2 >= n
+ */
+unsigned int potenciaDe2(unsigned int n) {
+    unsigned int p = 1;
+    while (p < n) p <<= 1;
+    return p;
 }
 
-int filaVazia(FilaCircular* fila) {
-    return (fila->tamanho == 0);
+/*
+ * tamanhoArena()
+ * Quantidade de pecas da arena de uma sessao: array da fila (potencia
+ * de 2) seguido do array da pilha
+ */
+size_t tamanhoArena(const Configuracao* cfg) {
+    return potenciaDe2(cfg->tamFila) + (size_t)cfg->tamPilha;
+}
+
+/*
+ * ligarArena()
+ * Liga a fila e a pilha a uma arena de tamanhoArena(cfg) pecas. A arena
+ * e alocada uma unica vez; nenhuma operacao do jogo aloca memoria.
+ */
+void ligarArena(FilaCircular* fila, Pilha* pilha, const Configuracao* cfg, Peca* arena) {
+    inicializarFila(fila, arena, cfg->tamFila);
+    inicializarPilha(pilha, arena + potenciaDe2(cfg->tamFila), cfg->tamPilha);
+}
+
+// ==================== IMPLEMENTACAO - FILA ====================
+
+/*
+ * inicializarFila()
+ * 'armazenamento' deve ter potenciaDe2(capacidade) posicoes
+ */
+void inicializarFila(FilaCircular* fila, Peca* armazenamento, int capacidade) {
+    fila->elementos = armazenamento;
+    fila->mascara = potenciaDe2(capacidade) - 1;
+    fila->capacidade = capacidade;
+    fila->frente = 0;
+    fila->tras = 0;
+    fila->hash = 0;
+    fila->potencia = 1;
+}
+
+int tamanhoFila(FilaCircular* fila) {
+    return (int)(fila->tras - fila->frente);
+}
+
+int filaVazia(FilaCircular* fila) {
+    return (fila->tras == fila->frente);
 }
 
 int filaCheia(FilaCircular* fila) {
-    return (fila->tamanho == TAM_FILA);
+    return (tamanhoFila(fila) == fila->capacidade);
+}
+
+void enqueue(FilaCircular* fila, Peca peca) {
+    if (filaCheia(fila)) {
+        CONTAR(EV_ENQUEUE_FILA_CHEIA);
+        return;
+    }
+    CONTAR(EV_ENQUEUE);
+    fila->elementos[fila->tras & fila->mascara] = peca;
+    fila->tras++;
+    fila->hash += chaveFila(peca) * fila->potencia;
+    fila->potencia *= HASH_BASE;
+    CONFERIR_HASH_FILA(fila);
+}
+
+Peca dequeue(FilaCircular* fila) {
+    CONTAR(EV_DEQUEUE);
+    Peca p = fila->elementos[fila->frente & fila->mascara];
+    fila->frente++;
+    fila->hash = (fila->hash - chaveFila(p)) * HASH_BASE_INVERSA;
+    fila->potencia *= HASH_BASE_INVERSA;
+    CONFERIR_HASH_FILA(fila);
+    return p;
+}
+
+// Inversa de enqueue (so o desfazer usa): tira a ultima peca
+static Peca retirarDoFim(FilaCircular* fila) {
+    fila->tras--;
+    Peca p = fila->elementos[fila->tras & fila->mascara];
+    fila->potencia *= HASH_BASE_INVERSA;
+    fila->hash -= chaveFila(p) * fila->potencia;
+    return p;
+}
+
+// Inversa de dequeue (so o desfazer usa): recoloca a peca na frente
+static void devolverAFrente(FilaCircular* fila, Peca peca) {
+    fila->frente--;
+    fila->elementos[fila->frente & fila->mascara] = peca;
+    fila->hash = fila->hash * HASH_BASE + chaveFila(peca);
+    fila->potencia *= HASH_BASE;
+}
+
+Peca frente(FilaCircular* fila) {
+    return fila->elementos[fila->frente & fila->mascara];
+}
+
+// ==================== IMPLEMENTACAO - FILA SPSC ====================
+
+/*
+ * inicializarFilaSpsc()
+ * 'armazenamento' deve ter potenciaDe2(capacidade) posicoes. Chamar
+ * antes de entregar a fila as threads.
+ */
+void inicializarFilaSpsc(FilaSpsc* fila, Peca* armazenamento, int capacidade) {
+    fila->elementos = armazenamento;
+    fila->mascara = potenciaDe2(capacidade) - 1;
+    fila->capacidade = (unsigned int)capacidade;
+    atomic_init(&fila->frente, 0);
+    atomic_init(&fila->tras, 0);
+    fila->trasVisto = 0;
+    fila->frenteVista = 0;
+}
+
+/*
+ * spscEnqueue()
+ * So o produtor chama. Retorna 0 se a fila estiver cheia. A peca e
+ * escrita antes do store release de 'tras', entao o consumidor que
+ * enxerga o novo 'tras' enxerga a peca.
+ */
+int spscEnqueue(FilaSpsc* fila, Peca peca) {
+    unsigned int tras = atomic_load_explicit(&fila->tras, memory_order_relaxed);
+    if (tras - fila->frenteVista == fila->capacidade) {
+        fila->frenteVista = atomic_load_explicit(&fila->frente, memory_order_acquire);
+        if (tras - fila->frenteVista == fila->capacidade) return 0;
+    }
+    fila->elementos[tras & fila->mascara] = peca;
+    atomic_store_explicit(&fila->tras, tras + 1, memory_order_release);
+    return 1;
+}
+
+/*
+ * spscDequeue()
+ * So o consumidor chama. Retorna 0 se a fila estiver vazia. O store
+ * release de 'frente' so libera a posicao depois que a peca foi lida.
+ */
+int spscDequeue(FilaSpsc* fila, Peca* peca) {
+    unsigned int frente = atomic_load_explicit(&fila->frente, memory_order_relaxed);
+    if (frente == fila->trasVisto) {
+        fila->trasVisto = atomic_load_explicit(&fila->tras, memory_order_acquire);
+        if (frente == fila->trasVisto) return 0;
+    }
+    *peca = fila->elementos[frente & fila->mascara];
+    atomic_store_explicit(&fila->frente, frente + 1, memory_order_release);
+    return 1;
+}
+
+// So o consumidor chama: le a proxima peca sem retirar
+int spscFrente(FilaSpsc* fila, Peca* peca) {
+    unsigned int frente = atomic_load_explicit(&fila->frente, memory_order_relaxed);
+    if (frente == fila->trasVisto) {
+        fila->trasVisto = atomic_load_explicit(&fila->tras, memory_order_acquire);
+        if (frente == fila->trasVisto) return 0;
+    }
+    *peca = fila->elementos[frente & fila->mascara];
+    return 1;
+}
+
+/*
+ * reporFilaSpsc()
+ * Lado do produtor: completa as vagas livres e publica todas com um
+ * unico store release. Retorna quantas pecas entraram.
+ */
+int reporFilaSpsc(FilaSpsc* fila, GeradorPecas* gerador) {
+    unsigned int tras = atomic_load_explicit(&fila->tras, memory_order_relaxed);
+    fila->frenteVista = atomic_load_explicit(&fila->frente, memory_order_acquire);
+    unsigned int limite = fila->frenteVista + fila->capacidade;
+    unsigned int inicio = tras;
+    while (tras != limite) {
+        fila->elementos[tras & fila->mascara] = gerarPeca(gerador);
+        tras++;
+    }
+    if (tras != inicio) {
+        atomic_store_explicit(&fila->tras, tras, memory_order_release);
+    }
+    return (int)(tras - inicio);
+}
+
+// Laco da thread produtora: repoe a fila; cede a CPU quando esta cheia
+static void* lacoAlimentador(void* arg) {
+    Alimentador* a = arg;
+    while (!atomic_load_explicit(&a->parar, memory_order_relaxed)) {
+        if (reporFilaSpsc(a->fila, a->gerador) == 0) sched_yield();
+    }
+    return NULL;
+}
+
+/*
+ * iniciarAlimentador()
+ * Sobe a thread produtora. O gerador passa a ser usado so por ela ate
+ * pararAlimentador. Retorna 0 se a thread nao pode ser criada.
+ */
+int iniciarAlimentador(Alimentador* a, FilaSpsc* fila, GeradorPecas* gerador) {
+    a->fila = fila;
+    a->gerador = gerador;
+    atomic_init(&a->parar, 0);
+    return pthread_create(&a->thread, NULL, lacoAlimentador, a) == 0;
+}
+
+void pararAlimentador(Alimentador* a) {
+    atomic_store_explicit(&a->parar, 1, memory_order_relaxed);
+    pthread_join(a->thread, NULL);
+}
+
+// ==================== IMPLEMENTACAO - PILHA ====================
+
+void inicializarPilha(Pilha* pilha, Peca* armazenamento, int capacidade) {
+    pilha->elementos = armazenamento;
+    pilha->capacidade = capacidade;
+    pilha->topo = -1;
+    pilha->hash = 0;
+}
+
+int pilhaVazia(Pilha* pilha) {
+    return (pilha->topo == -1);
+}
+
+int pilhaCheia(Pilha* pilha) {
+    return (pilha->topo == pilha->capacidade - 1);
+}
+
+void push(Pilha* pilha, Peca peca) {
+    if (pilhaCheia(pilha)) {
+        CONTAR(EV_PUSH_PILHA_CHEIA);
+        return;
+    }
+    CONTAR(EV_PUSH);
+    pilha->topo++;
+    pilha->elementos[pilha->topo] = peca;
+    pilha->hash ^= chavePilha(peca, pilha->topo);
+    CONFERIR_HASH_PILHA(pilha);
+}
+
+Peca pop(Pilha* pilha) {
+    CONTAR(EV_POP);
+    Peca p = pilha->elementos[pilha->topo];
+    pilha->hash ^= chavePilha(p, pilha->topo);
+    pilha->topo--;
+    CONFERIR_HASH_PILHA(pilha);
+    return p;
+}
+
+Peca topo(Pilha* pilha) {
+    return pilha->elementos[pilha->topo];
+}
+
+// ==================== HASH INCREMENTAL ====================
+
+/*
+ * calcularHashFila()
+ * Hash da fila recalculado do zero, O(n). As operacoes mantem o mesmo
+ * valor em fila->hash a custo O(1); esta versao serve de referencia.
+ */
+uint64_t calcularHashFila(const FilaCircular* fila) {
+    uint64_t h = 0;
+    uint64_t potencia = 1;
+    for (unsigned int i = fila->frente; i != fila->tras; i++) {
+        h += chaveFila(fila->elementos[i & fila->mascara]) * potencia;
+        potencia *= HASH_BASE;
+    }
+    return h;
+}
+
+uint64_t calcularHashPilha(const Pilha* pilha) {
+    uint64_t h = 0;
+    for (int i = 0; i <= pilha->topo; i++) {
+        h ^= chavePilha(pilha->elementos[i], i);
+    }
+    return h;
+}
+
+/*
+ * recalcularHashes()
+ * Para quem altera fila/pilha sem passar pelas operacoes (restaurar
+ * snapshot): refaz os dois hashes a partir do conteudo
+ */
+void recalcularHashes(FilaCircular* fila, Pilha* pilha) {
+    fila->hash = calcularHashFila(fila);
+    fila->potencia = 1;
+    for (int i = 0; i < tamanhoFila(fila); i++) fila->potencia *= HASH_BASE;
+    pilha->hash = calcularHashPilha(pilha);
+}
+
+/*
+ * hashFilaPilha()
+ * Hash de 64 bits do estado fila + pilha (pecas com id), O(1). Estados
+ * iguais tem o mesmo hash; a fila passa pelo misturador para que uma
+ * peca na fila e a mesma peca na pilha nao se cancelem.
+ */
+uint64_t hashFilaPilha(const FilaCircular* fila, const Pilha* pilha) {
+    return misturar64(fila->hash) ^ pilha->hash;
+}
+
+void conferirHashFila(const FilaCircular* fila, const char* onde) {
+    uint64_t potencia = 1;
+    for (unsigned int i = fila->frente; i != fila->tras; i++) potencia *= HASH_BASE;
+    if (fila->hash != calcularHashFila(fila) || fila->potencia != potencia) {
+        fprintf(stderr, "ERRO: hash incremental da fila divergiu em %s()\n", onde);
+        abort();
+    }
+}
+
+void conferirHashPilha(const Pilha* pilha, const char* onde) {
+    if (pilha->hash != calcularHashPilha(pilha)) {
+        fprintf(stderr, "ERRO: hash incremental da pilha divergiu em %s()\n", onde);
+        abort();
+    }
+}
+
+// ==================== OPERACOES AVANCADAS ====================
+
+/*
+ * aplicarTrocaSimples()
+ * Nucleo da troca simples, sem mensagens: frente da fila <-> topo da pilha
+ */
+Resultado aplicarTrocaSimples(FilaCircular* fila, Pilha* pilha) {
+    if (filaVazia(fila)) return RES_FILA_VAZIA;
+    if (pilhaVazia(pilha)) return RES_PILHA_VAZIA;
+    CONTAR(EV_TROCA_SIMPLES);
+    
+    // Guarda as pecas
+    Peca pecaFila = frente(fila);
+    Peca pecaPilha = topo(pilha);
+    
+    // Remove de ambas
+    dequeue(fila);
+    pop(pilha);
+    
+    // Insere trocadas
+    push(pilha, pecaFila);
+    enqueue(fila, pecaPilha);
+    return RES_OK;
+}
+
+/*
+ * trocarK()
+ * Troca, no lugar, as k primeiras pecas da fila com as k do topo da
+ * pilha: a i-esima da fila vai para a posicao (topo - i) da pilha e
+ * vice-versa, entao o lado da pilha sai invertido. Uma passada, sem
+ * arrays temporarios e sem passar por dequeue/pop.
+ */
+Resultado trocarK(FilaCircular* fila, Pilha* pilha, int k) {
+    if (k < 1 || tamanhoFila(fila) < k || pilha->topo + 1 < k) {
+        CONTAR(EV_TROCA_K_INSUFICIENTE);
+        return RES_TROCA_INSUFICIENTE;
+    }
+    CONTAR(EV_TROCA_K);
+    
+    unsigned int posFila = fila->frente;
+    int posPilha = pilha->topo;
+    uint64_t potencia = 1;      // HASH_BASE^i
+    for (int i = 0; i < k; i++, posFila++, posPilha--) {
+        Peca* a = &fila->elementos[posFila & fila->mascara];
+        Peca* b = &pilha->elementos[posPilha];
+        Peca daFila = *a;
+        Peca daPilha = *b;
+        *a = daPilha;
+        *b = daFila;
+        fila->hash += (chaveFila(daPilha) - chaveFila(daFila)) * potencia;
+        pilha->hash ^= chavePilha(daFila, posPilha) ^ chavePilha(daPilha, posPilha);
+        potencia *= HASH_BASE;
+    }
+    CONFERIR_HASH_FILA(fila);
+    CONFERIR_HASH_PILHA(pilha);
+    return RES_OK;
+}
+
+/*
+ * tamanhoTrocaMultipla()
+ * N da troca multipla: a capacidade da pilha (3 no padrao), limitada pela
+ * da fila, que nunca tem mais pecas que isso
+ */
+int tamanhoTrocaMultipla(const FilaCircular* fila, const Pilha* pilha) {
+    return fila->capacidade < pilha->capacidade ? fila->capacidade : pilha->capacidade;
+}
+
+/*
+ * aplicarTrocaMultipla()
+ * Nucleo da troca multipla, sem mensagens: as N primeiras da fila <-> as
+ * N da pilha (N = tamanhoTrocaMultipla)
+ */
+Resultado aplicarTrocaMultipla(FilaCircular* fila, Pilha* pilha) {
+    return trocarK(fila, pilha, tamanhoTrocaMultipla(fila, pilha));
+}
+
+/*
+ * trocarPecaSimples()
+ * Troca a peca da frente da fila com o topo da pilha
+ */
+Resultado trocarPecaSimples(FilaCircular* fila, Pilha* pilha) {
+    if (filaVazia(fila)) {
+        printf(">>> ERRO: Fila vazia! Impossivel trocar.\n");
+        return RES_FILA_VAZIA;
+    }
+    
+    if (pilhaVazia(pilha)) {
+        printf(">>> ERRO: Pilha vazia! Impossivel trocar.\n");
+        return RES_PILHA_VAZIA;
+    }
+    
+    printf(">>> TROCA SIMPLES:\n");
+    
+    Peca pecaFila = frente(fila);
+    Peca pecaPilha = topo(pilha);
+    
+    printf("    Fila (frente): [%c %d]\n", nomePeca(pecaFila), idPeca(pecaFila));
+    printf("    Pilha (topo): [%c %d]\n", nomePeca(pecaPilha), idPeca(pecaPilha));
+    
+    aplicarTrocaSimples(fila, pilha);
+    
+    printf("\n>>> TROCA REALIZADA COM SUCESSO!\n");
+    return RES_OK;
+}
+
+/*
+ * trocarMultipla()
+ * Troca as N primeiras pecas da fila com as N da pilha
+ */
+Resultado trocarMultipla(FilaCircular* fila, Pilha* pilha) {
+    int n = tamanhoTrocaMultipla(fila, pilha);
+    
+    // Valida se tem N em cada
+    if (tamanhoFila(fila) < n) {
+        CONTAR(EV_TROCA_K_INSUFICIENTE);
+        printf(">>> ERRO: Fila precisa ter pelo menos %d pecas!\n", n);
+        printf(">>> Atual: %d pecas\n", tamanhoFila(fila));
+        return RES_TROCA_INSUFICIENTE;
+    }
+    
+    if (pilha->topo + 1 < n) {
+        CONTAR(EV_TROCA_K_INSUFICIENTE);
+        printf(">>> ERRO: Pilha precisa ter %d pecas!\n", n);
+        printf(">>> Atual: %d pecas\n", pilha->topo + 1);
+        return RES_TROCA_INSUFICIENTE;
+    }
+    
+    printf(">>> TROCA MULTIPLA (%d x %d):\n", n, n);
+    
+    // Copias apenas para exibicao
+    Peca tempFila[PILHA_MAX];
+    Peca tempPilha[PILHA_MAX];
+    for (int i = 0; i < n; i++) {
+        tempFila[i] = fila->elementos[(fila->frente + i) & fila->mascara];
+        tempPilha[i] = pilha->elementos[pilha->topo - i];
+    }
+    
+    aplicarTrocaMultipla(fila, pilha);
+    
+    printf("\n    Removendo da fila:\n");
+    for (int i = 0; i < n; i++) {
+        printf("      [%c %d]\n", nomePeca(tempFila[i]), idPeca(tempFila[i]));
+    }
+    
+    printf("\n    Removendo da pilha:\n");
+    for (int i = 0; i < n; i++) {
+        printf("      [%c %d]\n", nomePeca(tempPilha[i]), idPeca(tempPilha[i]));
+    }
+    
+    printf("\n    Inserindo na frente da fila (pecas da pilha):\n");
+    for (int i = 0; i < n; i++) {
+        printf("      [%c %d]\n", nomePeca(tempPilha[i]), idPeca(tempPilha[i]));
+    }
+    
+    printf("\n    Inserindo na pilha (pecas da fila):\n");
+    for (int i = n - 1; i >= 0; i--) {  // Inverte ordem
+        printf("      [%c %d]\n", nomePeca(tempFila[i]), idPeca(tempFila[i]));
+    }
+    
+    printf("\n>>> TROCA MULTIPLA REALIZADA COM SUCESSO!\n");
+    return RES_OK;
+}
+
+/*
+ * aplicarOperacao()
+ * Nucleo de executarOperacao, sem a medicao
+ */
+static inline Resultado aplicarOperacao(Sessao* s, int opcao, Peca* peca) {
+    FilaCircular* fila = &s->fila;
+    Pilha* pilha = &s->pilha;
+    GeradorPecas* gerador = &s->gerador;
+    
+    switch (opcao) {
+        case 1:
+            // Jogar peca
+            if (filaVazia(fila)) return RES_FILA_VAZIA;
+            *peca = dequeue(fila);
+            reporFila(fila, gerador);
+            return RES_OK;
+            
+        case 2:
+            // Reservar peca
+            if (pilhaCheia(pilha)) return RES_PILHA_CHEIA;
+            if (filaVazia(fila)) return RES_FILA_VAZIA;
+            *peca = dequeue(fila);
+            push(pilha, *peca);
+            reporFila(fila, gerador);
+            return RES_OK;
+            
+        case 3:
+            // Usar peca reservada
+            if (pilhaVazia(pilha)) return RES_PILHA_VAZIA;
+            *peca = pop(pilha);
+            return RES_OK;
+            
+        case 4:
+            return aplicarTrocaSimples(fila, pilha);
+            
+        case 5:
+            return aplicarTrocaMultipla(fila, pilha);
+            
+        default:
+            return RES_OPCAO_INVALIDA;
+    }
+}
+
+/*
+ * executarOperacao()
+ * Executa uma opcao do menu (1-5) na sessao, sem imprimir nada.
+ * Em 'peca' devolve a peca jogada/reservada/usada (opcoes 1-3).
+ * Com -DINSTRUMENTAR conta a operacao, o resultado e o tempo gasto.
+ */
+Resultado executarOperacao(Sessao* s, int opcao, Peca* peca) {
+    INICIAR_MEDICAO(inicio);
+    Resultado r = aplicarOperacao(s, opcao, peca);
+    REGISTRAR_OPERACAO(s, opcao, r, inicio);
+    return r;
+}
+
+// ==================== DESFAZER / REFAZER ====================
+
+void iniciarHistorico(Historico* h) {
+    h->inicio = h->atual = h->fim = 0;
+}
+
+// Nova entrada no 'atual'; descarta o que podia ser refeito e, com o
+// anel cheio, a operacao mais antiga
+static DeltaOperacao* novaEntrada(Historico* h, int opcao) {
+    h->fim = h->atual;
+    if (h->fim - h->inicio == TAM_HISTORICO) h->inicio++;
+    DeltaOperacao* d = &h->entradas[h->fim % TAM_HISTORICO];
+    d->opcao = (uint8_t)opcao;
+    d->novoSaco = 0;
+    h->atual = ++h->fim;
+    return d;
+}
+
+/*
+ * executarComHistorico()
+ * Como executarOperacao, mas registra o delta das operacoes aceitas e
+ * trata 6 (desfazer) e 7 (refazer). Para o delta da geracao, basta
+ * olhar o gerador antes: se o saco esta vazio, a proxima peca abre um
+ * saco novo e o estado do PCG/historico de agora e o que se perde.
+ */
+Resultado executarComHistorico(Sessao* s, Historico* h, int opcao, Peca* peca) {
+    if (opcao == 6) return desfazer(s, h, &opcao);
+    if (opcao == 7) return refazer(s, h, &opcao);
+    
+    GeradorPecas* g = &s->gerador;
+    uint64_t aleatorio = g->aleatorio.estado;
+    uint32_t historico = g->historico;
+    int primeira = g->primeira;
+    int tamSaco = g->tamSaco;
+    int sacoVazio = g->posSaco == g->tamSaco;
+    
+    Resultado r = executarOperacao(s, opcao, peca);
+    if (r != RES_OK) return r;
+    
+    DeltaOperacao* d = novaEntrada(h, opcao);
+    if (opcao == 1 || opcao == 3) d->descartada = *peca;
+    if ((opcao == 1 || opcao == 2) && sacoVazio) {
+        d->novoSaco = 1;
+        d->tamSacoAnterior = (uint8_t)tamSaco;
+        d->primeiraAnterior = (uint8_t)primeira;
+        d->historicoAnterior = historico;
+        d->aleatorioAnterior = aleatorio;
+    }
+    return RES_OK;
+}
+
+/*
+ * registrarTroca()
+ * Para quem aplica 4/5 fora de executarComHistorico (menu interativo):
+ * as trocas nao geram nem descartam pecas, basta o codigo.
+ */
+void registrarTroca(Historico* h, int opcao) {
+    novaEntrada(h, opcao);
+}
+
+/*
+ * desfazerGeracao()
+ * Devolve ao gerador a peca 'gerada' (a ultima que ele produziu). A
+ * posicao do saco recebe de volta o tipo dela, entao a mesma peca sai
+ * de novo; se ela tinha aberto um saco novo, o saco anterior volta a
+ * ficar vazio com o PCG e o historico de antes.
+ */
+static void desfazerGeracao(GeradorPecas* g, const DeltaOperacao* d, Peca gerada) {
+    g->posSaco--;
+    g->proximoId--;
+    g->saco[g->posSaco] = (unsigned char)tipoPeca(gerada);
+    if (d->novoSaco) {
+        g->aleatorio.estado = d->aleatorioAnterior;
+        g->historico = d->historicoAnterior;
+        g->primeira = d->primeiraAnterior;
+        g->tamSaco = d->tamSacoAnterior;
+        g->posSaco = d->tamSacoAnterior;
+    }
+}
+
+/*
+ * aplicarDesfazer()
+ * Aplica o inverso da ultima operacao feita. O(k) para k pecas movidas:
+ * jogar/reservar tiram a peca gerada do fim e recolocam a da frente;
+ * usar reempilha a descartada; a troca simples devolve a peca do fim
+ * da fila ao topo e a do topo a frente; a multipla e a propria inversa.
+ */
+static inline Resultado aplicarDesfazer(Sessao* s, Historico* h, int* opcao) {
+    if (h->atual == h->inicio) return RES_NADA_A_DESFAZER;
+    const DeltaOperacao* d = &h->entradas[(h->atual - 1) % TAM_HISTORICO];
+    FilaCircular* fila = &s->fila;
+    Pilha* pilha = &s->pilha;
+    
+    switch (d->opcao) {
+        case 1:
+        case 2: {
+            desfazerGeracao(&s->gerador, d, retirarDoFim(fila));
+            devolverAFrente(fila, d->opcao == 1 ? d->descartada : pop(pilha));
+            break;
+        }
+        case 3:
+            push(pilha, d->descartada);
+            break;
+        case 4: {
+            Peca doFim = retirarDoFim(fila);
+            Peca daFila = pop(pilha);
+            push(pilha, doFim);
+            devolverAFrente(fila, daFila);
+            break;
+        }
+        case 5:
+            aplicarTrocaMultipla(fila, pilha);
+            break;
+    }
+    
+    h->atual--;
+    *opcao = d->opcao;
+    CONFERIR_HASH_FILA(fila);
+    CONFERIR_HASH_PILHA(pilha);
+    return RES_OK;
+}
+
+/*
+ * aplicarRefazer()
+ * Repete a operacao desfeita. Desfazer deixou a sessao (gerador
+ * inclusive) exatamente como antes dela, entao repetir reproduz o
+ * mesmo resultado e o delta guardado continua valido.
+ */
+static inline Resultado aplicarRefazer(Sessao* s, Historico* h, int* opcao) {
+    if (h->atual == h->fim) return RES_NADA_A_REFAZER;
+    const DeltaOperacao* d = &h->entradas[h->atual % TAM_HISTORICO];
+    Peca p;
+    executarOperacao(s, d->opcao, &p);
+    h->atual++;
+    *opcao = d->opcao;
+    return RES_OK;
+}
+
+/*
+ * desfazer() / refazer()
+ * Contadas como operacoes 6 e 7 com -DINSTRUMENTAR. A operacao que o
+ * refazer repete passa por executarOperacao e conta tambem no seu codigo.
+ */
+Resultado desfazer(Sessao* s, Historico* h, int* opcao) {
+    INICIAR_MEDICAO(inicio);
+    Resultado r = aplicarDesfazer(s, h, opcao);
+    REGISTRAR_OPERACAO(s, 6, r, inicio);
+    return r;
+}
+
+Resultado refazer(Sessao* s, Historico* h, int* opcao) {
+    INICIAR_MEDICAO(inicio);
+    Resultado r = aplicarRefazer(s, h, opcao);
+    REGISTRAR_OPERACAO(s, 7, r, inicio);
+    return r;
+}
+
+// ==================== SESSAO ====================
+
+/*
+ * iniciarSessao()
+ * Prepara uma sessao sobre uma arena ja alocada e enche a fila
+ */
+void iniciarSessao(Sessao* s, const Configuracao* cfg, Peca* arena, uint64_t semente) {
+    s->arena = arena;
+#ifdef INSTRUMENTAR
+    memset(&s->contadores, 0, sizeof(s->contadores));
+#endif
+    ligarArena(&s->fila, &s->pilha, cfg, arena);
+    iniciarGeradorPecas(&s->gerador, cfg->politica, semente);
+    reporFila(&s->fila, &s->gerador);
+}
+
+/*
+ * criarSessao()
+ * Sessao avulsa com arena propria. Retorna 0 se faltar memoria.
+ */
+int criarSessao(Sessao* s, const Configuracao* cfg, uint64_t semente) {
+    Peca* arena = malloc(sizeof(Peca) * tamanhoArena(cfg));
+    if (arena == NULL) return 0;
+    iniciarSessao(s, cfg, arena, semente);
+    return 1;
+}
+
+void destruirSessao(Sessao* s) {
+    free(s->arena);
+    s->arena = NULL;
+}
+
+/*
+ * resumoSessao()
+ * FNV-1a de tudo que determina o futuro da sessao: pecas da fila (em
+ * ordem), da pilha e o estado do gerador. Usado nos checkpoints.
+ */
+uint64_t resumoSessao(const Sessao* s) {
+    const GeradorPecas* g = &s->gerador;
+    uint64_t h = FNV_BASE;
+    uint64_t valores[6] = {
+        g->aleatorio.estado, g->proximoId, (uint64_t)g->posSaco, (uint64_t)g->tamSaco,
+        g->historico, ((uint64_t)(s->fila.tras - s->fila.frente) << 32) | (uint32_t)(s->pilha.topo + 1)
+    };
+    for (int i = 0; i < 6; i++) h = (h ^ valores[i]) * FNV_PRIMO;
+    for (unsigned int i = s->fila.frente; i != s->fila.tras; i++) {
+        h = (h ^ s->fila.elementos[i & s->fila.mascara]) * FNV_PRIMO;
+    }
+    for (int i = 0; i <= s->pilha.topo; i++) {
+        h = (h ^ s->pilha.elementos[i]) * FNV_PRIMO;
+    }
+    for (int i = g->posSaco; i < g->tamSaco; i++) {
+        h = (h ^ g->saco[i]) * FNV_PRIMO;
+    }
+    return h;
+}
+
+// ==================== SNAPSHOT E CHECKPOINTS ====================
+
+/*
+ * salvarSnapshot()
+ * Copia o estado completo da sessao para o bloco. As posicoes de pecas
+ * alem da arena ficam zeradas para o arquivo gravado ser deterministico.
+ */
+void salvarSnapshot(const Sessao* s, SnapshotSessao* snap) {
+    size_t usadas = (size_t)(s->fila.mascara + 1) + (size_t)s->pilha.capacidade;
+    
+    snap->magico = SNAPSHOT_MAGICO;
+    snap->versao = SNAPSHOT_VERSAO;
+    snap->tamFila = (uint8_t)s->fila.capacidade;
+    snap->tamPilha = (uint8_t)s->pilha.capacidade;
+    snap->frente = s->fila.frente;
+    snap->tras = s->fila.tras;
+    snap->topo = s->pilha.topo;
+    snap->gerador = s->gerador;
+    memcpy(snap->pecas, s->arena, sizeof(Peca) * usadas);
+    memset(snap->pecas + usadas, 0, sizeof(snap->pecas) - sizeof(Peca) * usadas);
+}
+
+/*
+ * restaurarSnapshot()
+ * Volta a sessao ao estado salvo. A sessao tem que ter as mesmas
+ * capacidades do snapshot; retorna 0 (sem alterar nada) se nao tiver
+ * ou se o bloco for de outra versao.
+ */
+int restaurarSnapshot(Sessao* s, const SnapshotSessao* snap) {
+    if (snap->magico != SNAPSHOT_MAGICO || snap->versao != SNAPSHOT_VERSAO) return 0;
+    if (snap->tamFila != s->fila.capacidade || snap->tamPilha != s->pilha.capacidade) return 0;
+    
+    size_t usadas = (size_t)(s->fila.mascara + 1) + (size_t)s->pilha.capacidade;
+    memcpy(s->arena, snap->pecas, sizeof(Peca) * usadas);
+    s->fila.frente = snap->frente;
+    s->fila.tras = snap->tras;
+    s->pilha.topo = snap->topo;
+    s->gerador = snap->gerador;
+    recalcularHashes(&s->fila, &s->pilha);
+    return 1;
+}
+
+int gravarSnapshot(const SnapshotSessao* snap, const char* caminho) {
+    FILE* f = fopen(caminho, "wb");
+    if (f == NULL) return 0;
+    int ok = fwrite(snap, sizeof(*snap), 1, f) == 1;
+    if (fclose(f) != 0) ok = 0;
+    return ok;
+}
+
+/*
+ * lerSnapshot()
+ * Le um bloco gravado por gravarSnapshot e confere versao e limites.
+ * Retorna 0 se o arquivo nao for um snapshot valido.
+ */
+int lerSnapshot(SnapshotSessao* snap, const char* caminho) {
+    FILE* f = fopen(caminho, "rb");
+    if (f == NULL) return 0;
+    int ok = fread(snap, sizeof(*snap), 1, f) == 1;
+    fclose(f);
+    
+    if (!ok || snap->magico != SNAPSHOT_MAGICO || snap->versao != SNAPSHOT_VERSAO) return 0;
+    if (snap->tamFila < 1 || snap->tamFila > FILA_MAX) return 0;
+    if (snap->tamPilha < 1 || snap->tamPilha > PILHA_MAX) return 0;
+    if (snap->tras - snap->frente > snap->tamFila) return 0;
+    if (snap->topo < -1 || snap->topo >= snap->tamPilha) return 0;
+    if ((unsigned)snap->gerador.politica >= NUM_POLITICAS) return 0;
+    return snap->gerador.posSaco >= 0 && snap->gerador.posSaco <= snap->gerador.tamSaco &&
+           snap->gerador.tamSaco <= TAM_SACO_MAX;
+}
+
+/*
+ * criarArmazem()
+ * Reserva 'capacidade' snapshots de uma vez. Retorna 0 se faltar memoria.
+ */
+int criarArmazem(ArmazemCheckpoints* a, int capacidade) {
+    a->capacidade = capacidade;
+    a->snapshots = malloc(sizeof(SnapshotSessao) * capacidade);
+    a->referencias = malloc(sizeof(uint32_t) * capacidade);
+    a->livres = malloc(sizeof(int) * capacidade);
+    if (!a->snapshots || !a->referencias || !a->livres) {
+        destruirArmazem(a);
+        return 0;
+    }
+    for (int i = 0; i < capacidade; i++) {
+        a->livres[i] = capacidade - 1 - i;
+        a->referencias[i] = 0;
+    }
+    a->numLivres = capacidade;
+    return 1;
+}
+
+void destruirArmazem(ArmazemCheckpoints* a) {
+    free(a->snapshots);
+    free(a->referencias);
+    free(a->livres);
+    a->snapshots = NULL;
+    a->referencias = NULL;
+    a->livres = NULL;
+    a->numLivres = 0;
+}
+
+/*
+ * checkpointSalvar()
+ * Novo checkpoint com uma referencia. Retorna o id ou -1 se o
+ * armazem estiver cheio.
+ */
+int checkpointSalvar(ArmazemCheckpoints* a, const Sessao* s) {
+    if (a->numLivres == 0) return -1;
+    int id = a->livres[--a->numLivres];
+    salvarSnapshot(s, &a->snapshots[id]);
+    a->referencias[id] = 1;
+    return id;
+}
+
+// O(1): mais um dono para o mesmo checkpoint, sem copiar nada
+int checkpointCompartilhar(ArmazemCheckpoints* a, int id) {
+    a->referencias[id]++;
+    return id;
+}
+
+// Solta uma referencia; o slot volta ao pool quando nao sobra nenhuma
+void checkpointLiberar(ArmazemCheckpoints* a, int id) {
+    if (a->referencias[id] == 0) return;
+    if (--a->referencias[id] == 0) a->livres[a->numLivres++] = id;
+}
+
+int checkpointRestaurar(const ArmazemCheckpoints* a, int id, Sessao* s) {
+    return restaurarSnapshot(s, &a->snapshots[id]);
+}
+
+// ==================== MOTOR DE SESSOES ====================
+
+/*
+ * criarMotor()
+ * Aloca de uma vez o slab de sessoes, as arenas e os indices.
+ * Retorna 0 se faltar memoria.
+ */
+int criarMotor(Motor* m, const Configuracao* cfg, int capacidade) {
+    m->cfg = *cfg;
+    m->capacidade = capacidade;
+    m->pecasPorSessao = tamanhoArena(cfg);
+    m->sessoes = malloc(sizeof(Sessao) * capacidade);
+    m->armazenamento = malloc(sizeof(Peca) * m->pecasPorSessao * capacidade);
+    m->livres = malloc(sizeof(int) * capacidade);
+    m->ativas = malloc(sizeof(int) * capacidade);
+    m->posicaoAtiva = malloc(sizeof(int) * capacidade);
+    if (!m->sessoes || !m->armazenamento || !m->livres || !m->ativas || !m->posicaoAtiva) {
+        destruirMotor(m);
+        return 0;
+    }
+    
+    // Indices livres empilhados ao contrario: a primeira sessao criada e a 0
+    for (int i = 0; i < capacidade; i++) {
+        m->livres[i] = capacidade - 1 - i;
+        m->posicaoAtiva[i] = -1;
+    }
+    m->numLivres = capacidade;
+    m->numAtivas = 0;
+    return 1;
+}
+
+void destruirMotor(Motor* m) {
+    free(m->sessoes);
+    free(m->armazenamento);
+    free(m->livres);
+    free(m->ativas);
+    free(m->posicaoAtiva);
+    m->sessoes = NULL;
+    m->armazenamento = NULL;
+    m->livres = m->ativas = m->posicaoAtiva = NULL;
+    m->numAtivas = m->numLivres = 0;
+}
+
+/*
+ * motorCriarSessao()
+ * Retorna o identificador da nova sessao ou -1 se o pool estiver cheio
+ */
+int motorCriarSessao(Motor* m, uint64_t semente) {
+    if (m->numLivres == 0) return -1;
+    int id = m->livres[--m->numLivres];
+    iniciarSessao(&m->sessoes[id], &m->cfg,
+                  m->armazenamento + (size_t)id * m->pecasPorSessao, semente);
+    m->posicaoAtiva[id] = m->numAtivas;
+    m->ativas[m->numAtivas++] = id;
+    return id;
+}
+
+/*
+ * motorDestruirSessao()
+ * Devolve a sessao ao pool; a ultima ativa ocupa o lugar dela
+ */
+void motorDestruirSessao(Motor* m, int id) {
+    int pos = m->posicaoAtiva[id];
+    if (pos < 0) return;
+    int ultima = m->ativas[--m->numAtivas];
+    m->ativas[pos] = ultima;
+    m->posicaoAtiva[ultima] = pos;
+    m->posicaoAtiva[id] = -1;
+    m->livres[m->numLivres++] = id;
+}
+
+Sessao* motorSessao(Motor* m, int id) {
+    return m->posicaoAtiva[id] >= 0 ? &m->sessoes[id] : NULL;
+}
+
+/*
+ * motorPasso()
+ * Aplica em cada sessao ativa a opcao opcoes[id] (0 = nenhuma).
+ * Retorna quantas operacoes terminaram com RES_OK.
+ */
+unsigned long motorPasso(Motor* m, const unsigned char* opcoes) {
+    unsigned long ok = 0;
+    Peca p;
+    for (int i = 0; i < m->numAtivas; i++) {
+        int id = m->ativas[i];
+        if (opcoes[id] == 0) continue;
+        ok += (executarOperacao(&m->sessoes[id], opcoes[id], &p) == RES_OK);
+    }
+    return ok;
+}
+
+// ==================== MOTOR SoA ====================
+
+/*
+ * criarMotorSoA()
+ * Cria numSessoes sessoes com fila cheia e pilha vazia. A sessao i usa
+ * a semente sementeBase + i. Retorna 0 se faltar memoria ou se a
+ * politica nao for GERADOR_UNIFORME (o lote so sorteia pecas uniformes).
+ */
+int criarMotorSoA(MotorSoA* m, const Configuracao* cfg, int numSessoes, uint64_t sementeBase) {
+    size_t n = (size_t)numSessoes;
+    memset(m, 0, sizeof(*m));
+    if (cfg->politica != GERADOR_UNIFORME) return 0;
+    m->numSessoes = numSessoes;
+    m->tamFila = cfg->tamFila;
+    m->tamPilha = cfg->tamPilha;
+    m->fisicoFila = potenciaDe2(cfg->tamFila);
+    m->mascara = m->fisicoFila - 1;
+    m->frente = malloc(sizeof(uint32_t) * n);
+    m->tras = malloc(sizeof(uint32_t) * n);
+    m->topo = malloc(sizeof(int32_t) * n);
+    m->estadoAleatorio = malloc(sizeof(uint64_t) * n);
+    m->incremento = malloc(sizeof(uint64_t) * n);
+    m->proximoId = malloc(sizeof(uint32_t) * n);
+    m->pecasFila = malloc(sizeof(Peca) * n * m->fisicoFila);
+    m->pecasPilha = malloc(sizeof(Peca) * n * (cfg->tamPilha + 1));
+    m->novas = malloc(sizeof(Peca) * n);
+    m->ok = malloc(sizeof(uint32_t) * n);
+    if (!m->frente || !m->tras || !m->topo || !m->estadoAleatorio || !m->incremento ||
+        !m->proximoId || !m->pecasFila || !m->pecasPilha || !m->novas || !m->ok) {
+        destruirMotorSoA(m);
+        return 0;
+    }
+    
+    for (size_t i = 0; i < n; i++) {
+        GeradorAleatorio g;
+        semearGerador(&g, sementeBase + i, 0);
+        m->frente[i] = 0;
+        m->tras[i] = 0;
+        m->topo[i] = -1;
+        m->proximoId[i] = 0;
+        Peca* fila = m->pecasFila + i * m->fisicoFila;
+        for (int k = 0; k < cfg->tamFila; k++) {
+            uint32_t tipo = (uint32_t)(((uint64_t)proximoAleatorio(&g) * NUM_TIPOS) >> 32);
+            fila[m->tras[i]++ & m->mascara] = criarPeca(tipo, m->proximoId[i]++);
+        }
+        m->estadoAleatorio[i] = g.estado;
+        m->incremento[i] = g.incremento;
+    }
+    return 1;
+}
+
+void destruirMotorSoA(MotorSoA* m) {
+    free(m->frente);
+    free(m->tras);
+    free(m->topo);
+    free(m->estadoAleatorio);
+    free(m->incremento);
+    free(m->proximoId);
+    free(m->pecasFila);
+    free(m->pecasPilha);
+    free(m->novas);
+    free(m->ok);
+    memset(m, 0, sizeof(*m));
+}
+
+/*
+ * sortearTipoSoA()
+ * Um passo do PCG32 da sessao i e o tipo uniforme correspondente.
+ * Multiplica e desloca sem rejeicao (vies < 7/2^32) para nao ter
+ * desvio dentro do laco vetorizado.
+ */
+static inline uint32_t sortearTipoSoA(uint64_t* estado, uint64_t incremento) {
+    uint64_t anterior = *estado;
+    *estado = anterior * 6364136223846793005ULL + incremento;
+    uint32_t xorDeslocado = (uint32_t)(((anterior >> 18) ^ anterior) >> 27);
+    uint32_t rotacao = (uint32_t)(anterior >> 59);
+    uint32_t x = (xorDeslocado >> rotacao) | (xorDeslocado << ((-rotacao) & 31));
+    return (uint32_t)(((uint64_t)x * NUM_TIPOS) >> 32);
+}
+
+/*
+ * soaGerarNovas()
+ * Sorteia uma peca nova por sessao em m->novas. Sessoes com ativas[i]
+ * == 0 nao avancam o gerador nem o contador de ids.
+ */
+static void soaGerarNovas(MotorSoA* m, const uint32_t* restrict ativas) {
+    const int n = m->numSessoes;
+    uint64_t* restrict estado = m->estadoAleatorio;
+    const uint64_t* restrict incremento = m->incremento;
+    uint32_t* restrict proximoId = m->proximoId;
+    Peca* restrict novas = m->novas;
+    
+    for (int i = 0; i < n; i++) {
+        uint64_t anterior = estado[i];
+        uint32_t tipo = sortearTipoSoA(&estado[i], incremento[i]);
+        uint32_t ok = ativas ? ativas[i] : 1;
+        estado[i] = ok ? estado[i] : anterior;
+        novas[i] = criarPeca(tipo, proximoId[i]);
+        proximoId[i] += ok;
+    }
+}
+
+/*
+ * soaJogarTodas()
+ * Opcao 1 em todas as sessoes: tira a frente (guardada em jogadas[i]) e
+ * repoe uma peca nova no final. Como a fila esta sempre cheia, nao ha
+ * desvio por sessao. Feito em tres passadas: leitura das frentes,
+ * sorteio das novas e escrita no final das filas.
+ */
+void soaJogarTodas(MotorSoA* m, Peca* restrict jogadas) {
+    const int n = m->numSessoes;
+    const uint32_t fisico = m->fisicoFila;
+    const uint32_t mascara = m->mascara;
+    uint32_t* restrict frente = m->frente;
+    uint32_t* restrict tras = m->tras;
+    Peca* restrict pecas = m->pecasFila;
+    const Peca* restrict novas = m->novas;
+    
+    for (int i = 0; i < n; i++) {
+        jogadas[i] = pecas[(uint32_t)i * fisico + (frente[i] & mascara)];
+        frente[i]++;
+    }
+    
+    soaGerarNovas(m, NULL);
+    
+    for (int i = 0; i < n; i++) {
+        pecas[(uint32_t)i * fisico + (tras[i] & mascara)] = novas[i];
+        tras[i]++;
+    }
+}
+
+/*
+ * soaReservarTodas()
+ * Opcao 2 em todas as sessoes. Sem desvios: onde a pilha esta cheia
+ * (ok[i] = 0) a peca vai para a posicao de descarte, a fila e reescrita
+ * com o mesmo valor e os contadores somam 0. Retorna quantas sessoes
+ * reservaram.
+ */
+unsigned long soaReservarTodas(MotorSoA* m) {
+    const int n = m->numSessoes;
+    const uint32_t fisico = m->fisicoFila;
+    const uint32_t mascara = m->mascara;
+    const uint32_t ladoPilha = (uint32_t)m->tamPilha + 1;
+    const int32_t ultimo = m->tamPilha - 1;
+    uint32_t* restrict frente = m->frente;
+    uint32_t* restrict tras = m->tras;
+    int32_t* restrict topo = m->topo;
+    Peca* restrict pecas = m->pecasFila;
+    Peca* restrict pilhas = m->pecasPilha;
+    const Peca* restrict novas = m->novas;
+    uint32_t* restrict ok = m->ok;
+    unsigned long total = 0;
+    
+    for (int i = 0; i < n; i++) {
+        ok[i] = topo[i] < ultimo;
+        total += ok[i];
+    }
+    
+    for (int i = 0; i < n; i++) {
+        uint32_t posPilha = ok[i] ? (uint32_t)(topo[i] + 1) : (uint32_t)m->tamPilha;
+        pilhas[(uint32_t)i * ladoPilha + posPilha] = pecas[(uint32_t)i * fisico + (frente[i] & mascara)];
+        topo[i] += (int32_t)ok[i];
+        frente[i] += ok[i];
+    }
+    
+    // Repoe a fila so onde houve reserva
+    soaGerarNovas(m, ok);
+    
+    for (int i = 0; i < n; i++) {
+        Peca* destino = &pecas[(uint32_t)i * fisico + (tras[i] & mascara)];
+        *destino = ok[i] ? novas[i] : *destino;
+        tras[i] += ok[i];
+    }
+    return total;
+}
+
+/*
+ * soaUsarTodas()
+ * Opcao 3 em todas as sessoes. usadas[i] recebe a peca ou PECA_NENHUMA
+ * se a pilha estava vazia. Retorna quantas sessoes usaram uma peca.
+ */
+unsigned long soaUsarTodas(MotorSoA* m, Peca* restrict usadas) {
+    const int n = m->numSessoes;
+    const uint32_t ladoPilha = (uint32_t)m->tamPilha + 1;
+    int32_t* restrict topo = m->topo;
+    const Peca* restrict pilhas = m->pecasPilha;
+    unsigned long total = 0;
+    
+    for (int i = 0; i < n; i++) {
+        uint32_t ok = topo[i] >= 0;
+        uint32_t pos = ok ? (uint32_t)topo[i] : (uint32_t)m->tamPilha;
+        Peca p = pilhas[(uint32_t)i * ladoPilha + pos];
+        usadas[i] = ok ? p : PECA_NENHUMA;
+        topo[i] -= (int32_t)ok;
+        total += ok;
+    }
+    return total;
+}
+
+// ==================== ESCALONADOR ====================
+
+/*
+ * executarTarefa()
+ * Aplica todos os passos do roteiro as sessoes do bloco 'tarefa'.
+ * O passo p da sessao id e roteiro[p * capacidade + id] (0 = nenhuma).
+ */
+static unsigned long executarTarefa(Escalonador* e, int tarefa) {
+    Motor* m = e->motor;
+    int inicio = tarefa * e->tamBloco;
+    int fim = inicio + e->tamBloco;
+    if (fim > m->numAtivas) fim = m->numAtivas;
+    
+    unsigned long ok = 0;
+    Peca p;
+    for (int passo = 0; passo < e->numPassos; passo++) {
+        const unsigned char* opcoes = e->roteiro + (size_t)passo * m->capacidade;
+        for (int i = inicio; i < fim; i++) {
+            int id = m->ativas[i];
+            if (opcoes[id] == 0) continue;
+            ok += (executarOperacao(&m->sessoes[id], opcoes[id], &p) == RES_OK);
+        }
+    }
+    return ok;
+}
+
+// Dono: proxima tarefa pelo inicio da propria deque
+static int retirarTarefa(FilaTrabalho* f, int* tarefa) {
+    int achou = 0;
+    pthread_mutex_lock(&f->trava);
+    if (f->inicio < f->fim) {
+        *tarefa = f->inicio++;
+        achou = 1;
+    }
+    pthread_mutex_unlock(&f->trava);
+    return achou;
+}
+
+// Ladrao: ultima tarefa da deque de outro trabalhador
+static int roubarTarefa(FilaTrabalho* vitima, int* tarefa) {
+    int achou = 0;
+    pthread_mutex_lock(&vitima->trava);
+    if (vitima->inicio < vitima->fim) {
+        *tarefa = --vitima->fim;
+        achou = 1;
+    }
+    pthread_mutex_unlock(&vitima->trava);
+    return achou;
+}
+
+/*
+ * trabalhar()
+ * Esvazia a propria deque e depois rouba, comecando por uma vitima
+ * sorteada. Nenhuma tarefa e criada durante a rodada, entao quando
+ * todas as deques estao vazias o trabalho acabou.
+ */
+static void trabalhar(Escalonador* e, int indice) {
+    FilaTrabalho* propria = &e->filas[indice];
+    int n = e->numTrabalhadores;
+    int tarefa;
+    
+    for (;;) {
+        if (retirarTarefa(propria, &tarefa)) {
+            propria->ok += executarTarefa(e, tarefa);
+            continue;
+        }
+        
+        int roubou = 0;
+        if (n > 1) {
+            uint32_t x = propria->sorteio;
+            x ^= x << 13;
+            x ^= x >> 17;
+            x ^= x << 5;
+            propria->sorteio = x;
+            int primeira = (int)(x % (uint32_t)n);
+            for (int k = 0; k < n && !roubou; k++) {
+                int v = (primeira + k) % n;
+                if (v != indice) roubou = roubarTarefa(&e->filas[v], &tarefa);
+            }
+        }
+        if (!roubou) return;
+        propria->roubos++;
+        propria->ok += executarTarefa(e, tarefa);
+    }
+}
+
+// Laco das threads 1..numTrabalhadores-1: espera rodada, trabalha, avisa
+static void* lacoTrabalhador(void* arg) {
+    FilaTrabalho* f = arg;
+    Escalonador* e = f->dono;
+    int indice = (int)(f - e->filas);
+    unsigned int vista = 0;
+    
+    pthread_mutex_lock(&e->trava);
+    for (;;) {
+        while (e->geracao == vista && !e->encerrar) {
+            pthread_cond_wait(&e->inicioRodada, &e->trava);
+        }
+        if (e->encerrar) break;
+        vista = e->geracao;
+        pthread_mutex_unlock(&e->trava);
+        
+        trabalhar(e, indice);
+        
+        pthread_mutex_lock(&e->trava);
+        if (--e->restantes == 0) pthread_cond_signal(&e->fimRodada);
+    }
+    pthread_mutex_unlock(&e->trava);
+    return NULL;
+}
+
+/*
+ * criarEscalonador()
+ * Sobe numTrabalhadores - 1 threads (a chamadora e o trabalhador 0).
+ * tamBloco <= 0 usa TAM_BLOCO_PADRAO. Retorna 0 em caso de falha.
+ */
+int criarEscalonador(Escalonador* e, Motor* motor, int numTrabalhadores, int tamBloco) {
+    memset(e, 0, sizeof(*e));
+    if (numTrabalhadores < 1) numTrabalhadores = 1;
+    e->motor = motor;
+    e->numTrabalhadores = numTrabalhadores;
+    e->tamBloco = tamBloco > 0 ? tamBloco : TAM_BLOCO_PADRAO;
+    e->filas = aligned_alloc(TAM_LINHA_CACHE, sizeof(FilaTrabalho) * numTrabalhadores);
+    e->threads = malloc(sizeof(pthread_t) * numTrabalhadores);
+    if (e->filas == NULL || e->threads == NULL) {
+        free(e->filas);
+        free(e->threads);
+        e->filas = NULL;
+        e->threads = NULL;
+        return 0;
+    }
+    
+    pthread_mutex_init(&e->trava, NULL);
+    pthread_cond_init(&e->inicioRodada, NULL);
+    pthread_cond_init(&e->fimRodada, NULL);
+    for (int i = 0; i < numTrabalhadores; i++) {
+        FilaTrabalho* f = &e->filas[i];
+        pthread_mutex_init(&f->trava, NULL);
+        f->inicio = f->fim = 0;
+        f->ok = f->roubos = 0;
+        f->sorteio = 2463534242u + 0x9E3779B9u * (uint32_t)i;
+        f->dono = e;
+    }
+    
+    for (int i = 1; i < numTrabalhadores; i++) {
+        if (pthread_create(&e->threads[i - 1], NULL, lacoTrabalhador, &e->filas[i]) != 0) {
+            destruirEscalonador(e);
+            return 0;
+        }
+        e->numThreads++;
+    }
+    return 1;
+}
+
+void destruirEscalonador(Escalonador* e) {
+    if (e->filas != NULL) {
+        pthread_mutex_lock(&e->trava);
+        e->encerrar = 1;
+        pthread_cond_broadcast(&e->inicioRodada);
+        pthread_mutex_unlock(&e->trava);
+        for (int i = 0; i < e->numThreads; i++) {
+            pthread_join(e->threads[i], NULL);
+        }
+        for (int i = 0; i < e->numTrabalhadores; i++) {
+            pthread_mutex_destroy(&e->filas[i].trava);
+        }
+        pthread_cond_destroy(&e->fimRodada);
+        pthread_cond_destroy(&e->inicioRodada);
+        pthread_mutex_destroy(&e->trava);
+    }
+    free(e->filas);
+    free(e->threads);
+    e->filas = NULL;
+    e->threads = NULL;
+    e->numThreads = 0;
+}
+
+/*
+ * escalonadorExecutar()
+ * Executa numPassos passos do roteiro (numPassos linhas de
+ * motor->capacidade opcoes, indexadas pelo identificador da sessao) em
+ * todas as sessoes ativas e so retorna quando todas terminaram. As
+ * tarefas comecam divididas em partes iguais e contiguas; quem acaba
+ * antes rouba do fim da deque dos outros. Retorna quantas operacoes
+ * terminaram com RES_OK.
+ */
+unsigned long escalonadorExecutar(Escalonador* e, const unsigned char* roteiro, int numPassos) {
+    int n = e->numTrabalhadores;
+    int numTarefas = (e->motor->numAtivas + e->tamBloco - 1) / e->tamBloco;
+    
+    e->roteiro = roteiro;
+    e->numPassos = numPassos;
+    e->numTarefas = numTarefas;
+    for (int i = 0; i < n; i++) {
+        FilaTrabalho* f = &e->filas[i];
+        f->inicio = (int)((long)numTarefas * i / n);
+        f->fim = (int)((long)numTarefas * (i + 1) / n);
+        f->ok = 0;
+    }
+    
+    // A trava publica o roteiro e as deques para as outras threads
+    pthread_mutex_lock(&e->trava);
+    e->restantes = n - 1;
+    e->geracao++;
+    pthread_cond_broadcast(&e->inicioRodada);
+    pthread_mutex_unlock(&e->trava);
+    
+    trabalhar(e, 0);
+    
+    pthread_mutex_lock(&e->trava);
+    while (e->restantes > 0) {
+        pthread_cond_wait(&e->fimRodada, &e->trava);
+    }
+    pthread_mutex_unlock(&e->trava);
+    
+    unsigned long ok = 0;
+    for (int i = 0; i < n; i++) ok += e->filas[i].ok;
+    return ok;
+}
+
+// ==================== TABULEIRO ====================
+
+// As 4 linhas a partir de y numa palavra (linha y nos 16 bits de baixo)
+static inline uint64_t lerQuatroLinhas(const Tabuleiro* t, int y) {
+    const uint16_t* l = &t->linhas[y + TAB_CHAO];
+    return (uint64_t)l[0] | (uint64_t)l[1] << 16 | (uint64_t)l[2] << 32 | (uint64_t)l[3] << 48;
+}
+
+static inline void escreverQuatroLinhas(Tabuleiro* t, int y, uint64_t q) {
+    uint16_t* l = &t->linhas[y + TAB_CHAO];
+    l[0] = (uint16_t)q;
+    l[1] = (uint16_t)(q >> 16);
+    l[2] = (uint16_t)(q >> 32);
+    l[3] = (uint16_t)(q >> 48);
+}
+
+// Linha mais baixa / mais alta da caixa com algum bloco
+static inline int linhaMaisBaixa(uint64_t forma) {
+    int r = 0;
+    while (((forma >> (16 * r)) & 0xF) == 0) r++;
+    return r;
+}
+
+static inline int linhaMaisAlta(uint64_t forma) {
+    int r = 3;
+    while (((forma >> (16 * r)) & 0xF) == 0) r--;
+    return r;
+}
+
+// y da caixa na entrada: a linha mais baixa da peca logo acima do campo visivel
+static inline int ySurgir(uint64_t forma) {
+    return TAB_VISIVEL - linhaMaisBaixa(forma);
+}
+
+/*
+ * limparCampo()
+ * Zera o campo (paredes, chao e folga) sem mexer nas estatisticas
+ */
+void limparCampo(Tabuleiro* t) {
+    for (int i = 0; i < TAB_CHAO; i++) t->linhas[i] = TAB_LINHA_CHEIA;
+    for (int i = TAB_CHAO; i < TAB_LINHAS; i++) t->linhas[i] = TAB_LINHA_VAZIA;
+    t->altura = 0;
+}
+
+void iniciarTabuleiro(Tabuleiro* t) {
+    limparCampo(t);
+    t->pecas = t->linhasLimpas = t->derrotas = 0;
+}
+
+/*
+ * colideTabuleiro()
+ * A peca com a caixa em (x, y) bate em bloco, parede ou chao? Um AND de
+ * 64 bits: as linhas da forma ficam nas mesmas posicoes das 4 linhas do
+ * campo e o deslocamento por x vale para as quatro de uma vez.
+ * x em [TAB_X_MIN, TAB_X_MAX], y em [-TAB_CHAO, TAB_ALTURA].
+ */
+static inline int colide(const Tabuleiro* t, uint64_t forma, int x, int y) {
+    return (lerQuatroLinhas(t, y) & (forma << (x + TAB_PAREDE))) != 0;
+}
+
+int colideTabuleiro(const Tabuleiro* t, uint64_t forma, int x, int y) {
+    return colide(t, forma, x, y);
+}
+
+/*
+ * fixarPeca()
+ * Grava a peca em (x, y) com um OR e remove as linhas que ficaram
+ * cheias. Uma linha cheia e uma pista de 16 bits toda ligada: invertida
+ * vira zero, e o teste de zero por pista acha as quatro de uma vez.
+ * Retorna quantas linhas foram limpas (0-4).
+ */
+int fixarPeca(Tabuleiro* t, uint64_t forma, int x, int y) {
+    uint64_t q = lerQuatroLinhas(t, y) | (forma << (x + TAB_PAREDE));
+    escreverQuatroLinhas(t, y, q);
+    
+    int topo = y + linhaMaisAlta(forma) + 1;
+    if (topo > t->altura) t->altura = topo;
+    t->pecas++;
+    
+    // Bit 15 de cada pista ligado se a pista de ~q e zero (linha cheia)
+    uint64_t v = ~q;
+    uint64_t cheias = ~(((v & TAB_PISTAS_7FFF) + TAB_PISTAS_7FFF) | v | TAB_PISTAS_7FFF);
+    if (y < 0) cheias &= ~0ULL << (16 * -y);    // O chao nao conta
+    if (cheias == 0) return 0;
+    
+    // Compacta: cada linha que sobra desce sobre as removidas
+    int limpas = 0;
+    int escrita = y < 0 ? 0 : y;
+    for (int leitura = escrita; leitura < t->altura; leitura++) {
+        int k = leitura - y;
+        if (k < 4 && ((cheias >> (16 * k + 15)) & 1)) {
+            limpas++;
+            continue;
+        }
+        t->linhas[TAB_CHAO + escrita++] = t->linhas[TAB_CHAO + leitura];
+    }
+    for (int i = escrita; i < t->altura; i++) t->linhas[TAB_CHAO + i] = TAB_LINHA_VAZIA;
+    t->altura -= limpas;
+    t->linhasLimpas += limpas;
+    return limpas;
+}
+
+// y onde a peca para ao cair na coluna x. Acima de 'altura' nao ha
+// blocos, entao a queda comeca la e nao na entrada.
+static inline int yQueda(const Tabuleiro* t, uint64_t forma, int x) {
+    int y = ySurgir(forma);
+    int livre = t->altura - linhaMaisBaixa(forma);
+    if (livre < y) y = livre;
+    while (!colideTabuleiro(t, forma, x, y - 1)) y--;
+    return y;
+}
+
+/*
+ * soltarPeca()
+ * Queda direta (hard drop) da forma na coluna x a partir da entrada.
+ * Retorna as linhas limpas, ou -1 se a peca nem cabe na entrada.
+ */
+int soltarPeca(Tabuleiro* t, uint64_t forma, int x) {
+    if (colideTabuleiro(t, forma, x, ySurgir(forma))) return -1;
+    return fixarPeca(t, forma, x, yQueda(t, forma, x));
+}
+
+/*
+ * colocarPeca()
+ * Destino das pecas jogadas (opcao 1) e usadas (opcao 3): cai, na
+ * orientacao de entrada, na coluna em que o topo dela fica mais baixo
+ * (empate: a mais a esquerda). Sem nenhuma coluna livre na entrada e
+ * derrota: o campo e zerado e a peca entra nele. Retorna as linhas
+ * limpas.
+ */
+int colocarPeca(Tabuleiro* t, Peca p) {
+    uint64_t forma = FORMAS_TABULEIRO[tipoPeca(p)][0];
+    int entrada = ySurgir(forma);
+    int melhorX = 0;
+    int melhorY = TAB_ALTURA + 1;   // Mesma forma: y mais baixo = topo mais baixo
+    
+    for (int x = TAB_X_MIN; x <= TAB_X_MAX; x++) {
+        if (colideTabuleiro(t, forma, x, entrada)) continue;
+        int y = yQueda(t, forma, x);
+        if (y < melhorY) {
+            melhorX = x;
+            melhorY = y;
+        }
+    }
+    if (melhorY > TAB_ALTURA) {
+        t->derrotas++;
+        limparCampo(t);
+        melhorX = TAB_X_SURGIR;
+        melhorY = yQueda(t, forma, melhorX);
+    }
+    return fixarPeca(t, forma, melhorX, melhorY);
+}
+
+/*
+ * girarPeca()
+ * Rotacao SRS da peca em 'pos': a forma da rotacao seguinte e os chutes
+ * vem das tabelas e cada teste e um colideTabuleiro. Atualiza 'pos' com
+ * o primeiro teste que cabe e retorna o numero dele (1-5), ou 0 se
+ * nenhum cabe e a peca fica como estava.
+ */
+static inline int girar(const Tabuleiro* t, int tipo, PosicaoPeca* pos, int antiHorario) {
+    int destino = (pos->rotacao + (antiHorario ? 3 : 1)) & 3;
+    uint64_t forma = FORMAS_TABULEIRO[tipo][destino];
+    const ChuteSrs* chutes = CHUTES_SRS[tipo == 0][pos->rotacao][antiHorario != 0];
+    for (int k = 0; k < NUM_CHUTES; k++) {
+        int x = pos->x + chutes[k].x;
+        int y = pos->y + chutes[k].y;
+        if (x < TAB_X_MIN || x > TAB_X_MAX || y < -TAB_CHAO || y > TAB_ALTURA) continue;
+        if (!colide(t, forma, x, y)) {
+            pos->x = x;
+            pos->y = y;
+            pos->rotacao = destino;
+            return k + 1;
+        }
+    }
+    return 0;
+}
+
+int girarPeca(const Tabuleiro* t, int tipo, PosicaoPeca* pos, int antiHorario) {
+    return girar(t, tipo, pos, antiHorario);
+}
+
+// Posicoes x em que a forma cabe na linha y, todas de uma vez: bit
+// x + TAB_PAREDE ligado se nao bate. A coluna c da caixa bate quando o
+// bit x + TAB_PAREDE + c da linha esta ligado, ou seja, o bit x +
+// TAB_PAREDE de (linha >> c).
+static inline uint16_t posicoesLivres(const Tabuleiro* t, uint64_t forma, int y) {
+    unsigned int bate = 0;
+    for (int r = 0; r < 4; r++) {
+        unsigned int celulas = (unsigned int)(forma >> (16 * r)) & 0xF;
+        unsigned int linha = t->linhas[y + r + TAB_CHAO];
+        for (int c = 0; celulas; c++, celulas >>= 1) {
+            if (celulas & 1) bate |= linha >> c;
+        }
+    }
+    return (uint16_t)(~bate & ((1u << (TAB_X_MAX - TAB_X_MIN + 1)) - 1));
+}
+
+// Desloca um mapa de posicoes em dx colunas (as que saem somem)
+static inline unsigned int deslocarX(unsigned int bits, int dx) {
+    return dx >= 0 ? bits << dx : bits >> -dx;
+}
+
+/*
+ * Struct BuscaColocacoes:
+ * Estado do preenchimento: por rotacao e linha, as posicoes livres
+ * (calculadas so quando a linha e tocada), as alcancadas e as ja
+ * giradas, todas como mapas de bits de x; e a pilha de linhas que
+ * ganharam posicoes e precisam ser expandidas.
+ */
+typedef struct {
+    uint16_t livres[NUM_ROTACOES][TAB_LINHAS];
+    uint16_t alcancadas[NUM_ROTACOES][TAB_LINHAS];
+    uint16_t giradas[NUM_ROTACOES][TAB_LINHAS];
+    uint64_t calculadas[NUM_ROTACOES];      // Bit y + TAB_CHAO: 'livres' pronto
+    uint64_t pendentes[NUM_ROTACOES];       // Bit y + TAB_CHAO: expandir
+} BuscaColocacoes;
+
+static inline uint16_t livresEm(BuscaColocacoes* b, const Tabuleiro* t, int tipo, int rot, int y) {
+    int i = y + TAB_CHAO;
+    if (!((b->calculadas[rot] >> i) & 1)) {
+        b->livres[rot][i] = posicoesLivres(t, FORMAS_TABULEIRO[tipo][rot], y);
+        b->calculadas[rot] |= 1ULL << i;
+    }
+    return b->livres[rot][i];
+}
+
+// Junta 'novas' as alcancadas de (rot, y) e marca a linha para expandir
+static inline void alcancar(BuscaColocacoes* b, int rot, int y, unsigned int novas) {
+    int i = y + TAB_CHAO;
+    novas &= ~(unsigned int)b->alcancadas[rot][i];
+    if (novas == 0) return;
+    b->alcancadas[rot][i] |= (uint16_t)novas;
+    b->pendentes[rot] |= 1ULL << i;
+}
+
+/*
+ * expandirLinha()
+ * Fecha as alcancadas de (rot, y) para os lados dentro das livres, desce
+ * para a linha de baixo e gira as posicoes ainda nao giradas: cada
+ * teste de chute move todas as que sobraram de uma vez (deslocamento
+ * em x e mudanca de linha) e as que couberem param de tentar.
+ */
+static void expandirLinha(BuscaColocacoes* b, const Tabuleiro* t, int tipo, int rot, int y) {
+    int i = y + TAB_CHAO;
+    unsigned int livres = livresEm(b, t, tipo, rot, y);
+    unsigned int r = b->alcancadas[rot][i];
+    for (unsigned int antes = 0; r != antes; ) {
+        antes = r;
+        r |= ((r << 1) | (r >> 1)) & livres;
+    }
+    b->alcancadas[rot][i] = (uint16_t)r;
+    
+    if (y - 1 >= -TAB_CHAO) alcancar(b, rot, y - 1, r & livresEm(b, t, tipo, rot, y - 1));
+    
+    unsigned int girar = r & ~(unsigned int)b->giradas[rot][i];
+    b->giradas[rot][i] = (uint16_t)r;
+    for (int anti = 0; anti < 2 && girar; anti++) {
+        int destino = (rot + (anti ? 3 : 1)) & 3;
+        const ChuteSrs* chutes = CHUTES_SRS[tipo == 0][rot][anti];
+        unsigned int restantes = girar;
+        for (int k = 0; k < NUM_CHUTES && restantes; k++) {
+            int yd = y + chutes[k].y;
+            if (yd < -TAB_CHAO || yd > TAB_ALTURA) continue;
+            unsigned int cabem = deslocarX(restantes, chutes[k].x) & livresEm(b, t, tipo, destino, yd);
+            restantes &= ~deslocarX(cabem, -chutes[k].x);
+            alcancar(b, destino, yd, cabem);
+        }
+    }
+}
+
+/*
+ * enumerarColocacoes()
+ * Todas as posicoes finais (peca apoiada) que o tipo alcanca a partir
+ * da entrada com esquerda, direita, descer e girar (SRS, com chutes).
+ * E um preenchimento sobre (x, rotacao, y) em que cada linha (rotacao,
+ * y) e um mapa de bits de x, como o campo: mover para os lados, descer
+ * e cada teste de chute tratam a linha inteira com algumas operacoes
+ * de bits, ate nada mais mudar.
+ * Acima de altura + 2 so ha paredes: tudo la e alcancavel da entrada e
+ * os giros passam no primeiro teste ou nos laterais, entao o
+ * preenchimento comeca direto nessa linha, com todo (x, rotacao) que
+ * cabe entre as paredes, em vez de descer o ar linha por linha.
+ * Rotacoes que ocupam as mesmas celulas (O, I, S, Z) entram uma vez so,
+ * na forma canonica. 'saida' precisa de TAB_MAX_ESTADOS posicoes.
+ * Retorna quantas colocacoes achou (0 se a peca nem entra).
+ */
+int enumerarColocacoes(const Tabuleiro* t, int tipo, PosicaoPeca* saida) {
+    BuscaColocacoes b;
+    int entrada = ySurgir(FORMAS_TABULEIRO[tipo][0]);
+    if (colide(t, FORMAS_TABULEIRO[tipo][0], TAB_X_SURGIR, entrada)) return 0;
+    memset(b.alcancadas, 0, sizeof(b.alcancadas));
+    memset(b.giradas, 0, sizeof(b.giradas));
+    memset(b.calculadas, 0, sizeof(b.calculadas));
+    memset(b.pendentes, 0, sizeof(b.pendentes));
+    
+    int abertura = t->altura + 2;
+    if (abertura <= entrada) {
+        for (int rot = 0; rot < NUM_ROTACOES; rot++) {
+            alcancar(&b, rot, abertura, livresEm(&b, t, tipo, rot, abertura));
+        }
+    } else {
+        alcancar(&b, 0, entrada, 1u << (TAB_X_SURGIR + TAB_PAREDE));
+    }
+    
+    // Expande ate nao sobrar linha pendente (de cima para baixo)
+    for (int achou = 1; achou; ) {
+        achou = 0;
+        for (int rot = 0; rot < NUM_ROTACOES; rot++) {
+            while (b.pendentes[rot]) {
+                int i = 63 - __builtin_clzll(b.pendentes[rot]);
+                b.pendentes[rot] &= ~(1ULL << i);
+                expandirLinha(&b, t, tipo, rot, i - TAB_CHAO);
+                achou = 1;
+            }
+        }
+    }
+    
+    // Apoiadas: alcancadas que nao descem. Registra na forma canonica.
+    uint16_t registrado[NUM_ROTACOES][TAB_LINHAS];
+    memset(registrado, 0, sizeof(registrado));
+    int total = 0;
+    for (int rot = 0; rot < NUM_ROTACOES; rot++) {
+        int rc = ROTACAO_CANONICA[tipo][rot];
+        int dx = DESLOCAMENTO_CANONICO[tipo][rot].x;
+        int dy = DESLOCAMENTO_CANONICO[tipo][rot].y;
+        for (int i = 1; i < TAB_LINHAS; i++) {
+            unsigned int r = b.alcancadas[rot][i];
+            if (r == 0) continue;
+            int y = i - TAB_CHAO;
+            unsigned int apoiadas = deslocarX(r & ~(unsigned int)livresEm(&b, t, tipo, rot, y - 1), dx);
+            apoiadas &= ~(unsigned int)registrado[rc][i + dy];
+            registrado[rc][i + dy] |= (uint16_t)apoiadas;
+            for (; apoiadas; apoiadas &= apoiadas - 1) {
+                saida[total].x = __builtin_ctz(apoiadas) - TAB_PAREDE;
+                saida[total].y = y + dy;
+                saida[total].rotacao = rc;
+                total++;
+            }
+        }
+    }
+    return total;
+}
+
+/*
+ * enumerarJogadas()
+ * Colocacoes da peca da frente da fila e, com 'comReserva' e a pilha
+ * nao vazia, em seguida as do topo da pilha (opcao 3). Em 'numFrente'
+ * devolve quantas sao da frente. 'saida' precisa de 2 * TAB_MAX_ESTADOS.
+ */
+int enumerarJogadas(const Sessao* s, const Tabuleiro* t, int comReserva,
+                    PosicaoPeca* saida, int* numFrente) {
+    int total = 0;
+    if (s->fila.tras != s->fila.frente) {
+        Peca p = s->fila.elementos[s->fila.frente & s->fila.mascara];
+        total = enumerarColocacoes(t, tipoPeca(p), saida);
+    }
+    *numFrente = total;
+    if (comReserva && s->pilha.topo >= 0) {
+        Peca p = s->pilha.elementos[s->pilha.topo];
+        total += enumerarColocacoes(t, tipoPeca(p), saida + total);
+    }
+    return total;
+}
+
+/*
+ * iniciarHistoricoTabuleiro()
+ * Guarda o campo atual na posicao corrente do historico
+ */
+void iniciarHistoricoTabuleiro(HistoricoTabuleiro* ht, const Historico* h, const Tabuleiro* t) {
+    ht->estados[h->atual & (2 * TAM_HISTORICO - 1)] = *t;
+}
+
+/*
+ * executarComTabuleiro()
+ * executarComHistorico com um tabuleiro: as pecas de 1 e 3 caem no
+ * campo e cada operacao registrada guarda a copia do campo depois dela,
+ * entao desfazer e refazer so copiam o campo da nova posicao (refazer
+ * nao precisa soltar a peca de novo).
+ */
+Resultado executarComTabuleiro(Sessao* s, Historico* h, Tabuleiro* t, HistoricoTabuleiro* ht,
+                               int opcao, Peca* peca) {
+    Resultado r = executarComHistorico(s, h, opcao, peca);
+    if (r != RES_OK) return r;
+    
+    Tabuleiro* estado = &ht->estados[h->atual & (2 * TAM_HISTORICO - 1)];
+    if (opcao == 6 || opcao == 7) {
+        *t = *estado;
+        return r;
+    }
+    if (opcao == 1 || opcao == 3) colocarPeca(t, *peca);
+    *estado = *t;
+    return r;
+}
+
+/*
+ * exibirTabuleiro()
+ * Linhas ocupadas de cima para baixo ('#' bloco, '.' vazio) e as
+ * estatisticas
+ */
+void exibirTabuleiro(const Tabuleiro* t) {
+    printf("Tabuleiro: %lu pecas, %lu linhas limpas, %lu derrotas\n",
+           t->pecas, t->linhasLimpas, t->derrotas);
+    for (int y = t->altura - 1; y >= 0; y--) {
+        char linha[TAB_LARGURA + 1];
+        for (int c = 0; c < TAB_LARGURA; c++) {
+            linha[c] = (t->linhas[TAB_CHAO + y] >> (c + TAB_PAREDE)) & 1 ? '#' : '.';
+        }
+        linha[TAB_LARGURA] = '\0';
+        printf("  %2d |%s|\n", y, linha);
+    }
+    printf("     +----------+\n");
+}
+
+// ==================== BUSCA DE SEQUENCIAS ====================
+
+// Chaves Zobrist: uma por (posicao, tipo) na fila e na pilha e uma por
+// par de tamanhos. Semente fixa, entao o hash e igual em toda execucao.
+static uint64_t ZOBRIST_FILA[FILA_MAX][NUM_TIPOS + 1];
+static uint64_t ZOBRIST_PILHA[PILHA_MAX][NUM_TIPOS + 1];
+static uint64_t ZOBRIST_TAMANHOS[FILA_MAX + 1][PILHA_MAX + 1];
+static pthread_once_t zobristPronto = PTHREAD_ONCE_INIT;
+
+static uint64_t aleatorio64(GeradorAleatorio* g) {
+    uint64_t alto = proximoAleatorio(g);
+    return (alto << 32) | proximoAleatorio(g);
+}
+
+static void iniciarZobrist(void) {
+    GeradorAleatorio g;
+    semearGerador(&g, 0x5A0B1257u, 1);
+    for (int i = 0; i < FILA_MAX; i++) {
+        for (int t = 0; t <= NUM_TIPOS; t++) ZOBRIST_FILA[i][t] = aleatorio64(&g);
+    }
+    for (int i = 0; i < PILHA_MAX; i++) {
+        for (int t = 0; t <= NUM_TIPOS; t++) ZOBRIST_PILHA[i][t] = aleatorio64(&g);
+    }
+    for (int f = 0; f <= FILA_MAX; f++) {
+        for (int p = 0; p <= PILHA_MAX; p++) ZOBRIST_TAMANHOS[f][p] = aleatorio64(&g);
+    }
+}
+
+// Hash sem pthread_once, para o laco da busca (tabelas ja iniciadas)
+static uint64_t hashEstado(const EstadoBusca* e) {
+    uint64_t h = ZOBRIST_TAMANHOS[e->tamFila][e->tamPilha];
+    for (int i = 0; i < e->tamFila; i++) h ^= ZOBRIST_FILA[i][e->fila[i]];
+    for (int i = 0; i < e->tamPilha; i++) h ^= ZOBRIST_PILHA[i][e->pilha[i]];
+    return h;
+}
+
+/*
+ * hashEstadoBusca()
+ * Hash Zobrist de 64 bits dos tipos visiveis e dos tamanhos. As
+ * capacidades nao entram: sao as mesmas durante uma busca.
+ */
+uint64_t hashEstadoBusca(const EstadoBusca* e) {
+    pthread_once(&zobristPronto, iniciarZobrist);
+    return hashEstado(e);
+}
+
+/*
+ * estadoBuscaDaSessao()
+ * Copia os tipos visiveis da sessao (fila e pilha) para a busca
+ */
+void estadoBuscaDaSessao(const Sessao* s, EstadoBusca* e) {
+    const FilaCircular* f = &s->fila;
+    e->tamFila = (uint8_t)(f->tras - f->frente);
+    e->capFila = (uint8_t)f->capacidade;
+    for (int i = 0; i < e->tamFila; i++) {
+        e->fila[i] = (uint8_t)tipoPeca(f->elementos[(f->frente + i) & f->mascara]);
+    }
+    e->tamPilha = (uint8_t)(s->pilha.topo + 1);
+    e->capPilha = (uint8_t)s->pilha.capacidade;
+    for (int i = 0; i < e->tamPilha; i++) {
+        e->pilha[i] = (uint8_t)tipoPeca(s->pilha.elementos[i]);
+    }
+}
+
+// Tira a frente e completa a fila com pecas desconhecidas (reporFila)
+static void avancarFilaBusca(EstadoBusca* e) {
+    memmove(e->fila, e->fila + 1, e->tamFila - 1);
+    e->tamFila--;
+    while (e->tamFila < e->capFila) e->fila[e->tamFila++] = TIPO_DESCONHECIDO;
+}
+
+/*
+ * aplicarJogadaBusca()
+ * Mesmo efeito de executarOperacao (opcoes 1-5) sobre os tipos, sem
+ * gerar pecas. Retorna 0 quando a jogada seria recusada.
+ */
+int aplicarJogadaBusca(EstadoBusca* e, int opcao) {
+    switch (opcao) {
+        case 1:
+            if (e->tamFila == 0) return 0;
+            avancarFilaBusca(e);
+            return 1;
+            
+        case 2:
+            if (e->tamFila == 0 || e->tamPilha == e->capPilha) return 0;
+            e->pilha[e->tamPilha++] = e->fila[0];
+            avancarFilaBusca(e);
+            return 1;
+            
+        case 3:
+            if (e->tamPilha == 0) return 0;
+            e->tamPilha--;
+            return 1;
+            
+        case 4: {
+            // A frente vai para o topo e o topo entra no fim da fila
+            if (e->tamFila == 0 || e->tamPilha == 0) return 0;
+            uint8_t daFila = e->fila[0];
+            memmove(e->fila, e->fila + 1, e->tamFila - 1);
+            e->fila[e->tamFila - 1] = e->pilha[e->tamPilha - 1];
+            e->pilha[e->tamPilha - 1] = daFila;
+            return 1;
+        }
+            
+        case 5: {
+            int k = e->capFila < e->capPilha ? e->capFila : e->capPilha;
+            if (e->tamFila < k || e->tamPilha < k) return 0;
+            for (int i = 0; i < k; i++) {
+                uint8_t aux = e->fila[i];
+                e->fila[i] = e->pilha[e->tamPilha - 1 - i];
+                e->pilha[e->tamPilha - 1 - i] = aux;
+            }
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/*
+ * pontuarPecaNaFrente()
+ * 1 quando a frente da fila e do tipo alvo (contexto: int*), senao 0.
+ * Com suficiente = 1 a busca acha o caminho mais curto ate o alvo.
+ */
+int32_t pontuarPecaNaFrente(const EstadoBusca* e, const void* tipoAlvo) {
+    return e->tamFila > 0 && e->fila[0] == *(const int*)tipoAlvo;
+}
+
+/*
+ * pontuarProximidade()
+ * Quanto mais perto da frente estiver uma peca do tipo alvo, maior a
+ * nota (FILA_MAX + PILHA_MAX na frente). Na pilha vale menos que em
+ * qualquer posicao da fila, mais perto do topo = maior. 0 se nao ha.
+ */
+int32_t pontuarProximidade(const EstadoBusca* e, const void* tipoAlvo) {
+    int alvo = *(const int*)tipoAlvo;
+    for (int i = 0; i < e->tamFila; i++) {
+        if (e->fila[i] == alvo) return FILA_MAX + PILHA_MAX - i;
+    }
+    for (int i = e->tamPilha - 1; i >= 0; i--) {
+        if (e->pilha[i] == alvo) return PILHA_MAX - (e->tamPilha - 1 - i);
+    }
+    return 0;
+}
+
+int criarTabelaTransposicao(TabelaTransposicao* t, int bits) {
+    if (bits < 1 || bits > 30) return 0;
+    t->entradas = calloc((size_t)1 << bits, sizeof(EntradaTransposicao));
+    if (t->entradas == NULL) return 0;
+    t->mascara = ((uint64_t)1 << bits) - 1;
+    t->buscas = 0;
+    return 1;
+}
+
+void destruirTabelaTransposicao(TabelaTransposicao* t) {
+    free(t->entradas);
+    t->entradas = NULL;
+}
+
+long agoraMicrossegundos(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1000000L + t.tv_nsec / 1000;
+}
+
+static inline int melhorValor(ValorBusca a, ValorBusca b) {
+    return a.pontuacao > b.pontuacao || (a.pontuacao == b.pontuacao && a.jogadas < b.jogadas);
+}
+
+// Notas acima de 'suficiente' empatam: qualquer uma encerra a busca
+static inline int32_t notaBusca(const BuscaCompartilhada* b, const EstadoBusca* e) {
+    int32_t nota = b->parametros->pontuar(e, b->parametros->contexto);
+    return nota < b->parametros->suficiente ? nota : b->parametros->suficiente;
+}
+
+/*
+ * buscarNo()
+ * Melhor valor alcancavel a partir de 'e' com ate 'profundidade'
+ * jogadas (ficar parado tambem conta). A tabela guarda o valor exato
+ * por profundidade e a melhor jogada, que e tentada primeiro. Depois
+ * que o tempo acaba o retorno nao vale e nada mais e gravado.
+ */
+static ValorBusca buscarNo(TrabalhadorBusca* t, const EstadoBusca* e, int profundidade) {
+    BuscaCompartilhada* b = t->busca;
+    ValorBusca melhor = {notaBusca(b, e), 0};
+    int32_t suficiente = b->parametros->suficiente;
+    if (profundidade == 0 || melhor.pontuacao >= suficiente) return melhor;
+    
+    t->nos++;
+    if (t->comRelogio && (t->nos & (NOS_ENTRE_RELOGIO - 1)) == 0 &&
+        b->limiteUs != 0 && agoraMicrossegundos() > b->limiteUs) {
+        atomic_store_explicit(&b->esgotado, 1, memory_order_relaxed);
+    }
+    if (atomic_load_explicit(&b->esgotado, memory_order_relaxed)) return melhor;
+    
+    uint64_t chave = hashEstado(e) ^ b->sal;
+    EntradaTransposicao* entrada = &b->tabela[chave & b->mascara];
+    uint64_t dados = atomic_load_explicit(&entrada->dados, memory_order_relaxed);
+    uint64_t verificacao = atomic_load_explicit(&entrada->verificacao, memory_order_relaxed);
+    int jogadaTabela = 0;
+    if ((verificacao ^ dados) == chave && (dados >> 56) != 0) {
+        if ((int)((dados >> 40) & 0xFF) == profundidade) {
+            ValorBusca v = {(int32_t)(uint32_t)dados, (int)((dados >> 32) & 0xFF)};
+            return v;
+        }
+        jogadaTabela = (int)((dados >> 48) & 0xFF);
+    }
+    
+    int melhorJogada = 0;
+    for (int i = 0; i <= 5; i++) {
+        int opcao = i == 0 ? jogadaTabela : i;
+        if (opcao == 0 || (i > 0 && opcao == jogadaTabela)) continue;
+        
+        EstadoBusca filho = *e;
+        if (!aplicarJogadaBusca(&filho, opcao)) continue;
+        ValorBusca v = buscarNo(t, &filho, profundidade - 1);
+        v.jogadas++;
+        if (melhorValor(v, melhor)) {
+            melhor = v;
+            melhorJogada = opcao;
+            // Uma jogada ate o suficiente nao pode ser superada
+            if (melhor.pontuacao >= suficiente && melhor.jogadas == 1) break;
+        }
+    }
+    
+    if (!atomic_load_explicit(&b->esgotado, memory_order_relaxed)) {
+        dados = (uint64_t)(uint32_t)melhor.pontuacao | (uint64_t)melhor.jogadas << 32 |
+                (uint64_t)profundidade << 40 | (uint64_t)melhorJogada << 48 | 1ULL << 56;
+        atomic_store_explicit(&entrada->verificacao, chave ^ dados, memory_order_relaxed);
+        atomic_store_explicit(&entrada->dados, dados, memory_order_relaxed);
+    }
+    return melhor;
+}
+
+// Consome tarefas (pares de jogadas da raiz) ate acabarem
+static void iteracaoBusca(TrabalhadorBusca* t) {
+    BuscaCompartilhada* b = t->busca;
+    int i;
+    while ((i = atomic_fetch_add(&b->proximaTarefa, 1)) < 25) {
+        int pai = i / 5;
+        b->netoValido[i] = 0;
+        if (!b->filhoValido[pai] || b->profundidade < 2) continue;
+        
+        EstadoBusca neto = b->filhos[pai];
+        if (!aplicarJogadaBusca(&neto, i % 5 + 1)) continue;
+        b->valorNeto[i] = buscarNo(t, &neto, b->profundidade - 2);
+        b->netoValido[i] = 1;
+    }
+}
+
+static void* lacoBusca(void* arg) {
+    TrabalhadorBusca* t = (TrabalhadorBusca*)arg;
+    BuscaCompartilhada* b = t->busca;
+    pthread_mutex_lock(&b->largada);
+    pthread_mutex_unlock(&b->largada);
+    for (;;) {
+        pthread_barrier_wait(&b->barreira);
+        if (b->parar) break;
+        iteracaoBusca(t);
+        pthread_barrier_wait(&b->barreira);
+    }
+    return NULL;
+}
+
+/*
+ * concluirIteracao()
+ * Junta os valores das tarefas na raiz e refaz a sequencia descendo
+ * pelos filhos cujo valor reproduz o da raiz (quase tudo sai da
+ * tabela). So roda quando a iteracao terminou dentro do tempo.
+ */
+static void concluirIteracao(TrabalhadorBusca* t, const EstadoBusca* raiz, ResultadoBusca* r) {
+    BuscaCompartilhada* b = t->busca;
+    int32_t suficiente = b->parametros->suficiente;
+    ValorBusca melhor = {notaBusca(b, raiz), 0};
+    
+    for (int pai = 0; pai < 5; pai++) {
+        if (!b->filhoValido[pai]) continue;
+        ValorBusca v = {notaBusca(b, &b->filhos[pai]), 0};
+        for (int j = 0; j < 5 && v.pontuacao < suficiente; j++) {
+            if (!b->netoValido[pai * 5 + j]) continue;
+            ValorBusca neto = b->valorNeto[pai * 5 + j];
+            neto.jogadas++;
+            if (melhorValor(neto, v)) v = neto;
+        }
+        v.jogadas++;
+        if (melhorValor(v, melhor)) melhor = v;
+    }
+    
+    EstadoBusca e = *raiz;
+    int resta = b->profundidade;
+    r->numJogadas = 0;
+    t->comRelogio = 0;
+    while (melhor.jogadas > 0) {
+        int escolhida = 0;
+        for (int opcao = 1; opcao <= 5 && !escolhida; opcao++) {
+            EstadoBusca filho = e;
+            if (!aplicarJogadaBusca(&filho, opcao)) continue;
+            ValorBusca v = buscarNo(t, &filho, resta - 1);
+            if (!melhorValor(melhor, (ValorBusca){v.pontuacao, v.jogadas + 1})) {
+                e = filho;
+                melhor = v;
+                escolhida = opcao;
+            }
+        }
+        if (!escolhida) break;      // Nao acontece: o valor veio de um filho
+        r->jogadas[r->numJogadas++] = (uint8_t)escolhida;
+        resta--;
+    }
+    t->comRelogio = 1;
+    
+    r->pontuacao = b->parametros->pontuar(&e, b->parametros->contexto);
+    r->profundidade = b->profundidade;
+    r->atingiu = r->pontuacao >= suficiente;
+}
+
+/*
+ * buscarSequencia()
+ * Aprofundamento iterativo (1, 2, ... profundidadeMax jogadas) sobre o
+ * estado visivel, dividindo cada iteracao entre numThreads threads.
+ * O resultado e sempre o da ultima iteracao completa, entao um
+ * orcamento curto devolve uma sequencia mais rasa, nunca uma pela
+ * metade. Nao deve ser chamada em paralelo com a mesma tabela.
+ * Retorna 0 se os parametros forem invalidos.
+ */
+int buscarSequencia(const EstadoBusca* raiz, const ParametrosBusca* p, TabelaTransposicao* tabela, ResultadoBusca* r) {
+    if (p->pontuar == NULL || p->profundidadeMax < 1 || p->profundidadeMax > PROFUNDIDADE_BUSCA_MAX ||
+        p->numThreads < 1 || p->numThreads > MAX_THREADS_BUSCA) {
+        return 0;
+    }
+    pthread_once(&zobristPronto, iniciarZobrist);
+    long inicio = agoraMicrossegundos();
+    
+    BuscaCompartilhada b;
+    b.parametros = p;
+    b.tabela = tabela->entradas;
+    b.mascara = tabela->mascara;
+    b.sal = ++tabela->buscas * 0x9E3779B97F4A7C15ULL;
+    b.limiteUs = p->orcamentoUs > 0 ? inicio + p->orcamentoUs : 0;
+    atomic_init(&b.esgotado, 0);
+    atomic_init(&b.proximaTarefa, 0);
+    b.parar = 0;
+    
+    // Sem jogadas: o proprio estado ja e o resultado
+    r->numJogadas = 0;
+    r->pontuacao = p->pontuar(raiz, p->contexto);
+    r->profundidade = 0;
+    r->atingiu = r->pontuacao >= p->suficiente;
+    
+    TrabalhadorBusca trabalhadores[MAX_THREADS_BUSCA];
+    int criadas = 0;
+    pthread_mutex_init(&b.largada, NULL);
+    pthread_mutex_lock(&b.largada);
+    for (int i = 0; i < p->numThreads; i++) {
+        trabalhadores[i].busca = &b;
+        trabalhadores[i].comRelogio = 1;
+        trabalhadores[i].nos = 0;
+    }
+    for (int i = 1; i < p->numThreads && !r->atingiu; i++) {
+        if (pthread_create(&trabalhadores[i].thread, NULL, lacoBusca, &trabalhadores[i]) != 0) break;
+        criadas++;
+    }
+    pthread_barrier_init(&b.barreira, NULL, (unsigned)criadas + 1);
+    pthread_mutex_unlock(&b.largada);
+    
+    for (int prof = 1; prof <= p->profundidadeMax && !r->atingiu; prof++) {
+        b.profundidade = prof;
+        atomic_store(&b.proximaTarefa, 0);
+        for (int pai = 0; pai < 5; pai++) {
+            b.filhos[pai] = *raiz;
+            b.filhoValido[pai] = aplicarJogadaBusca(&b.filhos[pai], pai + 1);
+        }
+        
+        pthread_barrier_wait(&b.barreira);
+        iteracaoBusca(&trabalhadores[0]);
+        pthread_barrier_wait(&b.barreira);
+        
+        if (atomic_load(&b.esgotado)) break;
+        concluirIteracao(&trabalhadores[0], raiz, r);
+    }
+    
+    b.parar = 1;
+    pthread_barrier_wait(&b.barreira);
+    r->nos = trabalhadores[0].nos;
+    for (int i = 1; i <= criadas; i++) {
+        pthread_join(trabalhadores[i].thread, NULL);
+        r->nos += trabalhadores[i].nos;
+    }
+    pthread_barrier_destroy(&b.barreira);
+    pthread_mutex_destroy(&b.largada);
+    
+    r->tempoUs = agoraMicrossegundos() - inicio;
+    return 1;
+}
+
+/*
+ * buscarAtePecaNaFrente()
+ * Busca curta usada pela interface (ate 12 jogadas, 20 ms, uma thread
+ * por nucleo): menor sequencia que leva o tipo 'alvo' a frente da fila.
+ * Retorna 0 se faltar memoria para a tabela.
+ */
+int buscarAtePecaNaFrente(const Sessao* s, int alvo, ResultadoBusca* r) {
+    long nucleos = sysconf(_SC_NPROCESSORS_ONLN);
+    ParametrosBusca p = {pontuarPecaNaFrente, &alvo, 1, 12, 20000,
+                         nucleos < 1 ? 1 : nucleos > MAX_THREADS_BUSCA ? MAX_THREADS_BUSCA : (int)nucleos};
+    TabelaTransposicao tabela;
+    EstadoBusca raiz;
+    if (!criarTabelaTransposicao(&tabela, BITS_TABELA_PADRAO)) return 0;
+    estadoBuscaDaSessao(s, &raiz);
+    buscarSequencia(&raiz, &p, &tabela, r);
+    destruirTabelaTransposicao(&tabela);
+    return 1;
+}
+
+// ==================== AVALIACAO MONTE CARLO ====================
+
+/*
+ * prepararGeradorSimulacao()
+ * Copia o gerador da sessao num fluxo novo do PCG32 e embaralha o que
+ * resta do saco atual: a continuacao segue a politica (pecas do saco
+ * ainda nao entregues, historico do TGM) sem usar a ordem que a sessao
+ * de fato vai gerar.
+ */
+static void prepararGeradorSimulacao(GeradorPecas* g, const GeradorPecas* origem,
+                                     uint64_t semente, uint64_t fluxo) {
+    *g = *origem;
+    semearGerador(&g->aleatorio, semente, fluxo);
+    for (int i = g->tamSaco - 1; i > g->posSaco; i--) {
+        int j = g->posSaco + (int)aleatorioLimitado(&g->aleatorio, (uint32_t)(i - g->posSaco + 1));
+        unsigned char aux = g->saco[i];
+        g->saco[i] = g->saco[j];
+        g->saco[j] = aux;
+    }
+}
+
+// Troca as posicoes desconhecidas da fila (deixadas pela busca) por pecas sorteadas
+static void completarFilaSimulacao(EstadoBusca* e, GeradorPecas* g) {
+    for (int i = 0; i < e->tamFila; i++) {
+        if (e->fila[i] == TIPO_DESCONHECIDO) e->fila[i] = (uint8_t)tipoPeca(gerarPeca(g));
+    }
+}
+
+/*
+ * simularContinuacao()
+ * Faz a primeira jogada (1 ou 2) e segue sorteando entre as jogadas
+ * validas de 1-3 ate colocar 'horizonte' pecas no tabuleiro (com
+ * colocarPeca, como no lote). Nota: linhas limpas na continuacao, menos
+ * TAB_VISIVEL por derrota. A mesma semente nos dois lados do par da as
+ * mesmas pecas futuras, entao a diferenca tem bem menos ruido.
+ */
+static double simularContinuacao(const TrabalhadorAvaliacao* w, int primeira, uint64_t semente) {
+    EstadoBusca e = *w->raiz;
+    Tabuleiro t = *w->tabuleiro;
+    GeradorPecas g;
+    prepararGeradorSimulacao(&g, w->gerador, semente, w->fluxo);
+    
+    int colocadas = 0;
+    for (int opcao = primeira; ; ) {
+        uint8_t tipo = opcao == 3 ? e.pilha[e.tamPilha - 1] : e.fila[0];
+        aplicarJogadaBusca(&e, opcao);
+        completarFilaSimulacao(&e, &g);
+        if (opcao != 2) {
+            colocarPeca(&t, criarPeca(tipo, 0));
+            if (++colocadas == w->parametros->horizonte) break;
+        }
+        
+        int validas[3], n = 0;
+        validas[n++] = 1;       // A fila nunca fica vazia: e reposta a cada jogada
+        if (e.tamPilha < e.capPilha) validas[n++] = 2;
+        if (e.tamPilha > 0) validas[n++] = 3;
+        opcao = validas[aleatorioLimitado(&g.aleatorio, (uint32_t)n)];
+    }
+    return (double)(t.linhasLimpas - w->tabuleiro->linhasLimpas) -
+           (double)TAB_VISIVEL * (double)(t.derrotas - w->tabuleiro->derrotas);
+}
+
+// Pares de continuacoes ate a cota ou o relogio acabar
+static void* lacoAvaliacao(void* arg) {
+    TrabalhadorAvaliacao* w = (TrabalhadorAvaliacao*)arg;
+    while (w->cota == 0 || w->amostras < w->cota) {
+        if (w->limiteUs != 0 && w->amostras % MC_ENTRE_RELOGIO == 0 &&
+            agoraMicrossegundos() > w->limiteUs) {
+            break;
+        }
+        uint64_t semente = aleatorio64(&w->aleatorio);
+        double nota[3];
+        nota[0] = simularContinuacao(w, 1, semente);
+        nota[1] = w->podeReservar ? simularContinuacao(w, 2, semente) : 0;
+        nota[2] = nota[1] - nota[0];
+        for (int k = 0; k < 3; k++) {
+            w->soma[k] += nota[k];
+            w->somaQuadrados[k] += nota[k] * nota[k];
+        }
+        w->amostras++;
+    }
+    return NULL;
+}
+
+// Media e intervalo de 95% (aproximacao normal) a partir das somas
+static Estimativa estimar(double soma, double somaQuadrados, unsigned long n) {
+    Estimativa e = {0, 0};
+    if (n == 0) return e;
+    e.media = soma / (double)n;
+    if (n > 1) {
+        double variancia = (somaQuadrados - soma * e.media) / (double)(n - 1);
+        if (variancia < 0) variancia = 0;   // Arredondamento com amostras iguais
+        e.margem = MC_Z_95 * sqrt(variancia / (double)n);
+    }
+    return e;
+}
+
+/*
+ * avaliarReserva()
+ * Compara jogar (1) e reservar (2) a frente da fila com continuacoes
+ * aleatorias a partir da fila, da pilha e do tabuleiro atuais (NULL =
+ * campo vazio), espalhadas por numThreads threads, cada uma no seu
+ * fluxo do PCG32. A escolha so sai quando o intervalo de 95% da
+ * diferenca nao contem o 0. Nao altera a sessao.
+ * Retorna 0 se os parametros forem invalidos ou a fila estiver vazia.
+ */
+int avaliarReserva(const Sessao* s, const Tabuleiro* t, const ParametrosAvaliacao* p,
+                   ResultadoAvaliacao* r) {
+    if (p->horizonte < 1 || p->numThreads < 1 || p->numThreads > MAX_THREADS_BUSCA ||
+        (p->orcamentoUs <= 0 && p->maxAmostras == 0)) {
+        return 0;
+    }
+    long inicio = agoraMicrossegundos();
+    EstadoBusca raiz;
+    estadoBuscaDaSessao(s, &raiz);
+    if (raiz.tamFila == 0) return 0;
+    Tabuleiro vazio;
+    if (t == NULL) {
+        iniciarTabuleiro(&vazio);
+        t = &vazio;
+    }
+    
+    // Com limite de amostras cada thread tem a sua parte fixa
+    int numThreads = p->numThreads;
+    if (p->maxAmostras != 0 && p->maxAmostras < (unsigned long)numThreads) {
+        numThreads = (int)p->maxAmostras;
+    }
+    TrabalhadorAvaliacao trabalhadores[MAX_THREADS_BUSCA];
+    for (int i = 0; i < numThreads; i++) {
+        TrabalhadorAvaliacao* w = &trabalhadores[i];
+        memset(w, 0, sizeof(*w));
+        w->raiz = &raiz;
+        w->tabuleiro = t;
+        w->gerador = &s->gerador;
+        w->parametros = p;
+        w->podeReservar = raiz.tamPilha < raiz.capPilha;
+        w->limiteUs = p->orcamentoUs > 0 ? inicio + p->orcamentoUs : 0;
+        w->cota = p->maxAmostras / (unsigned long)numThreads +
+                  ((unsigned long)i < p->maxAmostras % (unsigned long)numThreads);
+        w->fluxo = (uint64_t)i + 1;
+        semearGerador(&w->aleatorio, p->semente, w->fluxo);
+    }
+    
+    int criadas = 1;
+    while (criadas < numThreads &&
+           pthread_create(&trabalhadores[criadas].thread, NULL, lacoAvaliacao, &trabalhadores[criadas]) == 0) {
+        criadas++;
+    }
+    lacoAvaliacao(&trabalhadores[0]);
+    
+    double soma[3] = {0, 0, 0};
+    double somaQuadrados[3] = {0, 0, 0};
+    r->amostras = 0;
+    for (int i = 0; i < criadas; i++) {
+        if (i > 0) pthread_join(trabalhadores[i].thread, NULL);
+        for (int k = 0; k < 3; k++) {
+            soma[k] += trabalhadores[i].soma[k];
+            somaQuadrados[k] += trabalhadores[i].somaQuadrados[k];
+        }
+        r->amostras += trabalhadores[i].amostras;
+    }
+    
+    r->jogar = estimar(soma[0], somaQuadrados[0], r->amostras);
+    r->reservar = estimar(soma[1], somaQuadrados[1], r->amostras);
+    r->diferenca = estimar(soma[2], somaQuadrados[2], r->amostras);
+    r->podeReservar = trabalhadores[0].podeReservar;
+    if (!r->podeReservar) {
+        r->escolha = 1;
+    } else if (r->amostras > 1 && r->diferenca.media - r->diferenca.margem > 0) {
+        r->escolha = 2;
+    } else if (r->amostras > 1 && r->diferenca.media + r->diferenca.margem < 0) {
+        r->escolha = 1;
+    } else {
+        r->escolha = 0;
+    }
+    r->tempoUs = agoraMicrossegundos() - inicio;
+    return 1;
+}
+
+/*
+ * avaliarReservaPadrao()
+ * Avaliacao usada pela interface (MC_ORCAMENTO_INTERFACE, uma thread
+ * por nucleo, campo vazio). A semente sai do estado da sessao.
+ */
+int avaliarReservaPadrao(const Sessao* s, ResultadoAvaliacao* r) {
+    long nucleos = sysconf(_SC_NPROCESSORS_ONLN);
+    ParametrosAvaliacao p = {MC_ORCAMENTO_INTERFACE, 0, MC_HORIZONTE_PADRAO,
+                             nucleos < 1 ? 1 : nucleos > MAX_THREADS_BUSCA ? MAX_THREADS_BUSCA : (int)nucleos,
+                             resumoSessao(s)};
+    return avaliarReserva(s, NULL, &p, r);
+}
+
+// ==================== INSTRUMENTACAO ====================
+
+#ifdef INSTRUMENTAR
+static const char* NOMES_EVENTO[NUM_EVENTOS] = {
+    "enqueue", "enqueue_fila_cheia", "dequeue", "push", "push_pilha_cheia",
+    "pop", "troca_simples", "troca_k", "troca_k_insuficiente", "peca_gerada"
+};
+
+static pthread_mutex_t travaContadores = PTHREAD_MUTEX_INITIALIZER;
+static BlocoContadores* blocosVivos;            // Um por thread que ja contou
+static Contadores contadoresAposentados;        // Soma das threads que sairam
+static pthread_key_t chaveBloco;
+static pthread_once_t chaveBlocoCriada = PTHREAD_ONCE_INIT;
+
+// Soma um bloco em 'total' (loads relaxados: a dona pode estar escrevendo)
+static void acumularBloco(Contadores* total, BlocoContadores* b) {
+    for (int e = 0; e < NUM_EVENTOS; e++) {
+        total->eventos[e] += atomic_load_explicit(&b->eventos[e], memory_order_relaxed);
+    }
+    for (int op = 0; op <= NUM_OPCOES; op++) {
+        for (int r = 0; r < NUM_RESULTADOS; r++) {
+            total->operacoes.operacoes[op][r] +=
+                atomic_load_explicit(&b->operacoes[op][r], memory_order_relaxed);
+        }
+        total->operacoes.nsOperacoes[op] +=
+            atomic_load_explicit(&b->nsOperacoes[op], memory_order_relaxed);
+    }
+}
+
+// Destrutor da chave: a thread saiu, o bloco dela vira parte do total
+// aposentado e sai da lista
+static void aposentarBloco(void* p) {
+    BlocoContadores* b = p;
+    pthread_mutex_lock(&travaContadores);
+    BlocoContadores** anterior = &blocosVivos;
+    while (*anterior != b) anterior = &(*anterior)->proximo;
+    *anterior = b->proximo;
+    acumularBloco(&contadoresAposentados, b);
+    pthread_mutex_unlock(&travaContadores);
+    free(b);
+}
+
+static void criarChaveBloco(void) {
+    pthread_key_create(&chaveBloco, aposentarBloco);
+}
+
+/*
+ * registrarBlocoContadores()
+ * Primeiro evento da thread: cria o bloco dela e o poe na lista. Sem
+ * memoria nao ha como contar sem perder eventos, entao aborta.
+ */
+BlocoContadores* registrarBlocoContadores(void) {
+    pthread_once(&chaveBlocoCriada, criarChaveBloco);
+    BlocoContadores* b = calloc(1, sizeof(BlocoContadores));
+    if (b == NULL) {
+        fprintf(stderr, "ERRO: memoria insuficiente para os contadores\n");
+        abort();
+    }
+    pthread_mutex_lock(&travaContadores);
+    b->proximo = blocosVivos;
+    blocosVivos = b;
+    pthread_mutex_unlock(&travaContadores);
+    pthread_setspecific(chaveBloco, b);
+    blocoLocal = b;
+    return b;
+}
+
+/*
+ * registrarOperacao()
+ * Conta uma operacao (codigo fora de 0-7 vira 0, invalida) na sessao e
+ * no bloco da thread
+ */
+void registrarOperacao(Sessao* s, int opcao, Resultado r, uint64_t ns) {
+    if (opcao < 0 || opcao > NUM_OPCOES) opcao = 0;
+    BlocoContadores* b = blocoContadores();
+    somarRelaxado(&b->operacoes[opcao][r], 1);
+    somarRelaxado(&b->nsOperacoes[opcao], ns);
+    s->contadores.operacoes[opcao][r]++;
+    s->contadores.nsOperacoes[opcao] += ns;
+}
+
+// {"1": {"total": N, "ns": N, "OK": N, ...}, ...} com so os resultados != 0
+static void despejarOperacoes(FILE* saida, const ContadoresSessao* c, const char* recuo) {
+    fprintf(saida, "{");
+    for (int op = 0; op <= NUM_OPCOES; op++) {
+        uint64_t total = 0;
+        for (int r = 0; r < NUM_RESULTADOS; r++) total += c->operacoes[op][r];
+        fprintf(saida, "%s\n%s  \"%d\": {\"total\": %llu, \"ns\": %llu", op ? "," : "",
+                recuo, op, (unsigned long long)total, (unsigned long long)c->nsOperacoes[op]);
+        for (int r = 0; r < NUM_RESULTADOS; r++) {
+            if (c->operacoes[op][r] == 0) continue;
+            fprintf(saida, ", \"%s\": %llu", NOMES_RESULTADO[r],
+                    (unsigned long long)c->operacoes[op][r]);
+        }
+        fprintf(saida, "}");
+    }
+    fprintf(saida, "\n%s}", recuo);
+}
+#endif
+
+/*
+ * somarContadores()
+ * Total de todas as threads (vivas e as que ja sairam) neste instante.
+ * Sem -DINSTRUMENTAR fica tudo zero.
+ */
+void somarContadores(Contadores* total) {
+    memset(total, 0, sizeof(*total));
+#ifdef INSTRUMENTAR
+    pthread_mutex_lock(&travaContadores);
+    *total = contadoresAposentados;
+    for (BlocoContadores* b = blocosVivos; b != NULL; b = b->proximo) {
+        acumularBloco(total, b);
+    }
+    pthread_mutex_unlock(&travaContadores);
+#endif
+}
+
+/*
+ * despejarContadores()
+ * JSON com os eventos e operacoes de todas as threads ("global") e, se
+ * 's' nao for NULL, as operacoes dessa sessao. A operacao "0" sao os
+ * codigos invalidos. Sem -DINSTRUMENTAR so {"instrumentado": false}.
+ */
+void despejarContadores(FILE* saida, const Sessao* s) {
+#ifdef INSTRUMENTAR
+    Contadores total;
+    somarContadores(&total);
+    fprintf(saida, "{\n  \"instrumentado\": true,\n  \"global\": {\n    \"eventos\": {");
+    for (int e = 0; e < NUM_EVENTOS; e++) {
+        fprintf(saida, "%s\n      \"%s\": %llu", e ? "," : "", NOMES_EVENTO[e],
+                (unsigned long long)total.eventos[e]);
+    }
+    fprintf(saida, "\n    },\n    \"operacoes\": ");
+    despejarOperacoes(saida, &total.operacoes, "    ");
+    fprintf(saida, "\n  }");
+    if (s != NULL) {
+        fprintf(saida, ",\n  \"sessao\": {\n    \"operacoes\": ");
+        despejarOperacoes(saida, &s->contadores, "    ");
+        fprintf(saida, "\n  }");
+    }
+    fprintf(saida, "\n}\n");
+#else
+    (void)s;
+    fprintf(saida, "{\"instrumentado\": false}\n");
+#endif
+}
+
+/*
+ * gravarContadores()
+ * despejarContadores() num arquivo ("-" = stderr, para nao misturar com
+ * a saida do modo). Retorna 0 se nao conseguir gravar.
+ */
+int gravarContadores(const char* caminho, const Sessao* s) {
+    if (strcmp(caminho, "-") == 0) {
+        despejarContadores(stderr, s);
+        return 1;
+    }
+    FILE* arq = fopen(caminho, "w");
+    if (arq == NULL) return 0;
+    despejarContadores(arq, s);
+    return fclose(arq) == 0;
+}
+
+// ==================== MODO LOTE ====================
+
+/*
+ * executarLote()
+ * Le um fluxo de codigos de operacao ('1'-'7', '0' encerra) e executa
+ * sem menu nem pausas. Espacos e quebras de linha sao ignorados.
+ * Ao final imprime um resumo; com 'rastro' imprime uma linha por operacao.
+ * Com 'gravador' cada operacao valida tambem vai para o log de replay.
+ * Com 'tabuleiro' as pecas jogadas e usadas caem no campo (e desfazer
+ * e refazer tambem voltam o campo); o resumo mostra o campo final.
+ * A sessao e criada (ou restaurada) e destruida por quem chama.
+ */
+int executarLote(FILE* entrada, int rastro, Configuracao* cfg, Sessao* sessao,
+                 GravadorReplay* gravador, Tabuleiro* tabuleiro) {
+    static unsigned char buffer[TAM_BUFFER_LOTE];
+    static char saida[TAM_BUFFER_LOTE];
+    static HistoricoTabuleiro estados;
+    
+    unsigned long contagem[NUM_OPCOES + 1][NUM_RESULTADOS] = {{0}};
+    unsigned long total = 0;
+    Historico historico;
+    int encerrar = 0;
+    size_t lidos;
+    
+    if (rastro) {
+        setvbuf(stdout, saida, _IOFBF, sizeof(saida));
+    }
+    
+    iniciarHistorico(&historico);
+    if (tabuleiro != NULL) iniciarHistoricoTabuleiro(&estados, &historico, tabuleiro);
+    clock_t inicio = clock();
+    
+    while (!encerrar && (lidos = fread(buffer, 1, sizeof(buffer), entrada)) > 0) {
+        for (size_t i = 0; i < lidos; i++) {
+            unsigned char c = buffer[i];
+            if (c == ' ' || c == '\n' || c == '\r' || c == '\t') continue;
+            if (c == '0') {
+                encerrar = 1;
+                break;
+            }
+            
+            int opcao = (c >= '1' && c <= '0' + NUM_OPCOES) ? c - '0' : 0;
+            Peca p = PECA_NENHUMA;
+            Resultado r = tabuleiro != NULL
+                        ? executarComTabuleiro(sessao, &historico, tabuleiro, &estados, opcao, &p)
+                        : executarComHistorico(sessao, &historico, opcao, &p);
+            contagem[opcao][r]++;
+            total++;
+            if (gravador != NULL && opcao != 0) gravarOperacao(gravador, sessao, opcao);
+            
+            if (rastro) {
+                if (p == PECA_NENHUMA) {
+                    printf("%lu %c %s [-]\n", total, c, NOMES_RESULTADO[r]);
+                } else {
+                    printf("%lu %c %s [%c %d]\n", total, c, NOMES_RESULTADO[r], nomePeca(p), idPeca(p));
+                }
+            }
+        }
+    }
+    
+    double segundos = (double)(clock() - inicio) / CLOCKS_PER_SEC;
+    
+    printf("=====================================================\n");
+    printf("   TETRIS STACK - RESUMO DO MODO LOTE\n");
+    printf("=====================================================\n");
+    printf("Semente: %llu (gerador %s)\n", (unsigned long long)cfg->semente,
+           nomePolitica(cfg->politica));
+    printf("Operacoes executadas: %lu\n", total);
+    for (int op = 1; op <= NUM_OPCOES; op++) {
+        unsigned long ok = contagem[op][RES_OK];
+        unsigned long soma = 0;
+        for (int r = 0; r < NUM_RESULTADOS; r++) soma += contagem[op][r];
+        printf("  Opcao %d: %lu (ok: %lu, erros: %lu)\n", op, soma, ok, soma - ok);
+    }
+    printf("  Invalidas: %lu\n", contagem[0][RES_OPCAO_INVALIDA]);
+    printf("Total de pecas geradas: %u\n", sessao->gerador.proximoId);
+    if (segundos > 0) {
+        printf("Tempo: %.3f s (%.0f ops/s)\n", segundos, total / segundos);
+    }
+    
+    // Estado final em uma linha
+    FilaCircular fila = sessao->fila;
+    Pilha pilha = sessao->pilha;
+    printf("Fila final:");
+    for (unsigned int i = fila.frente; i != fila.tras; i++) {
+        Peca p = fila.elementos[i & fila.mascara];
+        printf(" [%c %d]", nomePeca(p), idPeca(p));
+    }
+    printf("\nPilha final (topo -> base):");
+    for (int i = pilha.topo; i >= 0; i--) {
+        printf(" [%c %d]", nomePeca(pilha.elementos[i]), idPeca(pilha.elementos[i]));
+    }
+    printf("\n");
+    if (tabuleiro != NULL) exibirTabuleiro(tabuleiro);
+    printf("=====================================================\n");
+    fflush(stdout);
+    
+    int erroGravacao = gravador != NULL && !fecharGravador(gravador, sessao);
+    if (erroGravacao) fprintf(stderr, "ERRO: falha ao gravar o log de replay\n");
+    return (ferror(entrada) || erroGravacao) ? 1 : 0;
 }
 
-void enqueue(FilaCircular* fila, Peca peca) {
-    if (filaCheia(fila)) return;
-    fila->tras = (fila->tras + 1) % TAM_FILA;
-    fila->elementos[fila->tras] = peca;
-    fila->tamanho++;
+// ==================== LOG DE REPLAY ====================
+
+static void escreverU64(unsigned char* destino, uint64_t valor) {
+    for (int i = 0; i < 8; i++) destino[i] = (unsigned char)(valor >> (8 * i));
 }
 
-Peca dequeue(FilaCircular* fila) {
-    Peca p = fila->elementos[fila->frente];
-    fila->frente = (fila->frente + 1) % TAM_FILA;
-    fila->tamanho--;
-    return p;
+static uint32_t lerU32(const unsigned char* origem) {
+    return (uint32_t)origem[0] | ((uint32_t)origem[1] << 8) |
+           ((uint32_t)origem[2] << 16) | ((uint32_t)origem[3] << 24);
 }
 
-Peca frente(FilaCircular* fila) {
-    return fila->elementos[fila->frente];
+static uint64_t lerU64(const unsigned char* origem) {
+    uint64_t valor = 0;
+    for (int i = 7; i >= 0; i--) valor = (valor << 8) | origem[i];
+    return valor;
 }
 
-// ==================== IMPLEMENTACAO - PILHA ====================
+static void gravarCheckpoint(GravadorReplay* g, const Sessao* s) {
+    unsigned char registro[REPLAY_TAM_CHECKPOINT];
+    registro[0] = REPLAY_CHECKPOINT;
+    escreverU64(registro + 1, g->numOps);
+    escreverU64(registro + 9, resumoSessao(s));
+    escreverU64(registro + 17, g->resumoOps);
+    fwrite(registro, 1, sizeof(registro), g->arquivo);
+    g->desdeCheckpoint = 0;
+}
 
-void inicializarPilha(Pilha* pilha) {
-    pilha->topo = -1;
+/*
+ * abrirGravador()
+ * Cria o arquivo e escreve o cabecalho com a configuracao e a semente
+ * (a sessao deve ser criada com cfg->semente). Retorna 0 em erro.
+ */
+int abrirGravador(GravadorReplay* g, const char* caminho, const Configuracao* cfg, uint32_t intervalo) {
+    unsigned char cabecalho[REPLAY_TAM_CABECALHO] = {0};
+    
+    g->arquivo = fopen(caminho, "wb");
+    if (g->arquivo == NULL) return 0;
+    g->intervalo = intervalo > 0 ? intervalo : REPLAY_INTERVALO_PADRAO;
+    g->desdeCheckpoint = 0;
+    g->numOps = 0;
+    g->resumoOps = FNV_BASE;
+    
+    memcpy(cabecalho, REPLAY_MAGICO, 4);
+    cabecalho[4] = REPLAY_VERSAO & 0xFF;
+    cabecalho[5] = REPLAY_VERSAO >> 8;
+    cabecalho[6] = (unsigned char)cfg->tamFila;
+    cabecalho[7] = (unsigned char)cfg->tamPilha;
+    cabecalho[8] = (unsigned char)cfg->politica;
+    for (int i = 0; i < 4; i++) cabecalho[12 + i] = (unsigned char)(g->intervalo >> (8 * i));
+    escreverU64(cabecalho + 16, cfg->semente);
+    return fwrite(cabecalho, 1, sizeof(cabecalho), g->arquivo) == sizeof(cabecalho);
 }
 
-int pilhaVazia(Pilha* pilha) {
-    return (pilha->topo == -1);
+/*
+ * gravarOperacao()
+ * Acrescenta o codigo da operacao ja aplicada em 's' (1 byte) e, a cada
+ * 'intervalo' operacoes, um checkpoint com o resumo do estado.
+ */
+void gravarOperacao(GravadorReplay* g, const Sessao* s, int opcao) {
+    putc(opcao, g->arquivo);
+    g->numOps++;
+    g->resumoOps = (g->resumoOps ^ (unsigned int)opcao) * FNV_PRIMO;
+    if (++g->desdeCheckpoint == g->intervalo) gravarCheckpoint(g, s);
 }
 
-int pilhaCheia(Pilha* pilha) {
-    return (pilha->topo == TAM_PILHA - 1);
+/*
+ * fecharGravador()
+ * Grava o checkpoint final (se houve operacoes depois do ultimo) e
+ * fecha o arquivo. Retorna 0 se alguma escrita falhou.
+ */
+int fecharGravador(GravadorReplay* g, const Sessao* s) {
+    if (g->desdeCheckpoint > 0) gravarCheckpoint(g, s);
+    int ok = !ferror(g->arquivo);
+    if (fclose(g->arquivo) != 0) ok = 0;
+    g->arquivo = NULL;
+    return ok;
 }
 
-void push(Pilha* pilha, Peca peca) {
-    if (pilhaCheia(pilha)) return;
-    pilha->topo++;
-    pilha->elementos[pilha->topo] = peca;
+/*
+ * lerCabecalhoReplay()
+ * Valida o cabecalho e preenche a configuracao. Retorna 0 se o arquivo
+ * nao for um log valido ou for de uma versao mais nova que REPLAY_VERSAO.
+ * Logs da versao 1 (so opcoes 1-5) continuam legiveis.
+ */
+int lerCabecalhoReplay(const unsigned char* dados, size_t tamanho, Configuracao* cfg, uint32_t* intervalo) {
+    if (tamanho < REPLAY_TAM_CABECALHO || memcmp(dados, REPLAY_MAGICO, 4) != 0) return 0;
+    int versao = dados[4] | (dados[5] << 8);
+    if (versao < 1 || versao > REPLAY_VERSAO) return 0;
+    
+    cfg->tamFila = dados[6];
+    cfg->tamPilha = dados[7];
+    cfg->politica = (PoliticaGeracao)dados[8];
+    cfg->semente = lerU64(dados + 16);
+    *intervalo = lerU32(dados + 12);
+    if (cfg->tamFila < 1 || cfg->tamFila > FILA_MAX) return 0;
+    if (cfg->tamPilha < 1 || cfg->tamPilha > PILHA_MAX) return 0;
+    return cfg->politica < NUM_POLITICAS;
 }
 
-Peca pop(Pilha* pilha) {
-    Peca p = pilha->elementos[pilha->topo];
-    pilha->topo--;
-    return p;
+// ==================== GERADOR ALEATORIO ====================
+
+/*
+ * semearGerador()
+ * Inicializa o PCG32 com a semente e o numero do fluxo (sequencias
+ * independentes para a mesma semente)
+ */
+void semearGerador(GeradorAleatorio* g, uint64_t semente, uint64_t fluxo) {
+    g->estado = 0;
+    g->incremento = (fluxo << 1) | 1u;
+    proximoAleatorio(g);
+    g->estado += semente;
+    proximoAleatorio(g);
 }
 
-Peca topo(Pilha* pilha) {
-    return pilha->elementos[pilha->topo];
+uint32_t proximoAleatorio(GeradorAleatorio* g) {
+    uint64_t anterior = g->estado;
+    g->estado = anterior * 6364136223846793005ULL + g->incremento;
+    uint32_t xorDeslocado = (uint32_t)(((anterior >> 18) ^ anterior) >> 27);
+    uint32_t rotacao = (uint32_t)(anterior >> 59);
+    return (xorDeslocado >> rotacao) | (xorDeslocado << ((-rotacao) & 31));
 }
 
-// ==================== OPERACOES AVANCADAS ====================
+/*
+ * aleatorioLimitado()
+ * Numero em [0, limite) sem vies de modulo (metodo de Lemire:
+ * multiplicacao de 64 bits, rejeitando a pequena faixa que causaria vies)
+ */
+uint32_t aleatorioLimitado(GeradorAleatorio* g, uint32_t limite) {
+    uint64_t m = (uint64_t)proximoAleatorio(g) * limite;
+    uint32_t baixo = (uint32_t)m;
+    if (baixo < limite) {
+        uint32_t limiar = (-limite) % limite;
+        while (baixo < limiar) {
+            m = (uint64_t)proximoAleatorio(g) * limite;
+            baixo = (uint32_t)m;
+        }
+    }
+    return (uint32_t)(m >> 32);
+}
+
+// ==================== POLITICAS DE GERACAO ====================
 
 /*
- * trocarPecaSimples()
- * Troca a peca da frente da fila com o topo da pilha
+ * iniciarGeradorPecas()
+ * Prepara o gerador da politica escolhida; o primeiro saco e gerado
+ * na primeira peca pedida
  */
-void trocarPecaSimples(FilaCircular* fila, Pilha* pilha) {
-    if (filaVazia(fila)) {
-        printf(">>> ERRO: Fila vazia! Impossivel trocar.\n");
+void iniciarGeradorPecas(GeradorPecas* g, PoliticaGeracao politica, uint64_t semente) {
+    g->politica = politica;
+    semearGerador(&g->aleatorio, semente, 0);
+    g->posSaco = 0;
+    g->tamSaco = 0;
+    g->primeira = 1;
+    g->proximoId = 0;
+    // Historico inicial do TGM2: Z S Z S (evita S/Z logo no inicio)
+    g->historico = 0x06050605u;
+}
+
+/*
+ * embaralhar()
+ * Fisher-Yates sobre os n primeiros tipos do saco
+ */
+static void embaralhar(GeradorPecas* g, int n) {
+    for (int i = n - 1; i > 0; i--) {
+        int j = (int)aleatorioLimitado(&g->aleatorio, (uint32_t)(i + 1));
+        unsigned char aux = g->saco[i];
+        g->saco[i] = g->saco[j];
+        g->saco[j] = aux;
+    }
+}
+
+int encherSacoUniforme(GeradorPecas* g) {
+    for (int i = 0; i < NUM_TIPOS; i++) {
+        g->saco[i] = (unsigned char)aleatorioLimitado(&g->aleatorio, NUM_TIPOS);
+    }
+    return NUM_TIPOS;
+}
+
+int encherSaco7(GeradorPecas* g) {
+    for (int i = 0; i < NUM_TIPOS; i++) {
+        g->saco[i] = (unsigned char)i;
+    }
+    embaralhar(g, NUM_TIPOS);
+    return NUM_TIPOS;
+}
+
+int encherSaco14(GeradorPecas* g) {
+    for (int i = 0; i < 2 * NUM_TIPOS; i++) {
+        g->saco[i] = (unsigned char)(i % NUM_TIPOS);
+    }
+    embaralhar(g, 2 * NUM_TIPOS);
+    return 2 * NUM_TIPOS;
+}
+
+/*
+ * encherSacoTgm()
+ * Estilo TGM: sorteia ate TENTATIVAS_TGM vezes, aceitando a primeira
+ * peca que nao esteja no historico das 4 ultimas. A primeira peca do
+ * jogo nunca e S, Z ou O.
+ */
+int encherSacoTgm(GeradorPecas* g) {
+    for (int i = 0; i < NUM_TIPOS; i++) {
+        unsigned int tipo = 0;
+        if (g->primeira) {
+            static const unsigned char inicio[4] = {0, 2, 3, 4};   // I T L J
+            tipo = inicio[aleatorioLimitado(&g->aleatorio, 4)];
+            g->primeira = 0;
+        } else {
+            // Conjunto dos tipos no historico, um bit por tipo
+            uint32_t h = g->historico;
+            unsigned int presentes = (1u << (h & 0xFF)) | (1u << ((h >> 8) & 0xFF)) |
+                                     (1u << ((h >> 16) & 0xFF)) | (1u << (h >> 24));
+            for (int t = 0; t < TENTATIVAS_TGM; t++) {
+                tipo = aleatorioLimitado(&g->aleatorio, NUM_TIPOS);
+                if (!(presentes & (1u << tipo))) break;
+            }
+        }
+        g->historico = (g->historico << 8) | tipo;
+        g->saco[i] = (unsigned char)tipo;
+    }
+    return NUM_TIPOS;
+}
+
+// Tabela das politicas: nome aceito em --gerador e funcao que enche o saco
+static const struct {
+    const char* nome;
+    int (*encher)(GeradorPecas* g);
+} POLITICAS[NUM_POLITICAS] = {
+    {"uniforme", encherSacoUniforme},
+    {"saco7",    encherSaco7},
+    {"saco14",   encherSaco14},
+    {"tgm",      encherSacoTgm},
+};
+
+int politicaPorNome(const char* nome) {
+    for (int i = 0; i < NUM_POLITICAS; i++) {
+        if (strcmp(nome, POLITICAS[i].nome) == 0) return i;
+    }
+    return -1;
+}
+
+const char* nomePolitica(PoliticaGeracao politica) {
+    return POLITICAS[politica].nome;
+}
+
+// ==================== RENDERIZACAO ====================
+
+static const char LINHA_DUPLA[] = "=====================================================\n";
+static const char LINHA_SIMPLES[] = "-----------------------------------------------------\n";
+
+void iniciarRenderizador(Renderizador* r, int descritor) {
+    memset(r, 0, sizeof(*r));
+    r->descritor = descritor;
+}
+
+// Copia a string sem o '\0' e devolve o fim
+static char* escreverTexto(char* p, const char* s) {
+    while (*s) *p++ = *s++;
+    return p;
+}
+
+// Decimal sem printf: digitos de tras para frente num buffer local
+static char* escreverInteiro(char* p, unsigned int v) {
+    char digitos[10];
+    int n = 0;
+    do {
+        digitos[n++] = (char)('0' + v % 10);
+        v /= 10;
+    } while (v != 0);
+    while (n > 0) *p++ = digitos[--n];
+    return p;
+}
+
+// "[T id] "
+static char* escreverPeca(char* p, Peca peca) {
+    *p++ = '[';
+    *p++ = nomePeca(peca);
+    *p++ = ' ';
+    p = escreverInteiro(p, (unsigned int)idPeca(peca));
+    *p++ = ']';
+    *p++ = ' ';
+    return p;
+}
+
+// "    (n/cap pecas)\n"
+static char* escreverOcupacao(char* p, int n, int capacidade) {
+    p = escreverTexto(p, "    (");
+    p = escreverInteiro(p, (unsigned int)n);
+    *p++ = '/';
+    p = escreverInteiro(p, (unsigned int)capacidade);
+    return escreverTexto(p, " pecas)\n");
+}
+
+// write() ate sair tudo (o descritor pode aceitar menos bytes por vez)
+static int escreverTudo(Renderizador* r, const char* dados, int tamanho) {
+    while (tamanho > 0) {
+        ssize_t n = write(r->descritor, dados, (size_t)tamanho);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return 0;
+        dados += n;
+        tamanho -= (int)n;
+        r->envios++;
+        r->bytes += (unsigned long)n;
+    }
+    return 1;
+}
+
+// Acrescenta bytes ao quadro; se nao couberem, envia o que ja havia
+static void acrescentar(Renderizador* r, const char* dados, int tamanho) {
+    if (r->tamanho + tamanho > TAM_QUADRO) enviarQuadro(r);
+    if (tamanho > TAM_QUADRO) {
+        fflush(stdout);
+        escreverTudo(r, dados, tamanho);
         return;
     }
+    memcpy(r->quadro + r->tamanho, dados, (size_t)tamanho);
+    r->tamanho += tamanho;
+}
+
+void renderizarTexto(Renderizador* r, const char* texto) {
+    acrescentar(r, texto, (int)strlen(texto));
+}
+
+/*
+ * renderizarEstado()
+ * Acrescenta ao quadro o mesmo texto de exibirEstado. A fila e a pilha
+ * so sao formatadas de novo quando o hash incremental (ou o tamanho)
+ * mudou desde o ultimo quadro; senao os bytes guardados sao reusados.
+ */
+void renderizarEstado(Renderizador* r, const FilaCircular* fila, const Pilha* pilha) {
+    SecaoTela* s = &r->fila;
+    int tamFila = (int)(fila->tras - fila->frente);
+    if (!s->valida || s->hash != fila->hash || s->tamanho != tamFila || s->capacidade != fila->capacidade) {
+        char* p = escreverTexto(s->texto, "Fila de pecas: ");
+        if (tamFila == 0) {
+            p = escreverTexto(p, "[VAZIA]\n");
+        } else {
+            for (unsigned int i = fila->frente; i != fila->tras; i++) {
+                p = escreverPeca(p, fila->elementos[i & fila->mascara]);
+            }
+            *p++ = '\n';
+        }
+        p = escreverOcupacao(p, tamFila, fila->capacidade);
+        s->bytes = (int)(p - s->texto);
+        s->hash = fila->hash;
+        s->tamanho = tamFila;
+        s->capacidade = fila->capacidade;
+        s->valida = 1;
+        r->secoesRefeitas++;
+    }
     
-    if (pilhaVazia(pilha)) {
-        printf(">>> ERRO: Pilha vazia! Impossivel trocar.\n");
-        return;
+    s = &r->pilha;
+    int tamPilha = pilha->topo + 1;
+    if (!s->valida || s->hash != pilha->hash || s->tamanho != tamPilha || s->capacidade != pilha->capacidade) {
+        char* p = escreverTexto(s->texto, "Pilha de reserva (Topo -> Base): ");
+        if (tamPilha == 0) {
+            p = escreverTexto(p, "[VAZIA]\n");
+        } else {
+            for (int i = pilha->topo; i >= 0; i--) p = escreverPeca(p, pilha->elementos[i]);
+            *p++ = '\n';
+        }
+        p = escreverOcupacao(p, tamPilha, pilha->capacidade);
+        s->bytes = (int)(p - s->texto);
+        s->hash = pilha->hash;
+        s->tamanho = tamPilha;
+        s->capacidade = pilha->capacidade;
+        s->valida = 1;
+        r->secoesRefeitas++;
     }
     
-    printf(">>> TROCA SIMPLES:\n");
+    renderizarTexto(r, "\n");
+    renderizarTexto(r, LINHA_DUPLA);
+    renderizarTexto(r, "           ESTADO ATUAL DO SISTEMA\n");
+    renderizarTexto(r, LINHA_DUPLA);
+    acrescentar(r, r->fila.texto, r->fila.bytes);
+    renderizarTexto(r, LINHA_SIMPLES);
+    acrescentar(r, r->pilha.texto, r->pilha.bytes);
+    renderizarTexto(r, LINHA_DUPLA);
+}
+
+/*
+ * renderizarMenu()
+ * Acrescenta o menu de opcoes. So a linha da troca multipla depende do
+ * estado (capacidades da fila e da pilha), entao o texto fica pronto
+ * entre quadros.
+ */
+void renderizarMenu(Renderizador* r, const FilaCircular* fila, const Pilha* pilha) {
+    SecaoTela* s = &r->menu;
+    int n = tamanhoTrocaMultipla(fila, pilha);
+    if (!s->valida || s->capacidade != n) {
+        char* p = escreverTexto(s->texto, "\n");
+        p = escreverTexto(p, LINHA_DUPLA);
+        p = escreverTexto(p, "              MENU DE OPCOES\n");
+        p = escreverTexto(p, LINHA_DUPLA);
+        p = escreverTexto(p, "1 - Jogar peca da frente da fila\n"
+                             "2 - Enviar peca da fila para pilha de reserva\n"
+                             "3 - Usar peca da pilha de reserva\n"
+                             "4 - Trocar frente da fila com topo da pilha\n"
+                             "5 - Trocar ");
+        p = escreverInteiro(p, (unsigned int)n);
+        p = escreverTexto(p, " primeiras (fila) com ");
+        p = escreverInteiro(p, (unsigned int)n);
+        p = escreverTexto(p, " (pilha)\n"
+                             "6 - Desfazer ultima operacao\n"
+                             "7 - Refazer operacao desfeita\n"
+                             "8 - Buscar jogadas ate uma peca na frente\n"
+                             "9 - Avaliar jogar x reservar (Monte Carlo)\n"
+                             "0 - Sair\n");
+        p = escreverTexto(p, LINHA_DUPLA);
+        s->bytes = (int)(p - s->texto);
+        s->capacidade = n;
+        s->valida = 1;
+        r->secoesRefeitas++;
+    }
+    acrescentar(r, s->texto, s->bytes);
+}
+
+/*
+ * enviarQuadro()
+ * Esvazia o buffer do stdio (mensagens impressas antes do quadro tem
+ * que sair antes dele) e manda o quadro inteiro num unico write().
+ * Retorna 0 em erro de escrita.
+ */
+int enviarQuadro(Renderizador* r) {
+    if (r->tamanho == 0) return 1;
+    fflush(stdout);
+    int ok = escreverTudo(r, r->quadro, r->tamanho);
+    r->quadros++;
+    r->tamanho = 0;
+    return ok;
+}
+
+// ==================== INTERFACE DE TERMINAL (TUI) ====================
+
+static struct termios terminalOriginal;
+static volatile sig_atomic_t terminalAlterado = 0;
+
+// Volta o terminal ao modo original; seguro dentro de um tratador de sinal
+static void restaurarTerminal(void) {
+    static const char sair[] = "\x1b[?25h\x1b[?1049l";
+    if (!terminalAlterado) return;
+    ssize_t ignorado = write(STDOUT_FILENO, sair, sizeof(sair) - 1);
+    (void)ignorado;
+    tcsetattr(STDIN_FILENO, TCSAFLUSH, &terminalOriginal);
+    terminalAlterado = 0;
+}
+
+static void tratarSinalTui(int sinal) {
+    restaurarTerminal();
+    signal(sinal, SIG_DFL);
+    raise(sinal);
+}
+
+/*
+ * entrarModoBruto()
+ * Tecla a tecla, sem eco e sem esperar ENTER (ICANON/ECHO desligados,
+ * VMIN = 1). Ctrl-C continua gerando SIGINT, que restaura o terminal.
+ * Sem terminal (entrada por pipe) nada muda e o TUI le byte a byte.
+ */
+static void entrarModoBruto(void) {
+    if (!isatty(STDIN_FILENO) || tcgetattr(STDIN_FILENO, &terminalOriginal) != 0) return;
     
-    // Guarda as pecas
-    Peca pecaFila = frente(fila);
-    Peca pecaPilha = topo(pilha);
+    struct termios bruto = terminalOriginal;
+    bruto.c_lflag &= ~(tcflag_t)(ICANON | ECHO | IEXTEN);
+    bruto.c_iflag &= ~(tcflag_t)(IXON | ICRNL);
+    bruto.c_cc[VMIN] = 1;
+    bruto.c_cc[VTIME] = 0;
+    if (tcsetattr(STDIN_FILENO, TCSAFLUSH, &bruto) != 0) return;
+    
+    terminalAlterado = 1;
+    atexit(restaurarTerminal);
+    signal(SIGINT, tratarSinalTui);
+    signal(SIGTERM, tratarSinalTui);
+    signal(SIGQUIT, tratarSinalTui);
+}
+
+// Escreve texto no modelo da tela; devolve a coluna seguinte
+static int tuiEscrever(TelaTui* t, int linha, int coluna, const char* texto) {
+    while (*texto && coluna < TUI_COLUNAS) t->atual[linha][coluna++] = *texto++;
+    return coluna;
+}
+
+static int tuiNumero(TelaTui* t, int linha, int coluna, unsigned long valor) {
+    char texto[24];
+    char* fim = texto;
+    if (valor > 0xFFFFFFFFul) valor = 0xFFFFFFFFul;
+    fim = escreverInteiro(fim, (unsigned int)valor);
+    *fim = '\0';
+    return tuiEscrever(t, linha, coluna, texto);
+}
+
+static int tuiPeca(TelaTui* t, int linha, int coluna, Peca p) {
+    char texto[16];
+    char* fim = escreverPeca(texto, p);
+    fim[-1] = '\0';     // Sem o espaco final
+    return tuiEscrever(t, linha, coluna, texto);
+}
+
+/*
+ * desenharTui()
+ * Monta o quadro atual no modelo da tela (so memoria). Cada peca da
+ * fila e da pilha ocupa uma celula fixa de TUI_CELULA colunas, entao
+ * mudar uma peca muda so a sua celula.
+ */
+static void desenharTui(TelaTui* t, const Sessao* s) {
+    const FilaCircular* fila = &s->fila;
+    const Pilha* pilha = &s->pilha;
+    int tamFila = (int)(fila->tras - fila->frente);
+    int c;
     
-    printf("    Fila (frente): [%c %d]\n", pecaFila.nome, pecaFila.id);
-    printf("    Pilha (topo): [%c %d]\n", pecaPilha.nome, pecaPilha.id);
+    memset(t->atual, ' ', sizeof(t->atual));
+    c = tuiEscrever(t, 0, 0, "TETRIS STACK - MESTRE (tui)   gerador ");
+    tuiEscrever(t, 0, c, nomePolitica(s->gerador.politica));
+    memset(t->atual[1], '=', TUI_LARGURA);
     
-    // Remove de ambas
-    dequeue(fila);
-    pop(pilha);
+    c = tuiEscrever(t, 2, 0, "Fila  (");
+    c = tuiNumero(t, 2, c, (unsigned long)tamFila);
+    c = tuiEscrever(t, 2, c, "/");
+    c = tuiNumero(t, 2, c, (unsigned long)fila->capacidade);
+    tuiEscrever(t, 2, c, "):");
+    for (int i = 0; i < tamFila; i++) {
+        int linha = 2 + i / TUI_POR_LINHA;
+        int coluna = TUI_INICIO_CELULAS + (i % TUI_POR_LINHA) * TUI_CELULA;
+        t->atual[linha][coluna] = nomePeca(fila->elementos[(fila->frente + i) & fila->mascara]);
+    }
     
-    // Insere trocadas
-    push(pilha, pecaFila);
-    enqueue(fila, pecaPilha);
+    c = tuiEscrever(t, 4, 0, "Pilha (");
+    c = tuiNumero(t, 4, c, (unsigned long)(pilha->topo + 1));
+    c = tuiEscrever(t, 4, c, "/");
+    c = tuiNumero(t, 4, c, (unsigned long)pilha->capacidade);
+    tuiEscrever(t, 4, c, "):");
+    for (int i = pilha->topo, k = 0; i >= 0; i--, k++) {
+        t->atual[4][TUI_INICIO_CELULAS + k * TUI_CELULA] = nomePeca(pilha->elementos[i]);
+    }
     
-    printf("\n>>> TROCA REALIZADA COM SUCESSO!\n");
+    c = tuiEscrever(t, 5, 0, "Frente: ");
+    c = tamFila > 0 ? tuiPeca(t, 5, c, fila->elementos[fila->frente & fila->mascara])
+                    : tuiEscrever(t, 5, c, "-");
+    c = tuiEscrever(t, 5, c, "   Topo: ");
+    if (pilha->topo >= 0) tuiPeca(t, 5, c, pilha->elementos[pilha->topo]);
+    else tuiEscrever(t, 5, c, "-");
+    memset(t->atual[6], '-', TUI_LARGURA);
+    
+    tuiEscrever(t, 7, 0, t->mensagem);
+    tuiEscrever(t, 8, 0, t->busca);
+    memset(t->atual[9], '-', TUI_LARGURA);
+    tuiEscrever(t, 10, 0, "1 jogar  2 reservar  3 usar  4 troca  5 troca multipla");
+    tuiEscrever(t, 11, 0, "6 desfazer  7 refazer  8+tipo busca  9 avaliar  l redesenhar  0/q sair");
+    
+    if (t->medir && t->quadros > 0) {
+        c = tuiEscrever(t, 12, 0, "tecla->quadro: ");
+        c = tuiNumero(t, 12, c, (unsigned long)(t->ultimoNs / 1000));
+        c = tuiEscrever(t, 12, c, " us (max ");
+        c = tuiNumero(t, 12, c, (unsigned long)(t->maximoNs / 1000));
+        c = tuiEscrever(t, 12, c, " us)  bytes: ");
+        tuiNumero(t, 12, c, (unsigned long)t->ultimosBytes);
+    }
 }
 
 /*
- * trocarMultipla()
- * Troca as 3 primeiras pecas da fila com as 3 da pilha
+ * enviarDiferencas()
+ * Compara o modelo com o que ja esta no terminal e emite so os trechos
+ * que mudaram, cada um com o cursor posicionado (ESC[linha;colunaH).
+ * Trechos separados por ate TUI_FOLGA colunas iguais viram um so,
+ * porque reescrever poucas letras custa menos que outro ESC[..H.
  */
-void trocarMultipla(FilaCircular* fila, Pilha* pilha) {
-    // Valida se tem 3 em cada
-    if (fila->tamanho < 3) {
-        printf(">>> ERRO: Fila precisa ter pelo menos 3 pecas!\n");
-        printf(">>> Atual: %d pecas\n", fila->tamanho);
-        return;
+static void enviarDiferencas(TelaTui* t) {
+    Renderizador* r = &t->saida;
+    unsigned long antes = r->bytes;
+    
+    if (t->redesenhar) {
+        renderizarTexto(r, "\x1b[H\x1b[2J");
+        memset(t->anterior, ' ', sizeof(t->anterior));
+        t->redesenhar = 0;
+    }
+    for (int l = 0; l < TUI_LINHAS; l++) {
+        int c = 0;
+        while (c < TUI_COLUNAS) {
+            if (t->atual[l][c] == t->anterior[l][c]) {
+                c++;
+                continue;
+            }
+            int fim = c + 1;
+            for (int k = c + 1; k < TUI_COLUNAS && k - fim < TUI_FOLGA; k++) {
+                if (t->atual[l][k] != t->anterior[l][k]) fim = k + 1;
+            }
+            char cursor[16];
+            char* p = escreverTexto(cursor, "\x1b[");
+            p = escreverInteiro(p, (unsigned int)l + 1);
+            *p++ = ';';
+            p = escreverInteiro(p, (unsigned int)c + 1);
+            *p++ = 'H';
+            acrescentar(r, cursor, (int)(p - cursor));
+            acrescentar(r, &t->atual[l][c], fim - c);
+            c = fim;
+        }
     }
+    memcpy(t->anterior, t->atual, sizeof(t->atual));
     
-    if (pilha->topo + 1 < 3) {
-        printf(">>> ERRO: Pilha precisa ter 3 pecas!\n");
-        printf(">>> Atual: %d pecas\n", pilha->topo + 1);
+    enviarQuadro(r);
+    t->ultimosBytes = r->bytes - antes;
+}
+
+// Texto da mensagem de uma operacao (como no menu, sem printf)
+static void mensagemOperacao(TelaTui* t, int opcao, Resultado r, Peca p) {
+    static const char* ACOES[NUM_OPCOES + 1] = {"", "PECA JOGADA: ", "PECA RESERVADA: ",
+        "PECA USADA: ", "TROCA SIMPLES REALIZADA", "TROCA MULTIPLA REALIZADA",
+        "OPERACAO DESFEITA", "OPERACAO REFEITA"};
+    static const char* ERROS[NUM_RESULTADOS] = {"", "ERRO: Fila vazia!", "ERRO: Pilha cheia!",
+        "ERRO: Pilha vazia!", "ERRO: Pecas insuficientes para a troca!", "ERRO: Opcao invalida!",
+        "ERRO: Nada para desfazer!", "ERRO: Nada para refazer!"};
+    char* m = t->mensagem;
+    
+    if (r != RES_OK) {
+        m = escreverTexto(m, ERROS[r]);
+    } else {
+        m = escreverTexto(m, ACOES[opcao]);
+        if (opcao <= 3) {
+            m = escreverPeca(m, p);
+            m--;
+        }
+    }
+    *m = '\0';
+}
+
+// Resultado da busca em uma linha: "Busca [I]: 2 1 4 (3 jogadas, 812 us)"
+static void mensagemBusca(TelaTui* t, int alvo, const ResultadoBusca* r) {
+    char* m = escreverTexto(t->busca, "Busca [");
+    *m++ = TIPOS_PECA[alvo];
+    m = escreverTexto(m, "]: ");
+    if (!r->atingiu) {
+        m = escreverTexto(m, "nenhuma sequencia em ");
+        m = escreverInteiro(m, (unsigned int)r->profundidade);
+        m = escreverTexto(m, " jogadas");
+    } else if (r->numJogadas == 0) {
+        m = escreverTexto(m, "ja esta na frente");
+    } else {
+        for (int i = 0; i < r->numJogadas; i++) {
+            *m++ = (char)('0' + r->jogadas[i]);
+            *m++ = ' ';
+        }
+        *m++ = '(';
+        m = escreverInteiro(m, (unsigned int)r->numJogadas);
+        m = escreverTexto(m, " jogadas, ");
+        m = escreverInteiro(m, (unsigned int)r->tempoUs);
+        m = escreverTexto(m, " us)");
+    }
+    *m = '\0';
+}
+
+// Avaliacao em uma linha: "Avaliar: jogar 2.10+-0.04 reservar 2.31+-0.04 -> reservar"
+static void mensagemAvaliacao(TelaTui* t, const ResultadoAvaliacao* r) {
+    if (!r->podeReservar) {
+        snprintf(t->busca, sizeof(t->busca), "Avaliar: pilha cheia, so jogar (%.2f+-%.2f linhas)",
+                 r->jogar.media, r->jogar.margem);
         return;
     }
+    snprintf(t->busca, sizeof(t->busca), "Avaliar: jogar %.2f+-%.2f reservar %.2f+-%.2f -> %s (%lu)",
+             r->jogar.media, r->jogar.margem, r->reservar.media, r->reservar.margem,
+             r->escolha == 0 ? "empate" : NOMES_JOGADA[r->escolha], r->amostras);
+}
+
+static int compararLong(const void* a, const void* b) {
+    long x = *(const long*)a;
+    long y = *(const long*)b;
+    return (x > y) - (x < y);
+}
+
+/*
+ * executarTui()
+ * Laco do modo --tui: le uma tecla por vez (read de 1 byte, sem ENTER),
+ * executa a operacao e envia so as diferencas da tela, tudo antes de
+ * voltar a esperar. Com 'medir' mede o tempo de cada tecla ate o fim
+ * do write do quadro e, ao sair, imprime media, p50, p99 e maximo.
+ */
+int executarTui(Sessao* s, GravadorReplay* gravador, int medir) {
+    static TelaTui t;
+    static long amostras[TUI_AMOSTRAS];
+    Historico historico;
+    unsigned long numAmostras = 0;
+    unsigned long long somaNs = 0;
+    int buscaPendente = 0;
+    unsigned char tecla;
     
-    printf(">>> TROCA MULTIPLA (3 x 3):\n");
-    
-    // Arrays temporarios
-    Peca tempFila[3];
-    Peca tempPilha[3];
+    memset(&t, 0, sizeof(t));
+    iniciarRenderizador(&t.saida, STDOUT_FILENO);
+    iniciarHistorico(&historico);
+    t.medir = medir;
+    t.redesenhar = 1;
+    strcpy(t.mensagem, "Pressione uma tecla");
     
-    // Remove 3 da fila
-    printf("\n    Removendo da fila:\n");
-    for (int i = 0; i < 3; i++) {
-        tempFila[i] = dequeue(fila);
-        printf("      [%c %d]\n", tempFila[i].nome, tempFila[i].id);
-    }
+    entrarModoBruto();
+    renderizarTexto(&t.saida, "\x1b[?1049h\x1b[?25l");
+    desenharTui(&t, s);
+    enviarDiferencas(&t);
     
-    // Remove 3 da pilha
-    printf("\n    Removendo da pilha:\n");
-    for (int i = 0; i < 3; i++) {
-        tempPilha[i] = pop(pilha);
-        printf("      [%c %d]\n", tempPilha[i].nome, tempPilha[i].id);
+    while (read(STDIN_FILENO, &tecla, 1) == 1) {
+        long inicio = 0;
+        struct timespec agora;
+        if (medir) {
+            clock_gettime(CLOCK_MONOTONIC, &agora);
+            inicio = agora.tv_sec * 1000000000L + agora.tv_nsec;
+        }
+        
+        if (buscaPendente) {
+            int alvo = -1;
+            for (int i = 0; i < NUM_TIPOS; i++) {
+                if (TIPOS_PECA[i] == tecla || TIPOS_PECA[i] == tecla - 'a' + 'A') alvo = i;
+            }
+            if (alvo >= 0) {
+                ResultadoBusca r;
+                if (buscarAtePecaNaFrente(s, alvo, &r)) mensagemBusca(&t, alvo, &r);
+            } else {
+                strcpy(t.busca, "Busca: tipo invalido");
+            }
+            buscaPendente = 0;
+        } else if (tecla == '0' || tecla == 'q') {
+            break;
+        } else if (tecla >= '1' && tecla <= '0' + NUM_OPCOES) {
+            int opcao = tecla - '0';
+            Peca p = PECA_NENHUMA;
+            Resultado r = executarComHistorico(s, &historico, opcao, &p);
+            if (gravador != NULL) gravarOperacao(gravador, s, opcao);
+            mensagemOperacao(&t, opcao, r, p);
+            t.busca[0] = '\0';
+        } else if (tecla == '8') {
+            buscaPendente = 1;
+            strcpy(t.busca, "Busca: tipo da peca? (I O T L J S Z)");
+        } else if (tecla == '9') {
+            ResultadoAvaliacao r;
+            if (avaliarReservaPadrao(s, &r)) mensagemAvaliacao(&t, &r);
+        } else if (tecla == 'l' || tecla == 12) {
+            t.redesenhar = 1;   // l ou Ctrl-L: tela inteira de novo
+        } else {
+            continue;           // Tecla sem funcao: nada muda
+        }
+        
+        desenharTui(&t, s);
+        enviarDiferencas(&t);
+        
+        if (medir) {
+            clock_gettime(CLOCK_MONOTONIC, &agora);
+            long ns = agora.tv_sec * 1000000000L + agora.tv_nsec - inicio;
+            amostras[numAmostras % TUI_AMOSTRAS] = ns;
+            numAmostras++;
+            somaNs += (unsigned long long)ns;
+            t.ultimoNs = ns;
+            if (ns > t.maximoNs) t.maximoNs = ns;
+        }
+        t.quadros++;
     }
     
-    // Coloca pecas da pilha na fila
-    printf("\n    Inserindo na fila (pecas da pilha):\n");
-    for (int i = 0; i < 3; i++) {
-        enqueue(fila, tempPilha[i]);
-        printf("      [%c %d]\n", tempPilha[i].nome, tempPilha[i].id);
-    }
+    // Com o terminal em modo bruto a restauracao ja reexibe o cursor
+    if (!terminalAlterado) renderizarTexto(&t.saida, "\x1b[?25h\x1b[?1049l");
+    enviarQuadro(&t.saida);
+    restaurarTerminal();
     
-    // Coloca pecas da fila na pilha
-    printf("\n    Inserindo na pilha (pecas da fila):\n");
-    for (int i = 2; i >= 0; i--) {  // Inverte ordem
-        push(pilha, tempFila[i]);
-        printf("      [%c %d]\n", tempFila[i].nome, tempFila[i].id);
+    if (medir && numAmostras > 0) {
+        int n = numAmostras < TUI_AMOSTRAS ? (int)numAmostras : TUI_AMOSTRAS;
+        qsort(amostras, (size_t)n, sizeof(long), compararLong);
+        fprintf(stderr, "Teclas medidas: %lu (ultimas %d nos percentis)\n", numAmostras, n);
+        fprintf(stderr, "Tecla -> quadro: medio %.1f us, p50 %.1f us, p99 %.1f us, max %.1f us\n",
+                (double)somaNs / numAmostras / 1e3, amostras[n / 2] / 1e3,
+                amostras[(n * 99) / 100] / 1e3, t.maximoNs / 1e3);
+        fprintf(stderr, "Quadros: %lu, write(): %lu, bytes: %lu (%.1f por quadro)\n",
+                t.saida.quadros, t.saida.envios, t.saida.bytes,
+                (double)t.saida.bytes / (t.saida.quadros > 0 ? t.saida.quadros : 1));
     }
     
-    printf("\n>>> TROCA MULTIPLA REALIZADA COM SUCESSO!\n");
+    int erroGravacao = gravador != NULL && !fecharGravador(gravador, s);
+    if (erroGravacao) fprintf(stderr, "ERRO: falha ao gravar o log de replay\n");
+    return erroGravacao;
 }
 
 // ==================== FUNCOES GERAIS ====================
 
-Peca gerarPeca() {
-    Peca p;
-    char tipos[] = {'I', 'O', 'T', 'L'};
-    p.nome = tipos[rand() % 4];
-    p.id = proximoId++;
-    return p;
+Peca gerarPeca(GeradorPecas* gerador) {
+    if (gerador->posSaco == gerador->tamSaco) {
+        gerador->tamSaco = POLITICAS[gerador->politica].encher(gerador);
+        gerador->posSaco = 0;
+    }
+    CONTAR(EV_PECA_GERADA);
+    return criarPeca(gerador->saco[gerador->posSaco++], gerador->proximoId++);
+}
+
+/*
+ * reporFila()
+ * Completa a fila de uma vez, gerando as pecas direto nas posicoes
+ * livres do array (sem passar por enqueue peca a peca)
+ */
+void reporFila(FilaCircular* fila, GeradorPecas* gerador) {
+    unsigned int limite = fila->frente + (unsigned int)fila->capacidade;
+    while (fila->tras != limite) {
+        Peca p = gerarPeca(gerador);
+        fila->elementos[fila->tras & fila->mascara] = p;
+        fila->tras++;
+        fila->hash += chaveFila(p) * fila->potencia;
+        fila->potencia *= HASH_BASE;
+    }
+    CONFERIR_HASH_FILA(fila);
+}
+
+// Tela compartilhada por exibirEstado/exibirMenu (saida padrao)
+static Renderizador telaPadrao;
+static int telaPadraoPronta = 0;
+
+static Renderizador* obterTelaPadrao(void) {
+    if (!telaPadraoPronta) {
+        iniciarRenderizador(&telaPadrao, STDOUT_FILENO);
+        telaPadraoPronta = 1;
+    }
+    return &telaPadrao;
 }
 
 void exibirEstado(FilaCircular* fila, Pilha* pilha) {
-    printf("\n=====================================================\n");
-    printf("           ESTADO ATUAL DO SISTEMA\n");
-    printf("=====================================================\n");
+    renderizarEstado(obterTelaPadrao(), fila, pilha);
+    enviarQuadro(obterTelaPadrao());
+}
+
+void exibirMenu(FilaCircular* fila, Pilha* pilha) {
+    renderizarMenu(obterTelaPadrao(), fila, pilha);
+    enviarQuadro(obterTelaPadrao());
+}
+
+/*
+ * sugerirSequencia()
+ * Pergunta um tipo e mostra a menor sequencia de jogadas (opcoes 1-5)
+ * que o leva a frente da fila, sem alterar a sessao. Pecas que ainda
+ * nao foram geradas sao desconhecidas, entao so conta o que esta visivel.
+ */
+void sugerirSequencia(const Sessao* s) {
+    char letra;
+    int alvo = -1;
     
-    // Fila
-    printf("Fila de pecas: ");
-    if (filaVazia(fila)) {
-        printf("[VAZIA]\n");
-    } else {
-        int i = fila->frente;
-        int cont = 0;
-        while (cont < fila->tamanho) {
-            printf("[%c %d] ", fila->elementos[i].nome, fila->elementos[i].id);
-            i = (i + 1) % TAM_FILA;
-            cont++;
-        }
-        printf("\n");
+    printf("Tipo da peca (I O T L J S Z): ");
+    if (scanf(" %c", &letra) != 1) return;
+    for (int t = 0; t < NUM_TIPOS; t++) {
+        if (TIPOS_PECA[t] == letra || TIPOS_PECA[t] == letra - 'a' + 'A') alvo = t;
+    }
+    if (alvo < 0) {
+        printf(">>> ERRO: Tipo invalido!\n");
+        return;
     }
-    printf("    (%d/%d pecas)\n", fila->tamanho, TAM_FILA);
     
-    printf("-----------------------------------------------------\n");
+    ResultadoBusca r;
+    if (!buscarAtePecaNaFrente(s, alvo, &r)) {
+        printf(">>> ERRO: memoria insuficiente\n");
+        return;
+    }
     
-    // Pilha
-    printf("Pilha de reserva (Topo -> Base): ");
-    if (pilhaVazia(pilha)) {
-        printf("[VAZIA]\n");
+    if (!r.atingiu) {
+        printf(">>> Nenhuma sequencia ate [%c] em %d jogadas (%ld us)\n",
+               TIPOS_PECA[alvo], r.profundidade, r.tempoUs);
+    } else if (r.numJogadas == 0) {
+        printf(">>> [%c] ja esta na frente da fila!\n", TIPOS_PECA[alvo]);
     } else {
-        for (int i = pilha->topo; i >= 0; i--) {
-            printf("[%c %d] ", pilha->elementos[i].nome, pilha->elementos[i].id);
+        printf(">>> SEQUENCIA ATE [%c] (%d jogadas, %lu nos, %ld us):\n",
+               TIPOS_PECA[alvo], r.numJogadas, r.nos, r.tempoUs);
+        for (int i = 0; i < r.numJogadas; i++) {
+            printf("    %d. opcao %d - %s\n", i + 1, r.jogadas[i], NOMES_JOGADA[r.jogadas[i]]);
         }
-        printf("\n");
     }
-    printf("    (%d/%d pecas)\n", pilha->topo + 1, TAM_PILHA);
-    
-    printf("=====================================================\n");
 }
 
-void exibirMenu() {
-    printf("\n=====================================================\n");
-    printf("              MENU DE OPCOES\n");
-    printf("=====================================================\n");
-    printf("1 - Jogar peca da frente da fila\n");
-    printf("2 - Enviar peca da fila para pilha de reserva\n");
-    printf("3 - Usar peca da pilha de reserva\n");
-    printf("4 - Trocar frente da fila com topo da pilha\n");
-    printf("5 - Trocar 3 primeiras (fila) com 3 (pilha)\n");
-    printf("0 - Sair\n");
-    printf("=====================================================\n");
+/*
+ * sugerirReserva()
+ * Mostra a avaliacao Monte Carlo de jogar x reservar a frente da fila
+ * (medias com intervalo de 95%), sem alterar a sessao
+ */
+void sugerirReserva(const Sessao* s) {
+    ResultadoAvaliacao r;
+    if (!avaliarReservaPadrao(s, &r)) {
+        printf(">>> ERRO: Fila vazia!\n");
+        return;
+    }
+    
+    printf(">>> AVALIACAO MONTE CARLO (%lu pares de continuacoes, %ld us, %d pecas cada):\n",
+           r.amostras, r.tempoUs, MC_HORIZONTE_PADRAO);
+    printf("    1 - jogar:    %6.3f +- %.3f linhas\n", r.jogar.media, r.jogar.margem);
+    if (!r.podeReservar) {
+        printf(">>> Pilha cheia: so jogar e possivel\n");
+        return;
+    }
+    printf("    2 - reservar: %6.3f +- %.3f linhas\n", r.reservar.media, r.reservar.margem);
+    printf("    diferenca:    %+6.3f +- %.3f (reservar - jogar, 95%%)\n",
+           r.diferenca.media, r.diferenca.margem);
+    if (r.escolha == 0) {
+        printf(">>> Empate: a diferenca esta dentro da margem\n");
+    } else {
+        printf(">>> MELHOR: opcao %d - %s\n", r.escolha, NOMES_JOGADA[r.escolha]);
+    }
 }
 
 void pausar() {
@@ -409,22 +4975,42 @@ void pausar() {
  *    - Estrategia: pegar peca especifica da pilha
  * 
  * 2. TROCA MULTIPLA (Opcao 5):
- *    - Troca 3 primeiras da fila com 3 da pilha
+ *    - Troca N primeiras da fila com as N da pilha
+ *      (N = capacidade da pilha, 3 no padrao, limitada pela da fila)
  *    - Reorganizacao massiva
- *    - Usa arrays temporarios
+ *    - Troca no lugar (trocarK): indice circular na fila e acesso
+ *      direto na pilha, sem arrays temporarios
  *    - Inverte ordem ao inserir na pilha
- *    - Operacao O(n) onde n=3
+ *    - Operacao O(n) onde n=N
  * 
  * 3. COMPLEXIDADE DAS OPERACOES:
+ *    - Indice da fila: contador & mascara (capacidade potencia de 2),
+ *      sem divisao no enqueue/dequeue
+ *    - FilaSpsc: mesma fila para gerador e jogo em threads diferentes,
+ *      sem travas (acquire/release em frente/tras, cada contador na
+ *      sua linha de cache)
  *    - Jogar/Reservar/Usar: O(1)
  *    - Troca simples: O(1)
- *    - Troca multipla: O(1) - tamanho fixo
+ *    - Troca multipla: O(N), N = min(capacidade da fila, da pilha)
+ *    - Hash do estado (hashFilaPilha): O(1), mantido por cada operacao;
+ *      fila = soma de chave(peca) * HASH_BASE^posicao (sair da frente
+ *      multiplica pela inversa), pilha = XOR Zobrist por (posicao, peca).
+ *      Compilar com -DVERIFICAR_HASH recalcula e confere a cada operacao
  * 
  * 4. ESTRATEGIAS POSSIVEIS:
  *    - Reservar pecas "boas" para momento certo
  *    - Trocar simples para pegar peca especifica
  *    - Troca multipla para reorganizar sequencia
  *    - Combinar operacoes para otimizar jogadas
+ *    - Busca (Opcao 8): aprofundamento iterativo sobre as opcoes 1-5
+ *      no estado visivel (pecas futuras sao desconhecidas); acha a
+ *      menor sequencia ate um tipo na frente ou a maior nota de uma
+ *      FuncaoPontuacao qualquer
+ *    - Tabela de transposicao sem travas, chave Zobrist dos tipos; a
+ *      melhor jogada guardada e tentada primeiro na iteracao seguinte
+ *    - Cada iteracao e dividida em 25 tarefas (pares de jogadas da
+ *      raiz) entre as threads; com o tempo esgotado vale a ultima
+ *      iteracao completa
  * 
  * 5. INTEGRACAO FILA-PILHA:
  *    - Fila: ordem de chegada (FIFO)
@@ -432,10 +5018,119 @@ void pausar() {
  *    - Trocas permitem flexibilidade estrategica
  *    - Sistema completo e funcional
  * 
- * 6. VALIDACOES:
+ * 6. DESFAZER / REFAZER (Opcoes 6 e 7):
+ *    - Historico de TAM_HISTORICO deltas por sessao, memoria fixa
+ *    - Cada delta guarda so o codigo, a peca descartada e, se a peca
+ *      gerada abriu um saco novo, o estado do gerador de antes
+ *    - Desfazer e O(k) nas k pecas movidas; refazer repete a operacao
+ * 
+ * 7. VALIDACOES:
  *    - Verifica espacos antes de operacoes
- *    - Garante 3 pecas para troca multipla
+ *    - Garante N pecas para troca multipla
  *    - Mensagens claras de erro
  *    - Feedback detalhado das trocas
+ * 
+ * 8. GERACAO DE PECAS:
+ *    - PCG32 com semente explicita (--semente), sem rand()/srand()
+ *    - Mesma semente => mesma sequencia em qualquer plataforma
+ *    - Sorteio sem vies de modulo (aleatorioLimitado)
+ *    - 7 tipos (I O T L J S Z) e politicas de sorteio: uniforme,
+ *      saco de 7, saco de 14 e historico estilo TGM (--gerador)
+ *    - Cada politica gera um saco inteiro de uma vez
+ * 
+ * 9. SESSOES:
+ *    - Sessao = fila + pilha + gerador + contador de ids, sem globais
+ *    - Motor: pool de sessoes em slab, criar/destruir O(1) com pilha
+ *      de indices livres e array denso de ativas (motorPasso)
+ *    - MotorSoA: mesmos dados em arrays paralelos (frentes, tras,
+ *      topos, geradores) para jogar/reservar/usar em lote sem desvios;
+ *      so sorteio uniforme (criarMotorSoA recusa as outras politicas)
+ *    - Escalonador: blocos de sessoes divididos entre um trabalhador
+ *      por nucleo, com roubo de tarefas entre deques; cada sessao so
+ *      e tocada por uma tarefa por rodada, entao a ordem das operacoes
+ *      de cada sessao e preservada
+ * 
+ * 10. REPLAY (--gravar, reproducao.c):
+ *    - Cabecalho com semente e configuracao + 1 byte por operacao
+ *    - Checkpoint com resumo do estado e das operacoes a cada 4096
+ *      operacoes: a reproducao confere cada um e aponta onde divergiu
+ *    - A reproducao mapeia o arquivo (mmap), sem ler tudo para a RAM
+ * 
+ * 11. SNAPSHOTS (--salvar / --carregar):
+ *    - Bloco de tamanho fixo e versionado com contadores, gerador e as
+ *      pecas no layout da arena; restaurar nao reordena nada
+ *    - ArmazemCheckpoints: snapshots imutaveis com contagem de
+ *      referencias; compartilhar e O(1) e so copia ao restaurar (fora
+ *      do jogo: desfazer usa deltas e a busca copia EstadoBusca)
+ * 
+ * 12. MEMORIA:
+ *    - Peca compactada em 32 bits (tipo em 3 bits + id em 29 bits);
+ *      fila, pilha e trocas copiam inteiros
+ *    - Capacidades escolhidas no inicio (--fila 1-64, --pilha 1-16)
+ *    - Fila e pilha usam uma unica alocacao (arena), feita uma vez;
+ *      nenhuma operacao do jogo aloca memoria
+ * 
+ * 13. TELA:
+ *    - Estado, menu e prompt formatados num buffer fixo (Renderizador)
+ *      e enviados com um write() por quadro, em vez de ~24 escritas do
+ *      stdio com buffer de linha
+ *    - Inteiros formatados a mao, sem printf
+ *    - Fila e pilha so sao reformatadas quando o hash incremental muda;
+ *      o menu so quando muda o N da troca multipla
+ *    - --tui: terminal em modo bruto (tecla sem ENTER), modelo da tela
+ *      em memoria com uma celula por peca; so os trechos que mudaram
+ *      saem, com o cursor posicionado (ESC[linha;colunaH), num write()
+ *    - --medir: tempo de cada tecla ate o quadro enviado (p50/p99/max)
+ * 
+ * 14. INSTRUMENTACAO (-DINSTRUMENTAR, --contadores arq):
+ *    - Eventos das primitivas: enqueue/push ignorados por fila/pilha
+ *      cheia, trocas recusadas por falta de pecas, pecas geradas
+ *    - Operacoes por codigo e resultado, com o tempo (ns) de cada uma,
+ *      por sessao (dentro da Sessao) e no total de todas as threads
+ *    - Cada thread conta no seu bloco, sem trava; os blocos so sao
+ *      somados quando o total e pedido (JSON ao sair)
+ *    - Sem a flag as macros CONTAR/REGISTRAR_OPERACAO somem: nenhum
+ *      custo e a Sessao nao cresce
+ * 
+ * 15. TABULEIRO (--lote --tabuleiro):
+ *    - Campo 10x40 com uma palavra de 16 bits por linha; as 6 colunas
+ *      que sobram sao paredes e abaixo do fundo ha linhas cheias, entao
+ *      nao existe teste de limite
+ *    - Colisao e fixacao: as 4 linhas da caixa da peca num uint64_t,
+ *      um AND / um OR; linhas cheias achadas as quatro de uma vez
+ *    - Pecas jogadas (1) e usadas (3) caem na coluna mais baixa; sem
+ *      espaco na entrada o campo e zerado (derrota)
+ *    - Desfazer/refazer copiam o campo guardado por posicao do historico
+ *    - Rotacao SRS so com tabelas constantes: forma por tipo e rotacao
+ *      e os 5 chutes de cada giro (girarPeca); o benchmark --srs
+ *      confere as tabelas contra a geometria e os deslocamentos do SRS
+ *    - Colocacoes alcancaveis (enumerarColocacoes): preenchimento em que
+ *      cada (rotacao, linha) e um mapa de bits de x; mover, descer e
+ *      cada teste de chute valem para a linha inteira de uma vez.
+ *      Rotacoes com as mesmas celulas contam uma vez so; o benchmark
+ *      --perft conta folhas com fila e reserva e confere contra uma
+ *      busca simples na grade
+ * 
+ * 16. AVALIACAO MONTE CARLO (opcao 9 / tecla 9):
+ *    - Jogar x reservar a frente: milhares de continuacoes aleatorias
+ *      (jogadas 1-3 sorteadas, pecas no tabuleiro com colocarPeca) a
+ *      partir da fila e da pilha atuais; nota = linhas limpas
+ *    - Uma thread por nucleo, cada uma no seu fluxo do PCG32 e com as
+ *      suas somas; nada e compartilhado ate o join
+ *    - Cada par (jogar, reservar) usa a mesma semente: as pecas futuras
+ *      sao as mesmas e a diferenca sai com bem menos ruido
+ *    - O saco atual e reembaralhado: a avaliacao nao enxerga a ordem
+ *      que a sessao vai gerar
+ *    - Orcamento de tempo fixo (200 ms); o resultado traz media e
+ *      intervalo de 95% e so escolhe quando o da diferenca exclui o 0
+ * 
+ * 17. SERVIDOR (servidor.c, cliente_carga.c):
+ *    - Opcoes 1-5 e o estado por socket Unix, uma linha por pedido; a
+ *      resposta traz o resultado, a peca e a fila e a pilha novas
+ *    - Poucas threads, um epoll cada; a conexao (com a sua Sessao) fica
+ *      na thread que a aceitou, sem travas
+ *    - Pedidos em pipeline: tudo o que chegou numa leitura sai num write
+ *    - O gerador de carga confere cada resposta numa copia local da
+ *      sessao com a mesma semente
  * =====================================================================
  */
\ No newline at end of file